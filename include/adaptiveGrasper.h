@@ -3,18 +3,31 @@
 
 #include <ros/ros.h>
 #include <XmlRpcValue.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include "utils/parsing_utilities.h"
+#include "utils/lockfree_mailbox.h"
+#include "utils/realtime_utilities.h"
+#include "utils/latency_histogram.h"
+#include "utils/solution_cache.h"
+#include "utils/async_logger.h"
 #include "contactState.h"
 #include "matricesCreator.h"
 #include "contactPreserver.h"
+#include "robotCommander.h"
+#include "jointStateHub.h"
+#include "debugTelemetry.h"
 
 // Msgs Includes
 #include "std_msgs/Float64.h"
+#include "adaptive_grasping/GraspSignal.h"
 #include <geometry_msgs/WrenchStamped.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 
 // Service Includes
-#include "std_srvs/Trigger.h"
 #include "adaptive_grasping/velCommand.h"
+#include "adaptive_grasping/ReferencePreview.h"
 #include "adaptive_grasping/adaptiveGrasp.h"
 #include "panda_softhand_safety/SafetyInfo.h"
 
@@ -30,6 +43,13 @@
 
 namespace adaptive_grasping {
 
+    // The timed stages of the control tick
+    enum loopStage {STAGE_INPUTS = 0, STAGE_READ_VALUES, STAGE_MATRICES, STAGE_TASK_BUILD, STAGE_SOLVE,
+        STAGE_SEND, STAGE_PUBLISH, STAGE_TICK, NUM_STAGES};
+
+    // The input sources of the control tick (each one with its generation counter)
+    enum inputSource {INPUT_CONTACTS = 0, INPUT_SYNERGY, INPUT_POSE, INPUT_TWIST, INPUT_X_D, INPUT_F_D_D, NUM_INPUTS};
+
     class adaptiveGrasper {
 
     public:
@@ -102,13 +122,21 @@ namespace adaptive_grasping {
         void spinROS();
 
         /** SPINGRASPER
-        * @brief Public function to run the adaptive loop
+        * @brief Public function to run the adaptive loop (on its own thread if in real-time mode)
         *
         * @param null
         * @return null
         */
         void spinGrasper();
 
+        /** CONTROLTICK
+        * @brief Public function to perform one step of the adaptive loop
+        *
+        * @param null
+        * @return null
+        */
+        void controlTick();
+
         /** SETCOMMANDANDSEND
         * @brief Class function to clear the service file, push back the new ref and send to robot commander
         *
@@ -118,6 +146,15 @@ namespace adaptive_grasping {
         */
         bool setCommandAndSend(Eigen::VectorXd ref_vec, adaptive_grasping::velCommand comm);
 
+        /** ATTACHCOMMANDER
+        * @brief Public function to pass the commands to a robotCommander in the same process
+        *   (sets the command mode to in_process)
+        *
+        * @param commander pointer to a robotCommander created with in_process_ = true
+        * @return null
+        */
+        void attachCommander(robotCommander* commander);
+
         // The desired motion provided from outside
         Eigen::VectorXd x_d;                                // Contains the desired x motion (for Contact Preserver)
         Eigen::VectorXd f_d_d;                              // Contains the desired contact force variation (for Contact Preserver)
@@ -132,26 +169,111 @@ namespace adaptive_grasping {
         ros::Subscriber x_d_reference_sub;                    // Subscriber to x_d_reference
         ros::Subscriber f_d_d_reference_sub;                  // Subscriber to f_d_d_reference
         ros::Publisher marker_pub;                            // Publisher for object marker to RViz
-        ros::Publisher pub_twist_debug;                       // To visualize the twist in rqt_plot
-        ros::Publisher pub_error_tracking;                    // To save tracking error
         ros::ServiceClient client_rc;                         // Service client to robot commander
+        ros::Publisher pub_command;                           // Publisher of the commands to robot commander (topic mode)
+        std_msgs::Float64MultiArray command_msg;              // Preallocated command message (topic mode)
+        std::string command_mode = "topic";                   // How commands reach robot commander: service, topic or in_process
+        robotCommander* in_process_commander = nullptr;       // The robot commander in the same process (in_process mode)
         ros::ServiceServer server_ag;                         // Service server for adaptive grasper
-        ros::ServiceClient signal_client;                     // Service client to signal that adaptive grasping ended
-        std_srvs::Trigger signal_srv;                         // Service message to be sent to trigger end
+        ros::Publisher pub_signal;                            // Latched publisher of the grasp signal (running or why it stopped)
+        adaptive_grasping::GraspSignal signal_msg;            // The grasp signal message
         double spin_rate;                                     // Rate at which the adaptive grasper should run
 
-        // RViz object marker elements
+        // RViz object marker elements (published by a timer, not by the object pose callback)
         uint32_t shape = visualization_msgs::Marker::SPHERE;
         visualization_msgs::Marker obj_marker;
+        ros::Timer marker_timer;
 
-        // Wrench message for twist publishing for rqt_plot
-        geometry_msgs::WrenchStamped twist_wrench;          // Publishing twist as a wrench (For Debugging)
+        // Debug telemetry published by a low priority thread: the object twist (as a wrench, for rqt_plot)
+        // and the tracking error
+        debugTelemetry telemetry;
+        int twist_channel = -1;
+        int error_channel = -1;
 
         // Boolean true if the algorithm should continue running
-        bool run;
+        std::atomic<bool> run;
+
+        // The grasp signal set by the callbacks (a GraspSignal reason, -1 if none): the control loop resets the
+        // contacts and publishes it, so that the callbacks never wait for other nodes
+        std::atomic<int> pending_signal{-1};
+
+        // Fixed sizes of the inputs: hand joints (rows of S), desired motion (synergy + arm twist) and contact force
+        static const int SYN_ROWS = 33;
+        static const int X_D_SIZE = 7;
+        static const int F_D_D_SIZE = 6;
+        typedef Eigen::Matrix<double, SYN_ROWS, 1> synVector;
+        typedef Eigen::Matrix<double, X_D_SIZE, 1> xdVector;
+        typedef Eigen::Matrix<double, F_D_D_SIZE, 1> fddVector;
+
+        // Mailboxes where the callbacks post the latest inputs for the control loop (fixed size payloads, so
+        // posting and fetching never allocate); the pose one has two readers (control loop and marker timer)
+        tripleBufferMailbox<synVector> syn_mailbox;
+        seqlockMailbox<Eigen::Affine3d> pose_mailbox;
+        tripleBufferMailbox<xdVector> x_d_mailbox;
+        tripleBufferMailbox<fddVector> f_d_d_mailbox;
+
+        // Values fetched from the mailboxes (compared with the current ones before being used) and the
+        // versions of the pose last read by the control loop and by the marker timer
+        synVector S_fetched;
+        Eigen::Affine3d pose_fetched;
+        xdVector x_d_fetched;
+        fddVector f_d_d_fetched;
+        uint64_t pose_version = 0;
+        uint64_t marker_pose_version = 0;
+
+        // Generation counters of the inputs (bumped only when a value changes) and the last solution of the run
+        // with the generations it was computed from (reused while no input changes, if it was not degraded by the
+        // time budget of the inversion)
+        bool skip_unchanged_ticks = true;
+        unsigned long input_gen[NUM_INPUTS] = {};
+        solutionCache<NUM_INPUTS> solution_cache;
+        Eigen::VectorXd x_send;                             // The scaled reference sent to the commander (x_ref is never scaled)
+        std::atomic<unsigned long> skipped_ticks{0};
+        std::atomic<unsigned long> recomputed_ticks{0};
+        unsigned long total_skipped = 0;
+        unsigned long total_recomputed = 0;
+
+        // Multi-rate scheduling: contacts refresh, matrices and factorization, solve and send run on the ticks
+        // multiple of their dividers (spin_rate / stage rate); factorized_gen are the generations of the factorization
+        bool multi_rate = false;
+        int contacts_div = 1;
+        int matrices_div = 1;
+        int solve_div = 1;
+        int send_div = 1;
+        unsigned long tick_index = 0;
+        bool have_contacts = false;
+        bool factorization_ready = false;
+        unsigned long factorized_gen[NUM_INPUTS] = {};
+
+        // Real-time mode params: control loop on its own thread with absolute deadlines, callbacks
+        // on an AsyncSpinner, SCHED_FIFO priority (if > 0), cpu affinity (if >= 0) and memory locking
+        bool realtime_mode = false;
+        int rt_priority = 0;
+        int rt_cpu = -1;
+        bool rt_lock_memory = false;
+        int callback_threads = 2;
+
+        // Loop instrumentation: latency histograms per stage, period and jitter histograms, tick counters
+        // (written by the control loop, drained by the diagnostics timer) and diagnostics publishing
+        static const char* STAGE_NAMES[NUM_STAGES];
+        latencyHistogram stage_hist[NUM_STAGES];
+        latencyHistogram period_hist;
+        latencyHistogram jitter_hist;
+        uint64_t period_ns = 1000000;
+        std::chrono::steady_clock::time_point last_tick_start;
+        std::atomic<unsigned long> tick_count{0};
+        std::atomic<unsigned long> tick_overruns{0};
+        std::atomic<unsigned long> deadline_overruns{0};
+        unsigned long total_overruns = 0;
+        ros::WallTime last_diag_time;
+        ros::Publisher pub_diagnostics;
+        ros::Timer diag_timer;
 
         // Message variables
         sensor_msgs::JointState::ConstPtr full_joint_state;      // A msg where the subscriber will save the joint states
+        jointStateHub joint_hub;                                 // Indexed access to the hand joints in full_joint_state
+        int hand_block;                                          // Handle of the 33 hand joints in joint_hub
+        synVector syn_buffer;                                    // The synergy matrix computed in the joint states callback
 
         // XMLRPC elements
         XmlRpc::XmlRpcValue adaptive_params;
@@ -211,6 +333,21 @@ namespace adaptive_grasping {
         // The service file to be sent to the robot commander server
         adaptive_grasping::velCommand ref_command;
 
+        // Reference preview: preview_knots next references, preview_step apart, ramping linearly from the last sent
+        // reference to the new one over one send period (the reference is delayed by one send period and never
+        // extrapolated), so that a streaming commander interpolates them at the controller rate while the reference
+        // is computed at a lower rate (0 knots disables it); the ramp restarts when run toggles (preview_running)
+        int preview_knots = 0;
+        double preview_step = 0.0;
+        bool preview_running = false;
+        bool have_sent_ref = false;
+        xdVector last_sent_ref;
+        std::chrono::steady_clock::time_point last_sent_time;
+        std::vector<double> preview_refs;
+        std::vector<double> preview_times;
+        ros::Publisher pub_preview;                           // Publisher of the commands with preview (topic mode)
+        adaptive_grasping::ReferencePreview preview_msg;      // Preallocated command with preview message (topic mode)
+
         // The vector for sending zeros to the velocity and twist controllers (same dimension as x_ref)
         Eigen::VectorXd zero_ref;
 
@@ -222,6 +359,114 @@ namespace adaptive_grasping {
         */
         bool parseParams(XmlRpc::XmlRpcValue params_xml, std::vector<std::string> param_names);
 
+        /** BUILDPREVIEW
+        * @brief Class function to build the preview of the next references as a ramp from the last sent
+        *   reference to the new one over the time since the last send (fills preview_refs)
+        *
+        * @param ref_vec the new reference (replaced by the first knot of the ramp, i.e. the last sent one)
+        * @return null
+        */
+        void buildPreview(Eigen::VectorXd& ref_vec);
+
+        /** SPINREALTIME
+        * @brief Class function to run the control loop thread and the callback threads
+        *
+        * @param null
+        * @return null
+        */
+        void spinRealtime();
+
+        /** CONTROLLOOP
+        * @brief Class function run by the control thread (absolute deadlines at spin_rate)
+        *
+        * @param null
+        * @return null
+        */
+        void controlLoop();
+
+        /** FETCHINPUTS
+        * @brief Class function to read the latest inputs posted by the callbacks
+        *
+        * @param null
+        * @return null
+        */
+        void fetchInputs();
+
+        /** PROCESSSIGNAL
+        * @brief Class function to reset the contacts and publish the grasp signal set by the callbacks (if any)
+        *
+        * @param null
+        * @return null
+        */
+        void processSignal();
+
+        /** MULTIRATESTAGES
+        * @brief Class function to run the due stages of the multi-rate loop: contacts refresh, matrices and
+        *   factorization (slow), solve with the factorization (fast); leaves in x_ref the last solution of the
+        *   run (x_d before the first one)
+        *
+        * @param null
+        * @return uint64_t ns spent publishing debug info
+        */
+        uint64_t multiRateStages();
+
+        /** RATEDIVIDER
+        * @brief Class function to get the number of ticks between two runs of a stage from its rate param
+        *
+        * @param rate_name the name of the rate param
+        * @return int the divider (at least 1)
+        */
+        int rateDivider(std::string rate_name);
+
+        /** PUBLISHTWISTDEBUG
+        * @brief Class function to sample the twist part of x_ref for the telemetry (published as a wrench for rqt_plot)
+        *
+        * @param null
+        * @return null
+        */
+        void publishTwistDebug();
+
+        /** RECORDSTAGE
+        * @brief Class function to record in the stage histogram the time since t_last (then set to now)
+        *
+        * @param stage the loopStage
+        * @param t_last the start of the stage
+        * @return null
+        */
+        void recordStage(int stage, std::chrono::steady_clock::time_point& t_last);
+
+        /** ELAPSEDNS
+        * @brief Class function to get the ns elapsed since a time point
+        *
+        * @param t_from the time point
+        * @return uint64_t ns
+        */
+        static uint64_t elapsedNs(const std::chrono::steady_clock::time_point& t_from);
+
+        /** RECORDLOOPTIMING
+        * @brief Class function to record the period and the jitter of the control loop
+        *
+        * @param t_tick the start of the current tick
+        * @return null
+        */
+        void recordLoopTiming(const std::chrono::steady_clock::time_point& t_tick);
+
+        /** PUBLISHDIAGNOSTICS
+        * @brief Timer callback to publish the loop and stage statistics on /diagnostics
+        *
+        * @param event
+        * @return null
+        */
+        void publishDiagnostics(const ros::TimerEvent& event);
+
+        /** PUBLISHMARKER
+        * @brief Timer callback to publish the object marker to RViz (only if a new pose arrived)
+        *
+        * @param event the timer event
+        * @return null
+        */
+        void publishMarker(const ros::TimerEvent& event);
+
         /** GETJOINTSANDCOMPUTESYN
         * @brief Callback function to get the joint states and compute the synergy matrix
         *
@@ -3,11 +3,13 @@
 
 #include <iostream>
 #include <vector>
+#include <chrono>
 #include <Eigen/Dense>
 #include <ros/subscriber.h>
 #include <geometry_msgs/Twist.h>
 
 #include "task_utils/reversePriorityManager.h"
+#include "utils/lockfree_mailbox.h"
 #include "task_utils/stackOfTasksManager.h"
 
 /**
@@ -18,6 +20,26 @@
 
 namespace adaptive_grasping {
 
+  // The solver that produced the last reference (full task inversion or one of the cheaper fallbacks)
+  enum solverFallback {
+    FALLBACK_NONE = 0,          // Full RP / SOT task inversion
+    FALLBACK_DLS = 1,           // Single damped least squares solve on the whole Q_tilde
+    FALLBACK_PREVIOUS = 2       // Last full or DLS solution scaled (once, not again on every fallback tick)
+  };
+
+  // Statistics on the per tick time budget of performKinInversion
+  struct solverBudgetStats {
+    unsigned long ticks = 0;                // Number of calls to performKinInversion
+    unsigned long overruns = 0;             // Number of calls which exceeded the budget
+    unsigned long dls_fallbacks = 0;        // Number of times the DLS fallback was used
+    unsigned long previous_fallbacks = 0;   // Number of times the previous solution was reused
+    solverFallback last_fallback = FALLBACK_NONE;
+    double last_duration = 0.0;             // Duration of the last call [s]
+    double max_duration = 0.0;              // Worst duration seen so far [s]
+    double last_build_duration = 0.0;       // Duration of the task building part of the last call [s]
+    double last_solve_duration = 0.0;       // Duration of the solving part of the last call [s]
+  };
+
   class contactPreserver {
 
   public:
@@ -96,6 +118,25 @@ namespace adaptive_grasping {
     */
     bool initialize_tasks(int num_tasks_, std::vector<int> dim_tasks_, std::vector<int> prio_tasks_, double lambda_max_, double epsilon_);
 
+    /** SETTIMEBUDGET
+    * @brief Function to set the time budget of a single performKinInversion call
+    *
+    * @param budget_
+    *   the time budget in seconds (a value <= 0 disables the budget)
+    * @param fallback_scale_
+    *   the scaling applied to the last full or DLS solution when it is reused (applied once: consecutive
+    *   fallback ticks send the same scaled copy)
+    * @return null
+    */
+    void setTimeBudget(double budget_, double fallback_scale_);
+
+    /** GETBUDGETSTATS
+    * @brief Function to get the statistics on the time budget (overruns and used fallbacks)
+    *
+    * @return solverBudgetStats the current statistics
+    */
+    solverBudgetStats getBudgetStats();
+
     /** CHANGEHANDTYPE
     * @brief Function to eventually change the hand type (set new S)
     *
@@ -178,6 +219,31 @@ namespace adaptive_grasping {
     */
     bool performKinInversion(Eigen::VectorXd& x_result);
 
+    /** PREPAREINVERSION
+    * @brief Function to build the task set from the current grasp state and to factorize it (the slow
+    *   part of performKinInversion: the task velocities are given later to solveInversion)
+    *
+    * @return bool true if the factorization is ready
+    */
+    bool prepareInversion();
+
+    /** SOLVEINVERSION
+    * @brief Function to solve the factorized task set for the current x_d, f_d_d and object twist
+    *   (the fast part, only matrix vector products)
+    *
+    * @param x_result
+    *   the resulting motion that preserves contacts
+    * @return bool success if the found result is a valid one
+    */
+    bool solveInversion(Eigen::VectorXd& x_result);
+
+    /** UPDATEOBJECTTWIST
+    * @brief Function to get the latest object twist posted by the callback (also done by performKinInversion)
+    *
+    * @return bool true if the object twist changed
+    */
+    bool updateObjectTwist();
+
     /** PRINTALL
     * @brief Function to print out to console all relevant variables
     *
@@ -219,8 +285,9 @@ namespace adaptive_grasping {
     // Previous planner desired motions
     Eigen::VectorXd x_d_old;
 
-    // The object twist set by the object twist subscriber
+    // The object twist (fetched from the mailbox written by the object twist subscriber)
     Eigen::VectorXd xi_o;
+    tripleBufferMailbox<Eigen::Matrix<double, 6, 1>> xi_o_mailbox;
 
     // Planner desired contact forces derivative
     Eigen::VectorXd f_d_d;
@@ -228,7 +295,7 @@ namespace adaptive_grasping {
     // Full minimization solution
     Eigen::VectorXd x_ref;
 
-    // Full minimization solution
+    // Last full or DLS minimization solution (kept while the previous solution fallback is used)
     Eigen::VectorXd x_ref_old;
 
     // Constant term for Q_tilde (obtained by appending zeros under x_d)
@@ -297,6 +364,24 @@ namespace adaptive_grasping {
     // Null space basis of Q_tilde
     Eigen::MatrixXd N_tilde;
 
+    // Time budget of performKinInversion [s] (disabled if <= 0) and scaling of the reused previous solution
+    double time_budget = 0.0;
+    double fallback_scale = 1.0;
+
+    // Moving estimates of the duration of the full task inversion and of the DLS fallback [s]
+    double full_solve_estimate = 0.0;
+    double dls_solve_estimate = 0.0;
+
+    // Statistics on overruns and fallbacks
+    solverBudgetStats budget_stats;
+
+    // Rows of y of each task in insertion order (start row and dimension), the task velocities sliced from y
+    // and Kc * H * G^T (for the solves with the factorized task set)
+    std::vector<std::pair<int, int>> task_rows;
+    std::vector<Eigen::VectorXd> task_x_dots;
+    Eigen::MatrixXd KcHGt;
+    bool factorized = false;
+
     // PRIVATE FUNCTIONS
     /** CREATEFORCEREFVEC
     * @brief For creating the contact force vector reference after transforming to each finger local frame
@@ -304,6 +389,25 @@ namespace adaptive_grasping {
     */
     Eigen::VectorXd create_force_ref_vec(std::map<int, std::tuple<std::string, Eigen::Affine3d, Eigen::Affine3d>> contacts_map, Eigen::VectorXd f_d_d);
 
+    /** SOLVEDAMPEDLEASTSQUARES
+    * @brief Cheap fallback: a single damped least squares solve of Q_tilde * x = y (no priorities)
+    *
+    * @param x_sol
+    *   the resulting motion
+    * @return null
+    */
+    void solve_damped_least_squares(Eigen::VectorXd& x_sol);
+
+    /** BUILDQTILDE, BUILDY, BUILDTASKSET
+    * @brief The steps of the inversion: Q and Q_tilde (from the grasp state), y (from x_d, f_d_d and
+    *   the object twist) and the task set (sliced from Q_tilde and y, in tmp_task_vec and task_rows)
+    *
+    * @return null
+    */
+    void build_Q_tilde();
+    void build_y();
+    void build_task_set();
+
 	/** OBJECTTWISTCALLBACK
     * @brief Callback function to get the object twist from a topic
     *
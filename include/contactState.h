@@ -2,18 +2,37 @@
 #define CONTACT_STATE_H
 
 #include <map>
+#include <set>
 #include <tuple>
 #include <Eigen/Dense>
 #include <std_msgs/Int8.h>
 #include <mutex>
+#include <atomic>
+#include <memory>
 #include <ros/ros.h>
-#include <tf/transform_listener.h>
-#include <tf_conversions/tf_eigen.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <eigen_conversions/eigen_kdl.h>
+#include <kdl_parser/kdl_parser.hpp>
+#include <kdl/tree.hpp>
+#include <kdl/chain.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
 #include <sensor_msgs/JointState.h>
 
 // SERVICE INCLUDES
 #include "finger_fk/FingerJointsService.h"
 
+// MESSAGE INCLUDES
+#include "adaptive_grasping/FingerTouches.h"
+
+// OTHER INCLUDES
+#include "utils/spsc_ring_buffer.h"
+#include "jointStateHub.h"
+
+// The capacity of each touch event queue
+#define TOUCH_QUEUE_SIZE  64
+
 /**
 * @brief This class is called by the adaptive_grasping method to get the
 * state of the contacts (i.e. how many and which fingers are touching). This
@@ -24,6 +43,29 @@
 
 namespace adaptive_grasping {
 
+  // A set of touches as received from the touch topics (bit id - 1 of the finger mask for finger id)
+  struct touchEvent {
+    uint8_t finger_mask;
+    uint32_t link_mask;
+    ros::Time stamp;
+  };
+
+  // Counters of the touch event queue
+  struct touchQueueStats {
+    unsigned long processed;
+    unsigned long dropped;
+    size_t depth;
+    size_t high_water;
+  };
+
+  // An immutable published state of the contacts (readers keep it alive as long as they use it)
+  struct contactSnapshot {
+    std::map<int, std::tuple<std::string, Eigen::Affine3d, Eigen::Affine3d>> contacts_map;
+    std::map<int, sensor_msgs::JointState> joints_map;
+    unsigned long generation = 0;
+    ros::Time stamp;
+  };
+
   class contactState {
 
   public:
@@ -81,6 +123,40 @@ namespace adaptive_grasping {
       Eigen::Affine3d>>& input_map_,
         std::map<int, sensor_msgs::JointState>& input_map2_);
 
+    /** PROCESSPENDINGTOUCHES
+    * @brief Class function to drain the queued touch events and to update the maps
+    *   once for all of them (to be called at the start of each control tick)
+    *
+    * @param null
+    * @return int the number of processed touch events
+    */
+    int processPendingTouches();
+
+    /** GETTOUCHINGLINKS
+    * @brief Class function to read the mask of touching links received since the last reset
+    *
+    * @param null
+    * @return uint32_t link mask (0 if the touch publisher does not provide it)
+    */
+    uint32_t getTouchingLinks();
+
+    /** GETTOUCHQUEUESTATS
+    * @brief Class function to read the counters of the touch event queue
+    *
+    * @param null
+    * @return touchQueueStats
+    */
+    touchQueueStats getTouchQueueStats();
+
+    /** GETSNAPSHOT
+    * @brief Class function to get the latest published contact state without locking
+    *   (the snapshot never changes, a new one is published on every update)
+    *
+    * @param null
+    * @return shared pointer to the snapshot
+    */
+    std::shared_ptr<const contactSnapshot> getSnapshot();
+
     /** RESETCONTACTS
     * @brief Class function to reset the maps
     *
@@ -91,24 +167,69 @@ namespace adaptive_grasping {
 
   private:
 
-    // A mutual exclusion lock for the variables of this class
-    std::mutex contact_state_mutex;
+    // A mutual exclusion lock serializing the writers (processPendingTouches and resetContact)
+    // on the working maps; the readers only use the published snapshot and never lock
+    std::mutex writer_mutex;
+
+    // The latest published snapshot (accessed only with std::atomic_load/store) and its generation
+    std::shared_ptr<const contactSnapshot> snapshot;
+    unsigned long snapshot_generation = 0;
 
     // The finger which has just touched (read via topic)
     int touching_finger;
 
-    // Transform listener and stamped transform for lookupTransform
-    tf::TransformListener tf_listener;
-    tf::StampedTransform stamped_transform;
+    // The queues of touch events (one per topic, each with a single producer: handleCollision and
+    // handleTouches; both popped by processPendingTouches), their counters, the touching links
+    // and the time of the last reset (older events are discarded)
+    spscRingBuffer<touchEvent, TOUCH_QUEUE_SIZE> touch_queue;
+    spscRingBuffer<touchEvent, TOUCH_QUEUE_SIZE> mask_queue;
+    std::atomic<uint32_t> touching_links{0};
+    std::atomic<unsigned long> processed_touches{0};
+    std::atomic<unsigned long> dropped_touches{0};
+    std::atomic<size_t> queue_high_water{0};
+    std::atomic<uint64_t> last_reset_nsec{0};
+
+    // The tf2 buffer and its listener (which fills the buffer from its own thread)
+    tf2_ros::Buffer tf_buffer;
+    std::unique_ptr<tf2_ros::TransformListener> tf_listener;
+
+    // Maximum age of a transform before being considered stale (<= 0 disables the check) and
+    // what to do with a stale one: "use" it anyway or "hold" the previously saved transform
+    double tf_max_age = 0.1;
+    std::string tf_stale_policy = "hold";
+
+    // The last world to palm transform and if one was ever received (no contact is placed before)
+    Eigen::Affine3d world_palm_aff = Eigen::Affine3d::Identity();
+    bool have_world_palm = false;
+
+    // Kinematic tree of the robot and, for each finger id, the palm to finger chain and its position solver
+    bool use_fk = true;
+    KDL::Tree robot_kin_tree;
+    std::map<int, KDL::Chain> finger_chains;
+    std::map<int, std::shared_ptr<KDL::ChainFkSolverPos_recursive>> fk_solvers;
+    std::map<int, std::vector<std::string>> finger_joint_names;
 
-    // The map containing info on all the fingers in collision
+    // The working map containing info on all the fingers in collision
     std::map<int, std::tuple<std::string, Eigen::Affine3d,
       Eigen::Affine3d>> contacts_map;
 
-    // The map containing the joint state of the touched fingers
-    // Here we suppose that the finger_fk finger_joints_service is running
+    // The contacts whose transforms were computed at least once (fresh from tf or from the forward kinematics):
+    // the others stay in the working maps, out of the published snapshot, and are retried at every
+    // processPendingTouches until they get one (transforms_pending)
+    std::set<int> valid_contacts;
+    std::atomic<bool> transforms_pending{false};
+
+    // The working map containing the joint state of the touched fingers
+    // (extracted from the joint states or, as fallback, from the finger_fk finger_joints_service)
     std::map<int, sensor_msgs::JointState> joints_map;
 
+    // The latest joint state (guarded by its own mutex) and the hub with the joints of each finger
+    // (only used by the thread updating the contacts)
+    std::mutex joint_state_mutex;
+    sensor_msgs::JointState::ConstPtr latest_joint_state;
+    jointStateHub joint_hub;
+    bool use_fj_service = false;
+
     // Map for storing already read params from paramter server
     std::map<std::string, std::string> params_map;
 
@@ -119,6 +240,8 @@ namespace adaptive_grasping {
     // and the service client for finger_joints_service
     ros::NodeHandle node_contact_state;
     ros::Subscriber finger_col_sub;
+    ros::Subscriber touches_sub;
+    ros::Subscriber js_sub;
     ros::ServiceClient fj_client;
 
     // Publisher for number of touches
@@ -126,7 +249,7 @@ namespace adaptive_grasping {
     std_msgs::Int8 num_msg;
 
     /** HANDLECOLLISION
-    * @brief Callback function to handle the touching topic (finger_col_sub)
+    * @brief Callback function to handle the touching topic (finger_col_sub): it only queues the touch
     *
     * @param Int8 msg
     *   the listened message or the finger_col_sub
@@ -134,6 +257,39 @@ namespace adaptive_grasping {
     */
     void handleCollision(const std_msgs::Int8::ConstPtr& msg);
 
+    /** HANDLETOUCHES
+    * @brief Callback function to handle the stamped multi finger touches topic (touches_sub):
+    *   it queues the whole set of touching fingers at once
+    *
+    * @param FingerTouches msg
+    *   the listened message
+    * @return void (as all callbacks)
+    */
+    void handleTouches(const adaptive_grasping::FingerTouches::ConstPtr& msg);
+
+    /** QUEUETOUCHES
+    * @brief Auxiliary function to push a set of touches into a queue and update the counters
+    *
+    * @param queue
+    *   the queue of the calling callback
+    * @param finger_mask, link_mask
+    *   the touching fingers and links
+    * @param stamp
+    *   the time of the touches
+    * @return void
+    */
+    void queueTouches(spscRingBuffer<touchEvent, TOUCH_QUEUE_SIZE>& queue,
+      uint8_t finger_mask, uint32_t link_mask, ros::Time stamp);
+
+    /** PUBLISHSNAPSHOT
+    * @brief Auxiliary function to publish the working maps as a new snapshot (only the
+    *   contacts with valid transforms, to be called with writer_mutex held)
+    *
+    * @param null
+    * @return void
+    */
+    void publishSnapshot();
+
     /** ITERATECONTACTS
     * @brief Auxiliary function to iterate and update the contacts_map
     *
@@ -150,14 +306,52 @@ namespace adaptive_grasping {
     */
     void iterateJoints();
 
-    /** GETTRANSFORM
-    * @brief Class function to echo frame for the touching fingers
-    *   which will be written an Eigen::Affine3d
+    /** GETJOINTSTATE
+    * @brief Callback function to save the latest joint state (js_sub)
+    *
+    * @param msg
+    *   the joint state message
+    * @return void (as all callbacks)
+    */
+    void getJointState(const sensor_msgs::JointState::ConstPtr& msg);
+
+    /** PREPAREKDL
+    * @brief Class function to load the kinematic tree and to create the palm to finger
+    *   chains and forward kinematics solvers
     *
     * @param null
-    * @return Eigen::Affine3d = transfrom of echoed frames
+    * @return bool (success or failure)
+    */
+    bool prepareKDL();
+
+    /** COMPUTEFINGERFK
+    * @brief Class function to compute the palm to finger transform from the finger joints
+    *
+    * @param finger_id
+    *   the id of the finger
+    * @param finger_joints
+    *   the joint state of the finger (ordered as in its chain)
+    * @param palm_aff
+    *   the resulting palm to finger transform
+    * @return bool = true if the forward kinematics could be computed
+    */
+    bool computeFingerFK(int finger_id, const sensor_msgs::JointState& finger_joints,
+      Eigen::Affine3d& palm_aff);
+
+    /** GETTRANSFORM
+    * @brief Class function to get from the tf2 buffer (without waiting) the latest
+    *   transform between two frames which will be written an Eigen::Affine3d
+    *
+    * @param frame1_name, frame2_name
+    *   the names of the frames
+    * @param affine
+    *   the latest cached transform (untouched if there is none)
+    * @param age
+    *   the age of the transform in seconds
+    * @return bool = true if a transform was found and it is not stale
     */
-    Eigen::Affine3d getTrasform(std::string frame1_name, std::string frame2_name);
+    bool getTrasform(std::string frame1_name, std::string frame2_name,
+      Eigen::Affine3d& affine, double& age);
 
   }; // closing class
 
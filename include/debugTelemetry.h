@@ -0,0 +1,149 @@
+#ifndef DEBUG_TELEMETRY_H
+#define DEBUG_TELEMETRY_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <Eigen/Core>
+#include <ros/ros.h>
+#include <std_msgs/Float64.h>
+#include <std_msgs/Float64MultiArray.h>
+#include <geometry_msgs/Twist.h>
+#include <geometry_msgs/WrenchStamped.h>
+#include "utils/lockfree_mailbox.h"
+
+// Maximum number of values of a telemetry sample
+#define TELEMETRY_MAX_VALUES 16
+
+/**
+* @brief This class is used by the control and command paths to publish debug
+* data without serializing or writing to sockets in those paths: sampling only
+* copies the values into the latest value slot of the channel (lock-free), a low
+* priority thread publishes every channel at its own (decimated) rate, only if a
+* new sample arrived. A channel with rate 0 is disabled and sampling it costs a
+* branch. Every channel must be sampled by one thread at a time.
+*
+*/
+
+namespace adaptive_grasping {
+
+  // The message types a channel can be published as (twist and wrench take 6 values: linear / force then angular / torque)
+  enum telemetryType {TELEMETRY_FLOAT64 = 0, TELEMETRY_ARRAY, TELEMETRY_TWIST, TELEMETRY_WRENCH};
+
+  // A sample of a channel (plain data, passed through a seqlock mailbox)
+  struct telemetrySample {
+    double values[TELEMETRY_MAX_VALUES];
+    int size;
+    uint64_t stamp_ns;
+  };
+
+  class debugTelemetry {
+
+  public:
+
+    /** DEFAULT CONSTRUCTOR
+    * @brief Default constructor for debugTelemetry
+    *
+    * @param null
+    * @return null
+    */
+    debugTelemetry();
+
+    /** DESTRUCTOR
+    * @brief Default destructor for debugTelemetry (stops the publishing thread)
+    *
+    * @param null
+    * @return null
+    */
+    ~debugTelemetry();
+
+    /** ADDCHANNEL
+    * @brief Registers a channel and advertises its topic (before start); the rate is read
+    *   from rate_param (0 disables the channel)
+    *
+    * @param nh the node handle used to advertise and to read the rate
+    * @param topic the topic name
+    * @param type the message type
+    * @param rate_param the name of the rate param [Hz]
+    * @param default_rate the rate if the param is not set
+    * @param frame_id the frame of the stamped messages
+    * @return the handle of the channel (for sample), -1 if disabled
+    */
+    int addChannel(ros::NodeHandle& nh, std::string topic, telemetryType type, std::string rate_param,
+      double default_rate, std::string frame_id = "world");
+
+    /** START / STOP
+    * @brief Starts / stops the low priority publishing thread
+    *
+    * @param null
+    * @return null
+    */
+    void start();
+    void stop();
+
+    /** SAMPLE
+    * @brief Copies the values into the latest value slot of the channel (never blocks, never allocates)
+    *
+    * @param handle the handle of the channel (nothing is done if -1)
+    * @param values / value the values to be published (at most TELEMETRY_MAX_VALUES)
+    * @return null
+    */
+    void sample(int handle, const double* values, int size);
+    void sample(int handle, double value){
+      sample(handle, &value, 1);
+    }
+    template <typename Derived>
+    void sample(int handle, const Eigen::DenseBase<Derived>& values){
+      if(handle < 0) return;
+      double buffer[TELEMETRY_MAX_VALUES];
+      int size = std::min(int(values.size()), TELEMETRY_MAX_VALUES);
+      for(int i = 0; i < size; i++) buffer[i] = values(i);
+      sample(handle, buffer, size);
+    }
+
+    /** GETPUBLISHED
+    * @brief Returns the number of messages published so far
+    *
+    * @param null
+    * @return the number of messages
+    */
+    unsigned long getPublished() const;
+
+  private:
+
+    // A channel: its publisher, rate and the slot where the samples are written
+    struct telemetryChannel {
+      ros::Publisher pub;
+      telemetryType type;
+      std::string frame_id;
+      int64_t period_ns;
+      int64_t next_ns = 0;
+      uint64_t version = 0;
+      seqlockMailbox<telemetrySample> mailbox;
+    };
+    std::vector<std::unique_ptr<telemetryChannel>> channels;
+
+    // The publishing thread
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::atomic<unsigned long> published{0};
+
+    // Preallocated messages (only used by the publishing thread)
+    std_msgs::Float64 float_msg;
+    std_msgs::Float64MultiArray array_msg;
+    geometry_msgs::Twist twist_msg;
+    geometry_msgs::WrenchStamped wrench_msg;
+
+    // The loop of the publishing thread and the publishing of a sample
+    void workerLoop();
+    void publishSample(telemetryChannel& channel, const telemetrySample& sample);
+
+  };
+
+}
+
+#endif // DEBUG_TELEMETRY_H
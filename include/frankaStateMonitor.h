@@ -0,0 +1,140 @@
+#ifndef FRANKA_STATE_MONITOR_H
+#define FRANKA_STATE_MONITOR_H
+
+#include <string>
+#include <Eigen/Dense>
+#include <ros/ros.h>
+#include <franka_msgs/FrankaState.h>
+#include "utils/windowed_statistics.h"
+
+/**
+* @brief This class is used by fullGrasper to read the franka states: the last
+* message is held (not copied) and its fields are mapped with Eigen::Map, while
+* windowed statistics (mean, variance, peak, rate of change) of the tau_ext norm,
+* the EE and joint speeds and the EE position are updated incrementally at every
+* message, together with the time the arm has been still. Every query is O(1).
+* The monitor is meant to be updated and read under the same lock.
+*
+*/
+
+namespace adaptive_grasping {
+
+  class frankaStateMonitor {
+
+  public:
+
+    // The monitored signals (the speeds are the norms of the EE twist O_dP_EE_c and of the measured dq)
+    enum monitorChannel {TAU_EXT_NORM = 0, EE_SPEED, JOINT_SPEED, EE_X, EE_Y, EE_Z, NUM_CHANNELS};
+
+    /** DEFAULT CONSTRUCTOR
+    * @brief Default constructor for frankaStateMonitor
+    *
+    * @param null
+    * @return null
+    */
+    frankaStateMonitor();
+
+    /** DESTRUCTOR
+    * @brief Default destructor for frankaStateMonitor
+    *
+    * @param null
+    * @return null
+    */
+    ~frankaStateMonitor();
+
+    /** CONFIGURE
+    * @brief Sets the window of the statistics and the signal and threshold of the stillness
+    *
+    * @param window the window of the statistics [s]
+    * @param still_channel the speed checked for the stillness (EE_SPEED or JOINT_SPEED)
+    * @param still_threshold the speed below which the arm is still
+    * @return null
+    */
+    void configure(double window, monitorChannel still_channel, double still_threshold);
+
+    /** UPDATE
+    * @brief Takes a new franka state (held, not copied) and updates the statistics
+    *
+    * @param msg the franka state
+    * @return null
+    */
+    void update(const franka_msgs::FrankaState::ConstPtr& msg);
+
+    /** ISVALID
+    * @brief Checks if a franka state was received
+    *
+    * @param null
+    * @return true if valid
+    */
+    bool isValid() const;
+
+    /** GETSTATISTICS
+    * @brief Returns the windowed statistics of a signal
+    *
+    * @param channel the signal
+    * @return the statistics
+    */
+    const windowedStatistics& getStatistics(monitorChannel channel) const;
+
+    /** GETTRANSFORM, GETPOSITION, GETZAXIS, GETJOINTS
+    * @brief Views of the last franka state (valid only if isValid())
+    *
+    * @param null
+    * @return O_T_EE (column major), its position and z axis, the measured joints q
+    */
+    Eigen::Map<const Eigen::Matrix4d> getTransform() const;
+    Eigen::Vector3d getPosition() const;
+    Eigen::Vector3d getZAxis() const;
+    Eigen::Map<const Eigen::Matrix<double, 7, 1>> getJoints() const;
+
+    /** GETTAUEXTNORM
+    * @brief Returns the norm of tau_ext of the last franka state
+    *
+    * @param null
+    * @return the norm
+    */
+    double getTauExtNorm() const;
+
+    /** GETSTILLTIME
+    * @brief Returns for how long the still speed has been below the still threshold (robot time)
+    *
+    * @param null
+    * @return the time [s] (zero if moving)
+    */
+    double getStillTime() const;
+
+    /** GETAGE
+    * @brief Returns the time since the last franka state
+    *
+    * @param null
+    * @return the age [s] (infinite if none)
+    */
+    double getAge() const;
+
+    /** GETMESSAGE
+    * @brief Returns the last franka state
+    *
+    * @param null
+    * @return the message
+    */
+    franka_msgs::FrankaState::ConstPtr getMessage() const;
+
+  private:
+
+    // The last message and the time it was received
+    franka_msgs::FrankaState::ConstPtr msg;
+    ros::Time last_update;
+
+    // The statistics of the signals
+    windowedStatistics statistics[NUM_CHANNELS];
+
+    // The stillness: the speed checked, its threshold and the robot time since which it is below (negative if moving)
+    monitorChannel still_channel = JOINT_SPEED;
+    double still_threshold = 0.005;
+    double still_since = -1.0;
+
+  };
+
+}
+
+#endif // FRANKA_STATE_MONITOR_H
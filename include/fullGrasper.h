@@ -2,8 +2,14 @@
 #define FULL_GRASPER_H
 
 // Basic includes
+#include <mutex>
+#include <memory>
+#include <condition_variable>
 #include <ros/service.h>
+#include <actionlib/server/simple_action_server.h>
 #include <controller_manager_msgs/SwitchController.h>
+#include <controller_manager_msgs/ListControllers.h>
+#include <controller_manager_msgs/LoadController.h>
 #include <eigen_conversions/eigen_msg.h>
 
 // ROS msg includes
@@ -16,11 +22,15 @@
 
 // Custom msg and srv includes
 #include "adaptive_grasping/choose_object.h"
+#include "adaptive_grasping/GraspCycleAction.h"
 #include <franka_msgs/FrankaState.h>
 #include <franka_control/ErrorRecoveryActionGoal.h>
 
 // Custom Includes
 #include "adaptiveGrasper.h"                                // Most of other h files are included in this one
+#include "preGraspCache.h"
+#include "frankaStateMonitor.h"
+#include "debugTelemetry.h"
 #include "panda_softhand_control/PandaSoftHandClient.h"
 #include "panda_softhand_safety/SafetyInfo.h"
 
@@ -83,7 +93,7 @@ namespace adaptive_grasping {
         bool initialize(std::vector<std::string> param_names);
 
         /** SWITCHCONTROL
-        * @brief Public function for switching from a controller to another
+        * @brief Public function for switching from a controller to another (can be called by more threads)
         *
         * @param robot_name containing the name of robot
         * @param from_controller containing the name of controller to be stopped
@@ -92,6 +102,16 @@ namespace adaptive_grasping {
         */
         bool switch_control(std::string robot_name, std::string from_controller, std::string to_controller);
 
+        /** WAITFORCONTROLLER
+        * @brief Public function polling list_controllers until a controller is running or the timeout expires
+        *
+        * @param robot_name containing the name of robot
+        * @param controller containing the name of the controller
+        * @param timeout the maximum wait [s]
+        * @return bool = true if the controller is running
+        */
+        bool wait_for_controller(std::string robot_name, std::string controller, double timeout);
+
         /** SPIN
         * @brief Public function for spinning (recalls the spinGrasper function of adaptive_grasper)
         *
@@ -132,6 +152,14 @@ namespace adaptive_grasping {
         */
         void get_num_contacts(const std_msgs::Int8::ConstPtr &msg);
 
+        /** GETADAPTIVEGRASPINGSIGNAL
+        * @brief Callback function to get the grasp signal (latched) published by adaptive grasper
+        *
+        * @param msg
+        * @return null
+        */
+        void get_adaptive_grasping_signal(const adaptive_grasping::GraspSignal::ConstPtr &msg);
+
         /** GETJOINTSANDCOMPUTESYNJOINT
         * @brief Callback function to get the joint states and compute the synergy joint
         *
@@ -157,7 +185,8 @@ namespace adaptive_grasping {
         bool call_adaptive_grasp_task(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res);
 
         /** CALLENDADAPTIVEGRASP
-        * @brief Callback function for triggering the end of adaptive grasper
+        * @brief Callback function for triggering the end of adaptive grasper (kept for other nodes, adaptive
+        *   grasper uses the adaptive_grasping_signal topic)
         *
         * @param req / res
         * @return bool success
@@ -188,8 +217,131 @@ namespace adaptive_grasping {
         */
         bool call_switch_vel2pos(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res);
 
+        /** EXECUTEGRASPCYCLE
+        * @brief Callback function of the grasp cycle action: runs pregrasp, switch to velocity, adaptive grasp,
+        *   switch to position and postgrasp for every object of the goal back to back, preparing the velocity
+        *   control during the pregrasp motion and selecting the next object before the postgrasp; the latency of
+        *   every phase is sent as feedback and returned in the result (a preemption stops between cycles)
+        *
+        * @param goal the objects to be grasped
+        * @return null
+        */
+        void execute_grasp_cycle(const adaptive_grasping::GraspCycleGoalConstPtr &goal);
+
         private:
 
+        // The callbacks of the tasks run by the grasp cycle
+        typedef bool (fullGrasper::*taskCallback)(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res);
+
+        // The phases of the grasp sequencer (the adaptive grasp task, the handover wait of the post grasp task
+        // and the wait for the robot to stop before switching controllers)
+        enum graspPhase {PHASE_IDLE = 0, PHASE_APPROACH, PHASE_PIVOT, PHASE_RESTRAIN, PHASE_CLOSE, PHASE_LIFT,
+            PHASE_HANDOVER, PHASE_SETTLE, PHASE_DONE, PHASE_FAILED};
+        static const char* PHASE_NAMES[];
+
+        /** RUNGRASPSEQUENCE
+        * @brief Private function running the adaptive grasp task as a state machine (approach, pivot / restrain,
+        *   finish closing, lift) in the calling thread: the transitions are checked at the events of the callbacks
+        *   (pose, contacts, synergy, grasp signal) and at every tick of the sequencer rate, the references are
+        *   published when they change or at the reference rate
+        *
+        * @param grasp_pose the grasp pose (the approach ends there)
+        * @param approach_x_d the approach reference
+        * @return bool true if the sequence ended with the lift
+        */
+        bool run_grasp_sequence(const Eigen::Affine3d& grasp_pose, const std::vector<double>& approach_x_d);
+
+        /** SETPHASE
+        * @brief Private function to change the phase of the sequencer (logged)
+        *
+        * @param phase the new phase
+        * @return null
+        */
+        void set_phase(graspPhase phase);
+
+        /** NOTIFYSEQUENCER
+        * @brief Private function to signal an event to the sequencer if it waits in one of the given phases
+        *   (any phase if none is given); must be called after writing the inputs under seq_mutex
+        *
+        * @param phase_a, phase_b the phases interested in the event
+        * @return null
+        */
+        void notify_sequencer(int phase_a = -1, int phase_b = -1);
+
+        /** WAITFORSTILLNESS
+        * @brief Private function waiting until the arm motion (joint velocity or EE twist norm from the franka state)
+        *   stays below the still threshold for the still window, or the still timeout expires
+        *
+        * @param null
+        * @return bool = true if the arm is still
+        */
+        bool wait_for_stillness();
+
+        /** SWITCHCONTROLLERS
+        * @brief Private function waiting for the arm to be still, then switching the arm and hand controllers in
+        *   parallel and waiting for list_controllers to report the new ones running (the time of each phase is
+        *   logged and reported in the message)
+        *
+        * @param arm_from / arm_to the controllers of the arm to be stopped / started
+        * @param hand_from / hand_to the controllers of the hand to be stopped / started
+        * @param message the report of the switch
+        * @return bool = true if success
+        */
+        bool switch_controllers(std::string arm_from, std::string arm_to, std::string hand_from, std::string hand_to,
+            std::string& message);
+
+        /** PUBLISHREFERENCES
+        * @brief Private function publishing x_d and f_d_d if they changed or if the reference period elapsed
+        *
+        * @param x_d / f_d_d the references
+        * @param force if true always publishing
+        * @return null
+        */
+        void publish_references(const std::vector<double>& x_d, const std::vector<double>& f_d_d, bool force = false);
+
+        /** RUNCYCLEPHASE
+        * @brief Private function running a task of the grasp cycle, saving its latency in the result and sending it
+        *   as feedback
+        *
+        * @param phase the name of the phase
+        * @param callback the callback of the task
+        * @param cycle / object the present cycle and object
+        * @param result the result of the action (the latency is appended)
+        * @return bool = true if the task succeeded
+        */
+        bool run_cycle_phase(std::string phase, taskCallback callback, int cycle, std::string object,
+            adaptive_grasping::GraspCycleResult& result);
+
+        /** PREPAREVELOCITYCONTROL
+        * @brief Private function loading the velocity controllers if needed and connecting to adaptive grasper,
+        *   so that the switch only starts the controllers and the adaptive grasp task calls at once (run while
+        *   the arm moves to the pregrasp pose)
+        *
+        * @param null
+        * @return bool = true if everything is ready
+        */
+        bool prepare_velocity_control();
+
+        /** LOADCONTROLLER
+        * @brief Private function loading a controller through controller manager if list_controllers does not
+        *   report it (loaded or running)
+        *
+        * @param robot_name containing the name of robot
+        * @param controller containing the name of the controller
+        * @return bool = true if the controller is loaded
+        */
+        bool load_controller(std::string robot_name, std::string controller);
+
+        /** CONNECTADAPTIVEGRASPER / CALLADAPTIVEGRASPER
+        * @brief Private functions opening the persistent connection to the adaptive_grasper_service (if not open)
+        *   and calling it through that connection (reopened once if broken)
+        *
+        * @param run the request of the service (running or stopping the task inversion)
+        * @return bool = true if success
+        */
+        bool connect_adaptive_grasper();
+        bool call_adaptive_grasper(bool run);
+
         // Rose main variables
         ros::NodeHandle nh;
 
@@ -207,22 +359,22 @@ namespace adaptive_grasping {
         std::vector<std::string> normal_controllers_names;
         std::vector<std::string> velocity_controllers_names;
 
-        // A controller_mangager msg for switching controllers
-        controller_manager_msgs::SwitchController switch_controller;
+        // The list controllers and load controller service names
+        std::string list_service_name = "/controller_manager/list_controllers";
+        std::string load_service_name = "/controller_manager/load_controller";
 
         // The Panda SoftHand Client
         PandaSoftHandClient panda_softhand_client;
 
-        // Subscriber to franka_states for getting tau_ext on joints and other info and Publisher of its norm
+        // Subscriber to franka_states for getting tau_ext on joints and other info, the monitor of its statistics
+        // (written under seq_mutex) and the telemetry publishing the tau_ext norm and the statistics (decimated)
         std::string franka_state_topic_name = "/franka_state_controller/franka_states";
         ros::Subscriber franka_state_sub;
-        franka_msgs::FrankaState latest_franka_state;
-        Eigen::Matrix<double, 4, 4> T_EE;           // The homogeneous trans. from world to ee frame
-        Eigen::Vector3d ee_position_now;            // present panda_EE position
-        Eigen::Vector3d local_z_axis_now;            // present panda_EE z axis
+        frankaStateMonitor franka_monitor;
         bool franka_ok = true;
-        double tau_ext_norm = 0.0;
-        ros::Publisher pub_tau_ext_norm;
+        debugTelemetry telemetry;
+        int tau_ext_norm_channel = -1;
+        int monitor_stats_channel = -1;
         ros::Publisher pub_franka_recovery;         // TODO: Recover from error automatically
         ros::Publisher pub_x_d_reference;
         std_msgs::Float64MultiArray x_d_msg;
@@ -239,8 +391,8 @@ namespace adaptive_grasping {
 
         // Subscriber to joint states for getting synergy value
         ros::Subscriber js_sub;                               // Subscriber to joint states
-        sensor_msgs::JointState js_msg;
-        double present_synergy;
+        jointStateHub js_hub;                                 // Indexed access to the synergy joint
+        double present_synergy = 0.0;
 
         // Service Servers
         ros::ServiceServer pregrasp_task_server;
@@ -254,9 +406,23 @@ namespace adaptive_grasping {
         // Service Clients
         ros::ServiceClient arm_switch_client;
         ros::ServiceClient hand_switch_client;
+        ros::ServiceClient arm_list_client;
+        ros::ServiceClient hand_list_client;
+        ros::ServiceClient arm_load_client;
+        ros::ServiceClient hand_load_client;
 
-        // Adaptive grasping signal trigger bool
-        bool adaptive_grasping_signal;
+        // The persistent client of adaptive grasper (opened while preparing the velocity control)
+        ros::ServiceClient ag_client;
+        std::mutex ag_client_mutex;
+
+        // The grasp cycle action server and the start of its present goal
+        std::unique_ptr<actionlib::SimpleActionServer<adaptive_grasping::GraspCycleAction>> cycle_server;
+        ros::WallTime cycle_start;
+
+        // Subscriber to the grasp signal of adaptive grasper, the signal trigger bool and the last reason received
+        ros::Subscriber ag_signal_sub;
+        std::atomic<bool> adaptive_grasping_signal{false};
+        std::atomic<int> adaptive_grasping_reason{adaptive_grasping::GraspSignal::RUNNING};
 
         // The XmlRpc value for parsing complex params
         XmlRpc::XmlRpcValue task_seq_params;
@@ -275,6 +441,7 @@ namespace adaptive_grasping {
         geometry_msgs::Pose pre_grasp_T;
         std::vector<double> handover_joints;
         double handover_thresh;
+        std::string object_name = "default";           // Name of the object of grasp_transform (set_object_service)
 
         std::map<std::string, std::vector<double>> poses_map;               // The map containing the notable poses
 
@@ -283,6 +450,39 @@ namespace adaptive_grasping {
         std::map<std::string, std::vector<double>> restrain_ref_map;        // The map containing references for adaptive
         std::map<std::string, std::vector<double>> lift_ref_map;            // The map containing references for lift
 
+        // Grasp sequencer: the phase, the counter of the events of interest (both written under seq_mutex with the
+        // inputs read by the sequencer: EE pose, tau_ext norm, contacts and synergy) and the condition variable the
+        // sequencer waits on between its ticks
+        std::atomic<int> seq_phase{PHASE_IDLE};
+        std::mutex seq_mutex;
+        std::condition_variable seq_cv;
+        unsigned long seq_events = 0;
+        ros::Time last_ref_publish;
+
+        // Parsed sequencer variables
+        double sequencer_rate;                          // Rate of the ticks of the sequencer (time based checks)
+        double reference_rate;                          // Rate of the republishing of unchanged references (0: only on change)
+        double close_synergy;                           // Synergy value ending the finish closing phase
+        double lift_duration;                           // Duration of the lift phase [s]
+        double approach_tolerance;                      // Distance from the grasp position ending the approach [m]
+        double approach_overshoot;                      // Distance below the grasp position ending the approach [m]
+        double handover_timeout;                        // Maximum wait for the pull at handover [s]
+        double monitor_window;                          // Window of the statistics of the franka states [s]
+        std::string still_source;                       // The motion checked before switching: "dq" or "O_dP_EE"
+        double still_threshold;                         // Motion norm below which the arm is still [rad/s or m/s]
+        double still_window;                            // Time the arm must stay still before switching [s]
+        double still_timeout;                           // Maximum wait for the arm to be still [s]
+        double switch_timeout;                          // Maximum wait for the switched controllers to run [s]
+
+        // The cache of the pre-grasp joints (by object and quantized object pose) and its parsed variables
+        preGraspCache pregrasp_cache;
+        bool use_pregrasp_cache;                        // If false always planning to the pre-grasp pose
+        std::string pregrasp_cache_file;                // The file of the cache (empty: not persisted)
+        double pregrasp_cache_position_quantum;         // Quantum of the object position and target tolerance [m]
+        double pregrasp_cache_angle_quantum;            // Quantum of the object orientation and target tolerance [rad]
+        double pregrasp_cache_start_tolerance;          // Tolerance on every start joint [rad]
+        int pregrasp_cache_max_entries;                 // Maximum number of entries (least recently used evicted)
+
         std::vector<double> null_x_d = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
         std::vector<double> null_f_d_d = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
 
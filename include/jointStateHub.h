@@ -0,0 +1,178 @@
+#ifndef JOINT_STATE_HUB_H
+#define JOINT_STATE_HUB_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include <ros/ros.h>
+#include <sensor_msgs/JointState.h>
+
+/**
+* @brief This class is used by the nodes consuming /joint_states to access the
+* joints by name without searching the message every time. The needed joints
+* are registered once; at the first message (and whenever the name layout
+* changes) a name to index table is built, otherwise the layout is only checked
+* at the registered indices. Contiguous blocks are returned as Eigen::Map views
+* on the held message (no copies). The hub is meant to be updated and read by
+* the same thread (e.g. inside the joint states callback).
+*
+*/
+
+namespace adaptive_grasping {
+
+  class jointStateHub {
+
+  public:
+
+    /** DEFAULT CONSTRUCTOR
+    * @brief Default constructor for jointStateHub
+    *
+    * @param null
+    * @return null
+    */
+    jointStateHub();
+
+    /** DESTRUCTOR
+    * @brief Default destructor for jointStateHub
+    *
+    * @param null
+    * @return null
+    */
+    ~jointStateHub();
+
+    /** ADDJOINT
+    * @brief Registers a single joint
+    *
+    * @param name the name of the joint
+    * @return the handle of the joint (for getJoint)
+    */
+    int addJoint(const std::string& name);
+
+    /** ADDGROUP
+    * @brief Registers a group of joints (anywhere in the message)
+    *
+    * @param names the names of the joints in the wanted order
+    * @return the handle of the group (for getGroup)
+    */
+    int addGroup(const std::vector<std::string>& names);
+
+    /** ADDBLOCK
+    * @brief Registers a block of joints contiguous in the message
+    *
+    * @param first_name the name of the first joint of the block
+    * @param size the number of joints of the block
+    * @return the handle of the block (for getBlock)
+    */
+    int addBlock(const std::string& first_name, int size);
+
+    /** SETSYNERGYJOINT, ADDFINGER, SETARMJOINTS
+    * @brief Typed registrations for the synergy joint, the joints of a finger
+    * (by finger id) and the arm joints
+    *
+    * @param name, names, finger_id
+    * @return null
+    */
+    void setSynergyJoint(const std::string& name);
+    void addFinger(int finger_id, const std::vector<std::string>& names);
+    void setArmJoints(const std::vector<std::string>& names);
+
+    /** UPDATE
+    * @brief Takes a new joint state message: the layout is checked in O(number of
+    * registered joints) and the table is rebuilt if it changed
+    *
+    * @param msg the joint state message
+    * @return true if all the registered joints are in the message
+    */
+    bool update(const sensor_msgs::JointState::ConstPtr& msg);
+
+    /** ISVALID
+    * @brief Checks if a message with all the registered joints was received
+    *
+    * @param null
+    * @return true if valid
+    */
+    bool isValid() const;
+
+    /** GETJOINT, GETGROUP, GETBLOCK
+    * @brief Accessors of the registered joints (valid only if isValid())
+    *
+    * @param handle the handle returned by the registration
+    * @param values the vector to be filled (resized only if needed)
+    * @return the position / a view of the positions of the block / false if not valid
+    */
+    double getJoint(int handle) const;
+    bool getGroup(int handle, Eigen::VectorXd& values) const;
+    bool getGroup(int handle, std::vector<double>& values) const;
+    Eigen::Map<const Eigen::VectorXd> getBlock(int handle) const;
+
+    /** GETSYNERGY, GETFINGERJOINTS, GETARMJOINTS
+    * @brief Typed accessors (false if not registered or not valid)
+    *
+    * @param synergy, values, finger_id
+    * @return true if success
+    */
+    bool getSynergy(double& synergy) const;
+    bool getFingerJoints(int finger_id, std::vector<double>& values) const;
+    bool getArmJoints(Eigen::VectorXd& values) const;
+
+    /** GETGROUPNAMES
+    * @brief Returns the names of a registered group
+    *
+    * @param handle the handle of the group
+    * @return the names of the joints
+    */
+    const std::vector<std::string>& getGroupNames(int handle) const;
+
+    /** GETMESSAGE
+    * @brief Returns the last message given to update
+    *
+    * @param null
+    * @return the message
+    */
+    sensor_msgs::JointState::ConstPtr getMessage() const;
+
+    /** GETREBUILDS
+    * @brief Returns how many times the table was built (layout changes + 1)
+    *
+    * @param null
+    * @return the number of builds
+    */
+    unsigned long getRebuilds() const;
+
+  private:
+
+    // The registered joint names (slots) and their indices in the current layout
+    std::vector<std::string> slot_names;
+    std::vector<size_t> slot_indices;
+
+    // Groups and blocks as lists of slots / first slot and size
+    std::vector<std::vector<int>> groups;
+    std::vector<std::vector<std::string>> group_names;
+    std::vector<std::pair<int, int>> blocks;
+
+    // Typed handles
+    int synergy_handle = -1;
+    int arm_handle = -1;
+    std::map<int, int> finger_handles;
+
+    // The current message and the state of the table
+    sensor_msgs::JointState::ConstPtr msg;
+    size_t layout_size = 0;
+    bool valid = false;
+    unsigned long rebuilds = 0;
+
+    // Slot of a name (registering it if needed)
+    int slotOf(const std::string& name);
+
+    // Checks that the names at the saved indices are still the registered ones
+    bool checkLayout(const sensor_msgs::JointState& js) const;
+
+    // Builds the name to index table
+    bool buildLayout(const sensor_msgs::JointState& js);
+
+  };
+
+}
+
+#endif // JOINT_STATE_HUB_H
@@ -0,0 +1,157 @@
+#ifndef PRE_GRASP_CACHE_H
+#define PRE_GRASP_CACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <ros/ros.h>
+
+/**
+* @brief This class is used by fullGrasper to avoid planning the pre-grasp motion
+* from scratch every time: the arm joints reached at the pre-grasp pose are saved
+* with the start joints and the target pose, keyed by the object name and its
+* pose quantized (position and quaternion components). An entry is reused only if
+* the present start joints and the new target are within the tolerances of the
+* saved ones (otherwise it is rejected and planning is done again). The entries
+* are persisted to a text file and the least recently used ones are evicted.
+* The cache is meant to be used by one thread at a time.
+*
+*/
+
+namespace adaptive_grasping {
+
+  // An entry of the cache: the start joints, the target pose, the reached joints and the last use
+  struct preGraspEntry {
+    std::vector<double> start_joints;
+    Eigen::Vector3d target_position;
+    Eigen::Quaterniond target_orientation;
+    std::vector<double> joints;
+    unsigned long last_use = 0;
+  };
+
+  class preGraspCache {
+
+  public:
+
+    /** DEFAULT CONSTRUCTOR
+    * @brief Default constructor for preGraspCache
+    *
+    * @param null
+    * @return null
+    */
+    preGraspCache();
+
+    /** DESTRUCTOR
+    * @brief Default destructor for preGraspCache
+    *
+    * @param null
+    * @return null
+    */
+    ~preGraspCache();
+
+    /** CONFIGURE
+    * @brief Sets the quantization of the keys (also the tolerances on the target), the tolerance on the
+    *   start joints, the maximum number of entries and the file of the cache (empty: not persisted, relative:
+    *   in $ROS_HOME or ~/.ros)
+    *
+    * @param position_quantum the quantum of the object position and the target position tolerance [m]
+    * @param angle_quantum the quantum of the object orientation and the target angle tolerance [rad]
+    * @param start_tolerance the maximum difference of every start joint [rad]
+    * @param max_entries the maximum number of entries
+    * @param file the path of the file
+    * @return null
+    */
+    void configure(double position_quantum, double angle_quantum, double start_tolerance, int max_entries,
+      std::string file);
+
+    /** MAKEKEY
+    * @brief Builds the key of an object in a pose
+    *
+    * @param object the name of the object
+    * @param object_pose the pose of the object
+    * @return the key
+    */
+    std::string makeKey(const std::string& object, const Eigen::Affine3d& object_pose) const;
+
+    /** LOOKUP
+    * @brief Looks for a valid entry (counting a hit, a miss or a rejected entry)
+    *
+    * @param key the key of the object and pose
+    * @param start_joints the present joints of the arm
+    * @param target the pre-grasp pose to be reached
+    * @param joints the saved joints reached at the target (filled if hit)
+    * @return true if hit
+    */
+    bool lookup(const std::string& key, const std::vector<double>& start_joints, const Eigen::Affine3d& target,
+      std::vector<double>& joints);
+
+    /** STORE / INVALIDATE
+    * @brief Saves (replacing) / removes an entry and writes the file
+    *
+    * @param key the key of the object and pose
+    * @param start_joints the joints of the arm before the motion
+    * @param target the reached pre-grasp pose
+    * @param joints the joints of the arm at the target
+    * @return null
+    */
+    void store(const std::string& key, const std::vector<double>& start_joints, const Eigen::Affine3d& target,
+      const std::vector<double>& joints);
+    void invalidate(const std::string& key);
+
+    /** LOAD / SAVE
+    * @brief Reads / writes the entries from / to the file (written to a temporary file, then renamed)
+    *
+    * @param null
+    * @return true if success
+    */
+    bool load();
+    bool save() const;
+
+    /** GETHITS, GETMISSES, GETREJECTS, GETHITRATE, GETSIZE
+    * @brief The metrics of the cache (the rejected entries are also counted as misses)
+    *
+    * @param null
+    * @return the number of hits / misses / rejects, the hit rate (0 to 1), the number of entries
+    */
+    unsigned long getHits() const;
+    unsigned long getMisses() const;
+    unsigned long getRejects() const;
+    double getHitRate() const;
+    size_t getSize() const;
+
+    /** GETREPORT
+    * @brief Returns the metrics as a string for the logs
+    *
+    * @param null
+    * @return the report
+    */
+    std::string getReport() const;
+
+  private:
+
+    // The entries by key
+    std::map<std::string, preGraspEntry> entries;
+
+    // Quantization, tolerances, size and file
+    double position_quantum = 0.005;
+    double angle_quantum = 0.05;
+    double start_tolerance = 0.01;
+    int max_entries = 100;
+    std::string file;
+
+    // The metrics and the use counter (for the eviction)
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+    unsigned long rejects = 0;
+    unsigned long uses = 0;
+
+    // Removes the least recently used entries above the maximum
+    void evict();
+
+  };
+
+}
+
+#endif // PRE_GRASP_CACHE_H
@@ -2,11 +2,15 @@
 #define ROBOT_COMMANDER_H
 
 #include <mutex>
+#include <thread>
+#include <atomic>
 #include <Eigen/Dense>
 #include <std_msgs/Float64.h>
+#include <std_msgs/Float64MultiArray.h>
 #include <geometry_msgs/Twist.h>
 #include <geometry_msgs/WrenchStamped.h>
 #include <sensor_msgs/JointState.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include "ros/ros.h"
 
 // Action Client
@@ -16,10 +20,16 @@
 
 // Service Includes
 #include "adaptive_grasping/velCommand.h"
+#include "adaptive_grasping/ReferencePreview.h"
 #include <std_srvs/SetBool.h>
 
 // Filter Includes
-#include "filters/filter_chain.h"
+#include "utils/multichannel_filter.h"
+
+// Other Includes
+#include "utils/lockfree_mailbox.h"
+#include "utils/realtime_utilities.h"
+#include "debugTelemetry.h"
 
 /**
 * @brief This class is called by the adaptive_grasping method to close the
@@ -43,9 +53,11 @@ namespace adaptive_grasping {
     *   the topic for commanding the hand
     * @param arm_topic_
     *   the topic for commanding the arm
+    * @param in_process_
+    *   if true a worker thread executes the commands posted in process (see post)
     * @return null
     */
-    robotCommander(std::string hand_topic_, std::string arm_topic_);
+    robotCommander(std::string hand_topic_, std::string arm_topic_, bool in_process_ = false);
 
     /** DESTRUCTOR
     * @brief Default destructor for robotCommander
@@ -55,19 +67,134 @@ namespace adaptive_grasping {
     */
     ~robotCommander();
 
+    /** POST
+    * @brief Public function to pass a command from the same process without waiting:
+    *   the latest posted command is executed by the worker thread (only if in process)
+    *
+    * @param x_ref_
+    *   the 7d reference (synergy velocity and palm twist)
+    * @return null
+    */
+    void post(const Eigen::Matrix<double, 7, 1>& x_ref_);
+
+    /** POSTPREVIEW
+    * @brief Public function to post a command with a preview of the next references from the same process
+    *   (the preview is interpolated in streaming mode, otherwise only x_ref_ is executed as in post)
+    *
+    * @param x_ref_
+    *   the 7d reference (synergy velocity and palm twist)
+    * @param preview_
+    *   the next references, 7 values each (flattened)
+    * @param preview_times_
+    *   the times of the next references after x_ref_ [s] (increasing)
+    * @param preview_size_
+    *   the number of next references
+    * @return null
+    */
+    void postPreview(const Eigen::Matrix<double, 7, 1>& x_ref_, const double* preview_, const double* preview_times_,
+        int preview_size_);
+
+    // The command sources in streaming mode (each one is the only writer of its stream mailbox)
+    enum referenceSource {SOURCE_IN_PROCESS = 0, SOURCE_COMMAND_TOPIC, SOURCE_PREVIEW_TOPIC, SOURCE_SERVICE, NUM_SOURCES};
+
+    /** QUEUEREFERENCE
+    * @brief Public function to post a reference (and its optional preview) with its arrival time in the stream
+    *   mailbox of its source for the streaming output thread (overwrites the not yet sent one of the same source,
+    *   never waits for the output thread)
+    *
+    * @param source_
+    *   the command source (only one thread may post for a source at a time)
+    * @param x_ref_
+    *   the 7d reference (synergy velocity and palm twist)
+    * @param preview_, preview_times_, preview_size_
+    *   the optional preview (as in postPreview; at most MAX_KNOTS - 1 next references are kept)
+    * @param latency_
+    *   how long ago x_ref_ was computed [s] (the preview is shifted accordingly)
+    * @return bool true (a newer reference always replaces the older one)
+    */
+    bool queueReference(referenceSource source_, const Eigen::Matrix<double, 7, 1>& x_ref_, const double* preview_ = nullptr,
+        const double* preview_times_ = nullptr, int preview_size_ = 0, double latency_ = 0.0);
+
+    /** SENDCOMMAND
+    * @brief Public function to check, filter and publish a reference to the controllers
+    *   (used by the service, the topic and the in process worker)
+    *
+    * @param x_ref_
+    *   the 7d reference (synergy velocity and palm twist)
+    * @return bool success
+    */
+    bool sendCommand(const Eigen::VectorXd& x_ref_);
+
   private:
 
     // Basic variables
     ros::NodeHandle nh_rc;
     ros::ServiceServer rc_server;       // For getting velocity requests and commanding the robot
     ros::ServiceServer emerg_server;    // For stopping the robot in case of emergency
+    ros::Subscriber command_sub;        // For getting velocity requests as a topic (distributed deployment)
+    ros::Subscriber preview_sub;        // For getting velocity requests with a preview as a topic
 
-    // A bool for emergency stop (used for setReferences in performRobotCommand)
-    bool emergency;
+    // A bool for emergency stop (used for setReferences in sendCommand, set by the service)
+    std::atomic<bool> emergency;
 
-    // A mutual exclusion lock for the variables of this class
+    // A mutual exclusion lock for the variables of this class (taken by sendCommand)
     std::mutex robot_commander_mutex;
 
+    // The mailbox for in process commands, the worker thread executing them and its rate
+    tripleBufferMailbox<Eigen::Matrix<double, 7, 1>> command_mailbox;
+    std::thread command_worker;
+    std::atomic<bool> worker_running{false};
+    double command_rate = 1000.0;
+
+    // Streaming mode: every source posts its references with their arrival time in its own mailbox and the output
+    // thread sends the newest one (by arrival time) at stream_rate; when none arrived for stale_timeout the watchdog
+    // holds it (for hold_time, then zero), decays it (time constant decay_time) or zeroes it. The producers never
+    // share a lock with the output thread (concurrent service calls are serialized among themselves).
+    enum watchdogMode {WATCHDOG_HOLD = 0, WATCHDOG_DECAY, WATCHDOG_ZERO};
+
+    // A queued reference: the knots of the reference and of its preview (the first one is the reference itself),
+    // their times after the first one and the arrival time of the first one (shifted back by its latency)
+    static const int MAX_KNOTS = 9;
+    struct timedReference {
+      Eigen::Matrix<double, 7, MAX_KNOTS> knots;
+      int64_t knot_ns[MAX_KNOTS];
+      int size;
+      int64_t stamp_ns;
+    };
+    bool streaming = false;
+    double stream_rate = 500.0;
+    int stream_priority = 0;
+    double stale_timeout = 0.05;
+    double hold_time = 0.2;
+    double decay_time = 0.05;
+    watchdogMode watchdog_mode = WATCHDOG_DECAY;
+
+    // Interpolation of the preview knots at the stream rate: none (each knot held until the next one), linear or
+    // cubic (Hermite with finite difference slopes, continuous velocity between the knots); the reference is
+    // considered stale stale_timeout after its last knot
+    enum interpolationMode {INTERPOLATION_NONE = 0, INTERPOLATION_LINEAR, INTERPOLATION_CUBIC};
+    interpolationMode interpolation = INTERPOLATION_LINEAR;
+    seqlockMailbox<timedReference> stream_mailboxes[NUM_SOURCES];
+    uint64_t stream_versions[NUM_SOURCES] = {};
+    std::mutex service_stream_mutex;
+    std::thread stream_worker;
+    std::atomic<bool> stream_running{false};
+
+    // Streaming statistics (written by the output thread and the producers, drained by the diagnostics timer)
+    std::atomic<unsigned long> stream_sent{0};
+    std::atomic<unsigned long> stream_received{0};
+    std::atomic<unsigned long> stream_overwritten{0};
+    std::atomic<unsigned long> stream_stale{0};
+    std::atomic<unsigned long> watchdog_trips{0};
+    std::atomic<int64_t> max_staleness_ns{0};
+    std::atomic<int64_t> sum_staleness_ns{0};
+    std::atomic<bool> stream_is_stale{false};
+    unsigned long total_trips = 0;
+    std::atomic<unsigned long> missed_deadlines{0};
+    ros::WallTime last_diag_time;
+    ros::Publisher pub_diagnostics;
+    ros::Timer diag_timer;
+
     // A sensor message and an Eigen vector containing the latest available joints of the hand
     sensor_msgs::JointState::ConstPtr full_joint_state;
     Eigen::VectorXd current_joints_vector;
@@ -90,29 +217,22 @@ namespace adaptive_grasping {
     // Publishers to hand and arm controllers
     ros::Publisher pub_hand;
     ros::Publisher pub_arm;
-    ros::Publisher pub_sigma_debug;
-    ros::Publisher pub_twist_debug;
-    ros::Publisher pub_twist_init;
 
     // Command vars: messages to be published
     geometry_msgs::Twist cmd_twist;
-    geometry_msgs::Twist tmp_twist;
     std_msgs::Float64 cmd_syn;
-    geometry_msgs::WrenchStamped twist_wrench;          // Publishing twist as a wrench (For Debugging)
     double vel_limit = 0.05;                            // Upper limit for all joint velocities
 
-    // A vector of filters for eventually filtering the references to be sent to the controllers (TODO: use vector of filters)
-    // std::vector<filters::FilterChain<double>> ref_filter;
+    // Debug telemetry published by a low priority thread: requested twist, sent twist (as a wrench) and sent synergy
+    debugTelemetry telemetry;
+    int twist_init_channel = -1;
+    int twist_channel = -1;
+    int sigma_channel = -1;
 
-    // A series of double filter chains for reference low pass filtering
+    // The filter bank for reference low pass filtering (all the 7 references in one pass, same output of a
+    // filters::FilterChain<double> per reference configured with the low_pass_filter chain)
     bool enable_filter = true;
-    filters::FilterChain<double> ref_1_filter;
-    filters::FilterChain<double> ref_2_filter;
-    filters::FilterChain<double> ref_3_filter;
-    filters::FilterChain<double> ref_4_filter;
-    filters::FilterChain<double> ref_5_filter;
-    filters::FilterChain<double> ref_6_filter;
-    filters::FilterChain<double> ref_7_filter;
+    multiChannelFilter ref_filter;
 
     /** PERFORMROBOTCOMMAND
     * @brief Private callback function of the main service of robotCommander
@@ -124,6 +244,58 @@ namespace adaptive_grasping {
     bool performRobotCommand(adaptive_grasping::velCommand::Request &req,
         adaptive_grasping::velCommand::Response &res);
 
+    /** GETCOMMAND
+    * @brief Private callback function of the command topic
+    *
+    * @param msg
+    * @return null
+    */
+    void getCommand(const std_msgs::Float64MultiArray::ConstPtr &msg);
+
+    /** GETPREVIEW
+    * @brief Private callback function of the command with preview topic
+    *
+    * @param msg
+    * @return null
+    */
+    void getPreview(const adaptive_grasping::ReferencePreview::ConstPtr &msg);
+
+    /** COMMANDLOOP
+    * @brief Private function run by the worker thread to execute the in process commands
+    *
+    * @param null
+    * @return null
+    */
+    void commandLoop();
+
+    /** STREAMLOOP
+    * @brief Private function run by the output thread in streaming mode: sends the newest posted reference
+    *   of all the sources (or the watchdog command if it is stale) at the stream rate
+    *
+    * @param null
+    * @return null
+    */
+    void streamLoop();
+
+    /** INTERPOLATE
+    * @brief Private function to evaluate a queued reference and its preview at a time after its first knot
+    *   (the last knot is held after the end of the preview)
+    *
+    * @param ref the queued reference
+    * @param t_ns the time after the first knot [ns]
+    * @param command the 7d command to be filled
+    * @return null
+    */
+    void interpolate(const timedReference& ref, int64_t t_ns, Eigen::VectorXd& command) const;
+
+    /** PUBLISHDIAGNOSTICS
+    * @brief Timer callback publishing the streaming statistics on /diagnostics
+    *
+    * @param event the timer event
+    * @return null
+    */
+    void publishDiagnostics(const ros::TimerEvent& event);
+
     /** ENFORCELIMITS
     * @brief Private function to check joint velocity limits and to follow them
     *
@@ -39,6 +39,8 @@ public:
     void clear_set();                                                                   // Clears the task set
     void print_set();                                                                   // Prints to screen the whole task set
     bool solve_inv_kin(Eigen::VectorXd &q_sol);                                         // Gives the reverse priority inverse kinematics solution for the task set
+    bool prepare_factorization();                                                       // Orders the set and caches the projection matrices and pseudo inverses of the recursion
+    bool solve_with_factorization(const std::vector<Eigen::VectorXd> &x_dots, Eigen::VectorXd &q_sol);    // Solves for new task velocities (in insertion order) with the cached factorization
 
 private:
 
@@ -53,9 +55,17 @@ private:
     // Set of projection matrices Pk+1 (ref. reverse priority)
     std::vector<Eigen::MatrixXd> proj_mat_set_;
 
+    // Cached factorization: insertion index of each ordered task, its jacobian and the pseudo inverse of J_i * P_i+1
+    std::vector<int> order_;
+    std::vector<Eigen::MatrixXd> jac_set_;
+    std::vector<Eigen::MatrixXd> pinv_set_;
+
     // Private Auxiliary Fuctions
     bool compute_proj_mats();
 
+    // Orders the task set as reorder_set and saves the insertion index of each task in order_
+    void reorder_set_with_order();
+
 	// This one cleans the augmented jacobian from the rows that are lin. dep. on the current jacobian
     Eigen::MatrixXd clean_jac(Eigen::MatrixXd Jt, Eigen::MatrixXd Jrat);
 
@@ -43,6 +43,8 @@ public:
 	void clear_set();                                                                   // Clears the task set
 	void print_set();                                                                   // Prints to screen the whole task set
 	void solve_inv_kin(Eigen::VectorXd &q_sol);                                         // Gives the stack of tasks inverse kinematics solution for the task set
+	bool prepare_factorization();                                                       // Orders the set and caches the jacobians and pseudo inverses of the recursion
+	bool solve_with_factorization(const std::vector<Eigen::VectorXd> &x_dots, Eigen::VectorXd &q_sol);    // Solves for new task velocities (in insertion order) with the cached factorization
 
 private:
 
@@ -57,6 +59,14 @@ private:
 	// Set of projection matrices Pk+1 (ref. stack of tasks)
 	std::vector<Eigen::MatrixXd> proj_mat_set_;
 
+	// Cached factorization: insertion index of each ordered task, its jacobian and the pseudo inverse of the projected jacobian
+	std::vector<int> order_;
+	std::vector<Eigen::MatrixXd> jac_set_;
+	std::vector<Eigen::MatrixXd> pinv_set_;
+
+	// Orders the task set as reorder_set and saves the insertion index of each task in order_
+	void reorder_set_with_order();
+
 };
 
 #endif //SRC_STACKOFTASKSMANAGER_H
@@ -0,0 +1,157 @@
+#ifndef ASYNC_LOGGER_H
+#define ASYNC_LOGGER_H
+
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <Eigen/Core>
+#include "ros/ros.h"
+#include <std_msgs/Int8.h>
+
+/**
+* @brief This h file contains a logger for the hot paths (control loop, task
+* inversion): a log call only copies a static text and, if any, the values of a
+* matrix or a number into a preallocated ring; a background thread formats them
+* and prints them through rosconsole. Every site has its own minimum period and
+* the verbosity can be changed at runtime: a disabled site costs one relaxed
+* atomic load. Texts must be string literals (they are not copied).
+*
+* Usage:
+*   AG_LOG(LOG_LEVEL_WARN, 1.0, "Something happened");
+*   AG_LOG_VALUE(LOG_LEVEL_WARN, 1.0, "Small singular value", sing_val);
+*   AG_LOG_MATRIX(LOG_LEVEL_DEBUG, 1.0, "The solution is", x_ref);
+*
+*/
+
+// Log levels (LOG_LEVEL_OFF disables all sites)
+enum logLevel {LOG_LEVEL_DEBUG = 0, LOG_LEVEL_INFO = 1, LOG_LEVEL_WARN = 2, LOG_LEVEL_ERROR = 3, LOG_LEVEL_OFF = 4};
+
+// Sites below this level are removed at compile time
+#ifndef AG_LOG_MIN_LEVEL
+#define AG_LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Maximum number of records in the ring and of matrix values per record (bigger matrices are truncated)
+#define AG_LOG_RING_SIZE    256
+#define AG_LOG_MAX_VALUES   256
+
+// A logging site (one static object per call site) with its rate limit
+struct logSite {
+  logSite(const char* file_, int line_, logLevel level_, double min_period_) :
+    file(file_), line(line_), level(level_), min_period_ns(int64_t(min_period_ * 1e9)) {}
+  const char* file;
+  int line;
+  logLevel level;
+  int64_t min_period_ns;
+  std::atomic<int64_t> last_ns{INT64_MIN / 2};
+  std::atomic<unsigned long> suppressed{0};
+};
+
+// A record in the ring (filled by the logging thread, formatted by the background thread)
+struct logRecord {
+  const logSite* site;
+  const char* text;
+  int64_t stamp_ns;
+  unsigned long suppressed;
+  bool has_value;
+  double value;
+  int rows;
+  int cols;
+  double data[AG_LOG_MAX_VALUES];
+};
+
+class asyncLogger {
+
+public:
+
+  /* INSTANCE: the process wide logger (the background thread starts at the first call) */
+  static asyncLogger& instance();
+
+  /* ENABLED: true if the sites of this level are enabled */
+  static bool enabled(logLevel level){
+    return level >= verbosity.load(std::memory_order_relaxed);
+  }
+
+  /* SETVERBOSITY: sets the minimum enabled level */
+  static void setVerbosity(logLevel level){
+    verbosity.store(level, std::memory_order_relaxed);
+  }
+
+  /* ALLOW: rate limit of a site (true at most once per min_period) */
+  bool allow(logSite& site);
+
+  /* PUSH: queues a record (text only, text and value, text and matrix); never blocks, drops if full */
+  void push(logSite& site, const char* text);
+  void push(logSite& site, const char* text, double value);
+  template <typename Derived>
+  void push(logSite& site, const char* text, const Eigen::DenseBase<Derived>& mat){
+    logRecord* rec = acquire(site, text);
+    if(rec == NULL) return;
+    rec->rows = int(mat.rows());
+    rec->cols = int(mat.cols());
+    int n = 0;
+    for(int j = 0; j < rec->cols && n < AG_LOG_MAX_VALUES; j++){
+      for(int i = 0; i < rec->rows && n < AG_LOG_MAX_VALUES; i++){
+        rec->data[n++] = mat(i, j);
+      }
+    }
+    commit(rec);
+  }
+
+  /* SUBSCRIBELEVELTOPIC: lets the verbosity be changed at runtime through a std_msgs/Int8 topic */
+  void subscribeLevelTopic(ros::NodeHandle& nh, std::string topic_name);
+
+  /* GETDROPPED: number of records dropped because the ring was full */
+  unsigned long getDropped(){
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+  ~asyncLogger();
+
+private:
+
+  asyncLogger();
+
+  // The ring (bounded multi producer queue with per cell sequence numbers)
+  struct logCell {
+    std::atomic<size_t> seq;
+    logRecord rec;
+  };
+  logCell* cells;
+  std::atomic<size_t> enqueue_pos{0};
+  size_t dequeue_pos = 0;
+  std::atomic<unsigned long> dropped{0};
+
+  // The minimum enabled level
+  static std::atomic<int> verbosity;
+
+  // The background thread and the level topic subscriber
+  std::thread worker;
+  std::atomic<bool> running{false};
+  ros::Subscriber level_sub;
+
+  logRecord* acquire(logSite& site, const char* text);
+  void commit(logRecord* rec);
+  void workerLoop();
+  void format(const logRecord& rec);
+  void levelCallback(const std_msgs::Int8::ConstPtr& msg);
+
+};
+
+// Macros for logging sites (the static site is created at the first enabled call)
+#define AG_LOG_ENABLED(level) ((level) >= AG_LOG_MIN_LEVEL && asyncLogger::enabled(level))
+
+#define AG_LOG_SITE_CALL(level, period, ...) \
+  do { \
+    if(AG_LOG_ENABLED(level)){ \
+      static logSite ag_log_site(__FILE__, __LINE__, level, period); \
+      asyncLogger& ag_logger = asyncLogger::instance(); \
+      if(ag_logger.allow(ag_log_site)) ag_logger.push(ag_log_site, __VA_ARGS__); \
+    } \
+  } while(0)
+
+#define AG_LOG(level, period, text) AG_LOG_SITE_CALL(level, period, text)
+#define AG_LOG_VALUE(level, period, text, value) AG_LOG_SITE_CALL(level, period, text, double(value))
+#define AG_LOG_MATRIX(level, period, text, mat) AG_LOG_SITE_CALL(level, period, text, mat)
+
+#endif // ASYNC_LOGGER_H
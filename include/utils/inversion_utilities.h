@@ -7,6 +7,7 @@
 
 #include <Eigen/Dense>
 #include "ros/ros.h"
+#include "utils/async_logger.h"
 
 /**
 * @brief This h file contains utilities for pseudo inversions
@@ -22,7 +23,7 @@ inline Eigen::MatrixXd damped_pseudo_inv(const Eigen::MatrixXd input_mat, double
 	double min_sing_val = sing_vals(sing_vals.size() - 1);
 	if (min_sing_val < epsilon) {
 		lambda_sq = (1 - pow((min_sing_val / epsilon), 2)) * pow(damping_coeff, 2);
-		ROS_WARN("Damping the pseudo inverse!!!");
+		AG_LOG_VALUE(LOG_LEVEL_WARN, 1.0, "Damping the pseudo inverse!!! The smallest sing val is", min_sing_val);
 	}
 
 	// Changing the diagonal sv matrix
@@ -46,7 +47,7 @@ inline Eigen::MatrixXd trunk_pseudo_inv(const Eigen::MatrixXd input_mat, double
 	// Checking if the smallest sing values are really small
 	for (long int i = 0; i < sing_vals.size(); i++) {
 		if (sing_vals(i) < epsilon) {
-			ROS_WARN_STREAM("The " << i << "th sing val is really small! Will set it to zero for the pseudo inverse!!!");
+			AG_LOG_VALUE(LOG_LEVEL_WARN, 1.0, "A sing val is really small! Will set it to zero for the pseudo inverse!!! Its index is", i);
 			S(i, i) = 0.0;
 		} else {
 			S(i,i) = 1 / sing_vals(i);
@@ -0,0 +1,105 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+* @brief This h file contains a lock-free latency histogram with HDR-style
+* log-linear buckets: values (in ns) below 16 have their own bucket, above that
+* every power of two is split in 16 buckets (relative error below 1/16). Recording
+* is a few relaxed atomic operations, so it can be called from the control loop
+* while another thread drains the histogram.
+*
+*/
+
+// Summary of the values recorded in a histogram (times in ns)
+struct histogramSummary {
+  uint64_t count = 0;
+  double mean = 0.0;
+  double p50 = 0.0;
+  double p90 = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+};
+
+class latencyHistogram {
+
+public:
+
+  // 4 bits of sub-bucket precision and values up to 2^40 ns (about 18 minutes)
+  static const int SUB_BITS = 4;
+  static const int SUB_COUNT = 1 << SUB_BITS;
+  static const int MAX_EXP = 40;
+  static const int NUM_BUCKETS = (MAX_EXP - SUB_BITS + 2) * SUB_COUNT;
+
+  latencyHistogram(){
+    for(int i = 0; i < NUM_BUCKETS; i++) counts[i].store(0, std::memory_order_relaxed);
+  }
+
+  /* RECORD: adds a value in ns (from any single writer or multiple writers) */
+  void record(uint64_t value_ns){
+    counts[bucketIndex(value_ns)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value_ns, std::memory_order_relaxed);
+    uint64_t old_max = max_value.load(std::memory_order_relaxed);
+    while(value_ns > old_max && !max_value.compare_exchange_weak(old_max, value_ns, std::memory_order_relaxed)){}
+  }
+
+  /* DRAIN: summarizes the values recorded since the last drain and restarts the window (one drainer at a time) */
+  histogramSummary drain(){
+    histogramSummary summary;
+    uint64_t count = 0;
+    for(int i = 0; i < NUM_BUCKETS; i++){
+      window[i] = counts[i].exchange(0, std::memory_order_relaxed);
+      count += window[i];
+    }
+    uint64_t window_sum = sum.exchange(0, std::memory_order_relaxed);
+    uint64_t window_max = max_value.exchange(0, std::memory_order_relaxed);
+    if(count == 0) return summary;
+
+    summary.count = count;
+    summary.mean = double(window_sum) / double(count);
+    summary.max = double(window_max);
+    summary.p50 = percentile(window, count, 0.50);
+    summary.p90 = percentile(window, count, 0.90);
+    summary.p99 = percentile(window, count, 0.99);
+    return summary;
+  }
+
+  /* BUCKETINDEX */
+  static int bucketIndex(uint64_t value){
+    if(value < uint64_t(SUB_COUNT)) return int(value);
+    int exp = 63 - __builtin_clzll(value);
+    if(exp > MAX_EXP) return NUM_BUCKETS - 1;
+    return (exp - SUB_BITS + 1) * SUB_COUNT + int(value >> (exp - SUB_BITS)) - SUB_COUNT;
+  }
+
+  /* BUCKETMIDPOINT: the value in the middle of a bucket */
+  static double bucketMidpoint(int index){
+    if(index < SUB_COUNT) return double(index);
+    int exp = index / SUB_COUNT + SUB_BITS - 1;
+    uint64_t low = uint64_t(index % SUB_COUNT + SUB_COUNT) << (exp - SUB_BITS);
+    uint64_t width = uint64_t(1) << (exp - SUB_BITS);
+    return double(low) + 0.5 * double(width - 1);
+  }
+
+private:
+
+  std::atomic<uint64_t> counts[NUM_BUCKETS];
+  uint64_t window[NUM_BUCKETS];                 // Only used by the draining thread
+  std::atomic<uint64_t> sum{0};
+  std::atomic<uint64_t> max_value{0};
+
+  static double percentile(const uint64_t* buckets, uint64_t count, double p){
+    uint64_t target = uint64_t(p * double(count - 1)) + 1;
+    uint64_t seen = 0;
+    for(int i = 0; i < NUM_BUCKETS; i++){
+      seen += buckets[i];
+      if(seen >= target) return bucketMidpoint(i);
+    }
+    return bucketMidpoint(NUM_BUCKETS - 1);
+  }
+
+};
+
+#endif // LATENCY_HISTOGRAM_H
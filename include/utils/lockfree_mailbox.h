@@ -0,0 +1,134 @@
+#ifndef LOCKFREE_MAILBOX_H
+#define LOCKFREE_MAILBOX_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+/**
+* @brief This h file contains two lock-free single slot mailboxes for passing
+* the latest value of T from one writer thread to the readers. The writer never
+* waits and the readers always get the most recent complete value; intermediate
+* values may be overwritten.
+* - tripleBufferMailbox: one reader, any T (no allocation if T does not allocate on copy)
+* - seqlockMailbox: any number of readers, T with a fixed size and no pointers
+*   (e.g. fixed size Eigen types); a reader retries if it raced with the writer
+*   (or gives up with tryFetch, e.g. a real time reader which must not spin on a
+*   preempted writer)
+*
+*/
+
+template <typename T>
+class tripleBufferMailbox {
+
+public:
+
+  // The middle index also carries the "new data" flag (NEW_BIT)
+  tripleBufferMailbox() : back(0), middle(1), front(2) {}
+
+  /* POST (writer only): publishes a new value overwriting a not yet fetched one */
+  void post(const T& value){
+    buffers[back] = value;
+    const uint8_t old_middle = middle.exchange(back | NEW_BIT, std::memory_order_acq_rel);
+    back = old_middle & INDEX_MASK;
+  }
+
+  /* FETCH (reader only): returns true and copies the value if a new one was posted since the last fetch */
+  bool fetch(T& value){
+    if(!(middle.load(std::memory_order_acquire) & NEW_BIT)) return false;
+    const uint8_t old_middle = middle.exchange(front, std::memory_order_acq_rel);
+    front = old_middle & INDEX_MASK;
+    value = buffers[front];
+    return true;
+  }
+
+  /* HASNEW (reader only): true if a value is waiting to be fetched */
+  bool hasNew() const {
+    return middle.load(std::memory_order_acquire) & NEW_BIT;
+  }
+
+private:
+
+  static const uint8_t NEW_BIT = 4;
+  static const uint8_t INDEX_MASK = 3;
+
+  // The three buffers: one owned by the writer (back), one by the reader (front) and one in between
+  T buffers[3];
+  uint8_t back;
+  std::atomic<uint8_t> middle;
+  uint8_t front;
+
+};
+
+template <typename T>
+class seqlockMailbox {
+
+public:
+
+  seqlockMailbox() : sequence(0) {
+    for(int i = 0; i < WORDS; i++) words[i].store(0, std::memory_order_relaxed);
+  }
+
+  /* POST (writer only): publishes a new value (the sequence is odd while writing) */
+  void post(const T& value){
+    uint64_t buffer[WORDS] = {};
+    std::memcpy(buffer, &value, sizeof(T));
+    const uint64_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for(int i = 0; i < WORDS; i++) words[i].store(buffer[i], std::memory_order_relaxed);
+    sequence.store(seq + 2, std::memory_order_release);
+  }
+
+  /* READ (any reader): copies the latest value and returns its version (0 if nothing was posted yet) */
+  uint64_t read(T& value) const {
+    uint64_t buffer[WORDS];
+    uint64_t seq_before, seq_after;
+    do {
+      seq_before = sequence.load(std::memory_order_acquire);
+      for(int i = 0; i < WORDS; i++) buffer[i] = words[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      seq_after = sequence.load(std::memory_order_relaxed);
+    } while((seq_before & 1) || seq_before != seq_after);
+    if(seq_before == 0) return 0;
+    std::memcpy(&value, buffer, sizeof(T));
+    return seq_before / 2;
+  }
+
+  /* FETCH (any reader): like read, but only if the version is newer than last_version (which is updated) */
+  bool fetch(T& value, uint64_t& last_version) const {
+    if(version() == last_version) return false;
+    const uint64_t new_version = read(value);
+    if(new_version == last_version) return false;
+    last_version = new_version;
+    return true;
+  }
+
+  /* TRYFETCH (any reader): like fetch, but never retries (false also if it raced with the writer) */
+  bool tryFetch(T& value, uint64_t& last_version) const {
+    uint64_t buffer[WORDS];
+    const uint64_t seq_before = sequence.load(std::memory_order_acquire);
+    if((seq_before & 1) || seq_before / 2 == last_version) return false;
+    for(int i = 0; i < WORDS; i++) buffer[i] = words[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(sequence.load(std::memory_order_relaxed) != seq_before) return false;
+    std::memcpy(&value, buffer, sizeof(T));
+    last_version = seq_before / 2;
+    return true;
+  }
+
+  /* VERSION: the number of values posted so far */
+  uint64_t version() const {
+    return sequence.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+
+  // The value is stored in atomic words, so a read racing with a write is only discarded (no data race)
+  static const int WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  std::atomic<uint64_t> words[WORDS];
+  std::atomic<uint64_t> sequence;
+
+};
+
+#endif // LOCKFREE_MAILBOX_H
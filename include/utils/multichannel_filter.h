@@ -0,0 +1,176 @@
+#ifndef MULTICHANNEL_FILTER_H
+#define MULTICHANNEL_FILTER_H
+
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include <XmlRpcValue.h>
+#include "ros/ros.h"
+
+/**
+* @brief This h file contains a multi-channel transfer function filter: a chain
+* of stages (e.g. a single low pass or cascaded biquads), each one filtering all
+* the channels at once with vectorized array operations. Every stage computes
+*   y = b0 * x + sum_k b_k * x[n-k] - sum_k a_k * y[n-k]
+* with coefficients normalized by a0 and zero initial state, in the same order of
+* operations of filters/TransferFunctionFilter, so the output is the same as the
+* one of a FilterChain<double> per channel. The coefficients can be shared by all
+* the channels or given per channel. No memory is allocated after configuration.
+*
+* The chain is read from the parameter server in the filters package format:
+*   low_pass_filter:
+*   - name: first_low_pass
+*     type: filters/TransferFunctionFilterDouble
+*     params: {a: [1.0, -0.9971], b: [0.0014, 0.0014]}      # shared coefficients
+*   - name: per_channel_stage
+*     type: filters/TransferFunctionFilterDouble
+*     params: {a: [[1.0, -0.5], ...], b: [[0.5], ...]}      # one list per channel
+*
+*/
+
+class multiChannelFilter {
+
+public:
+
+  /* CONFIGURE: reads the chain of stages in param_name for the given number of channels */
+  bool configure(int channels_, std::string param_name, ros::NodeHandle& nh){
+    channels = channels_;
+    stages.clear();
+    XmlRpc::XmlRpcValue chain;
+    if(!nh.getParam(param_name, chain) || chain.getType() != XmlRpc::XmlRpcValue::TypeArray){
+      ROS_ERROR_STREAM("multiChannelFilter::configure : No filter chain found in " << param_name << ".");
+      return false;
+    }
+    for(int i = 0; i < chain.size(); i++){
+      if(!chain[i].hasMember("params") || !chain[i]["params"].hasMember("a") || !chain[i]["params"].hasMember("b")){
+        ROS_ERROR_STREAM("multiChannelFilter::configure : The stage " << i << " of " << param_name << " has no a or b params.");
+        return false;
+      }
+      Eigen::MatrixXd a, b;
+      if(!parseCoefficients(chain[i]["params"]["a"], a) || !parseCoefficients(chain[i]["params"]["b"], b) || !addStage(a, b)){
+        ROS_ERROR_STREAM("multiChannelFilter::configure : Could not configure the stage " << i << " of " << param_name << ".");
+        return false;
+      }
+    }
+    return !stages.empty();
+  }
+
+  /* SETCHANNELS: sets the number of channels (before adding stages by hand) */
+  void setChannels(int channels_){
+    channels = channels_;
+    stages.clear();
+  }
+
+  /* ADDSTAGE: adds a stage with a and b given as one row shared by all the channels or one row per channel */
+  bool addStage(const Eigen::MatrixXd& a, const Eigen::MatrixXd& b){
+    if(channels <= 0 || a.cols() == 0 || b.cols() == 0 || (a.rows() != 1 && a.rows() != channels) ||
+      (b.rows() != 1 && b.rows() != channels)) return false;
+
+    filterStage stage;
+    stage.a = a.rows() == 1 ? Eigen::ArrayXXd(a.replicate(channels, 1)) : Eigen::ArrayXXd(a);
+    stage.b = b.rows() == 1 ? Eigen::ArrayXXd(b.replicate(channels, 1)) : Eigen::ArrayXXd(b);
+
+    // Normalizing by a0 (as the filters package does: only if a0 is not 1)
+    for(int c = 0; c < channels; c++){
+      double a0 = stage.a(c, 0);
+      if(a0 == 0.0) return false;
+      if(a0 != 1.0){
+        for(int k = 0; k < stage.b.cols(); k++) stage.b(c, k) = stage.b(c, k) / a0;
+        for(int k = 1; k < stage.a.cols(); k++) stage.a(c, k) = stage.a(c, k) / a0;
+        stage.a(c, 0) = a0 / a0;
+      }
+    }
+
+    stage.x_hist = Eigen::ArrayXXd::Zero(channels, stage.b.cols() - 1);
+    stage.y_hist = Eigen::ArrayXXd::Zero(channels, stage.a.cols() - 1);
+    stages.push_back(stage);
+    stage_in.resize(channels);
+    stage_out.resize(channels);
+    return true;
+  }
+
+  /* RESET: sets the state of all the stages to zero */
+  void reset(){
+    for(auto& stage : stages){
+      stage.x_hist.setZero();
+      stage.y_hist.setZero();
+      stage.x_head = 0;
+      stage.y_head = 0;
+    }
+  }
+
+  /* UPDATE: filters one sample of all the channels (in and out must have size channels) */
+  void update(const Eigen::Ref<const Eigen::VectorXd>& in, Eigen::Ref<Eigen::VectorXd> out){
+    stage_in = in.array();
+    for(auto& stage : stages){
+      const int nx = int(stage.x_hist.cols());
+      const int ny = int(stage.y_hist.cols());
+
+      // The terms in the same order of the scalar filter (inputs first, newest first)
+      stage_out = stage.b.col(0) * stage_in;
+      for(int k = 1; k <= nx; k++) stage_out += stage.b.col(k) * stage.x_hist.col((stage.x_head + k - 1) % nx);
+      for(int k = 1; k <= ny; k++) stage_out -= stage.a.col(k) * stage.y_hist.col((stage.y_head + k - 1) % ny);
+
+      // Pushing the newest input and output in front of the histories
+      if(nx > 0){
+        stage.x_head = (stage.x_head + nx - 1) % nx;
+        stage.x_hist.col(stage.x_head) = stage_in;
+      }
+      if(ny > 0){
+        stage.y_head = (stage.y_head + ny - 1) % ny;
+        stage.y_hist.col(stage.y_head) = stage_out;
+      }
+      stage_in.swap(stage_out);
+    }
+    out = stage_in.matrix();
+  }
+
+  /* GETCHANNELS / GETSTAGES */
+  int getChannels() const { return channels; }
+  int getStages() const { return int(stages.size()); }
+
+private:
+
+  // A stage: coefficients (one row per channel) and circular histories (newest at the head column)
+  struct filterStage {
+    Eigen::ArrayXXd a;
+    Eigen::ArrayXXd b;
+    Eigen::ArrayXXd x_hist;
+    Eigen::ArrayXXd y_hist;
+    int x_head = 0;
+    int y_head = 0;
+  };
+
+  int channels = 0;
+  std::vector<filterStage> stages;
+  Eigen::ArrayXd stage_in;
+  Eigen::ArrayXd stage_out;
+
+  /* TODOUBLE: a number of the param server (int or double) */
+  static bool toDouble(XmlRpc::XmlRpcValue& value, double& number){
+    if(value.getType() == XmlRpc::XmlRpcValue::TypeDouble) number = double(value);
+    else if(value.getType() == XmlRpc::XmlRpcValue::TypeInt) number = double(int(value));
+    else return false;
+    return true;
+  }
+
+  /* PARSECOEFFICIENTS: a list (one row) or a list of lists of the same length (one row per channel) */
+  static bool parseCoefficients(XmlRpc::XmlRpcValue& value, Eigen::MatrixXd& coeffs){
+    if(value.getType() != XmlRpc::XmlRpcValue::TypeArray || value.size() == 0) return false;
+    bool per_channel = value[0].getType() == XmlRpc::XmlRpcValue::TypeArray;
+    int rows = per_channel ? value.size() : 1;
+    int cols = per_channel ? value[0].size() : value.size();
+    coeffs.resize(rows, cols);
+    for(int r = 0; r < rows; r++){
+      XmlRpc::XmlRpcValue& row = per_channel ? value[r] : value;
+      if(row.getType() != XmlRpc::XmlRpcValue::TypeArray || row.size() != cols) return false;
+      for(int c = 0; c < cols; c++){
+        if(!toDouble(row[c], coeffs(r, c))) return false;
+      }
+    }
+    return true;
+  }
+
+};
+
+#endif // MULTICHANNEL_FILTER_H
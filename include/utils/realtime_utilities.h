@@ -0,0 +1,110 @@
+#ifndef REALTIME_UTILITIES_H
+#define REALTIME_UTILITIES_H
+
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include "ros/ros.h"
+
+/**
+* @brief This h file contains utilities for running a loop in real-time:
+* absolute deadline sleeping on the monotonic clock, SCHED_FIFO priority,
+* CPU affinity and memory locking. All of them only warn on failure (e.g. if
+* the process has no rights for real-time scheduling) and the loop keeps running.
+*
+*/
+
+/* SETREALTIMEPRIORITY: sets SCHED_FIFO with the given priority for the calling thread */
+inline bool setRealtimePriority(int priority){
+  sched_param param;
+  std::memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+  int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if(ret != 0){
+    ROS_WARN_STREAM("setRealtimePriority : Could not set SCHED_FIFO priority " << priority << " (" << std::strerror(ret) << ").");
+    return false;
+  }
+  return true;
+}
+
+/* SETCPUAFFINITY: pins the calling thread to the given cpu */
+inline bool setCpuAffinity(int cpu){
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  if(ret != 0){
+    ROS_WARN_STREAM("setCpuAffinity : Could not pin the thread to cpu " << cpu << " (" << std::strerror(ret) << ").");
+    return false;
+  }
+  return true;
+}
+
+/* LOCKMEMORY: locks current and future pages of the process in RAM (no page faults in the loop) */
+inline bool lockMemory(){
+  if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+    ROS_WARN_STREAM("lockMemory : Could not lock the process memory (" << std::strerror(errno) << ").");
+    return false;
+  }
+  return true;
+}
+
+/**
+* @brief A periodic timer with absolute deadlines on CLOCK_MONOTONIC: the period
+* does not drift with the loop duration and missed deadlines are counted and skipped.
+*
+*/
+class periodicDeadline {
+
+public:
+
+  /* START: sets the period and the first deadline one period from now */
+  void start(double period_s){
+    period_ns = int64_t(period_s * 1e9);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    add(deadline, period_ns);
+    overruns = 0;
+  }
+
+  /* WAIT: sleeps until the deadline, then moves it one period ahead (skipping the missed ones) */
+  void wait(){
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(toNs(now) > toNs(deadline)){
+      // Late: restarting the schedule from now instead of bursting to catch up
+      overruns++;
+      deadline = now;
+    } else {
+      while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR){}
+    }
+    add(deadline, period_ns);
+  }
+
+  /* GETOVERRUNS */
+  unsigned long getOverruns() const {
+    return overruns;
+  }
+
+private:
+
+  int64_t period_ns = 0;
+  timespec deadline;
+  unsigned long overruns = 0;
+
+  static int64_t toNs(const timespec& t){
+    return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+  }
+
+  static void add(timespec& t, int64_t ns){
+    int64_t total = toNs(t) + ns;
+    t.tv_sec = total / 1000000000LL;
+    t.tv_nsec = total % 1000000000LL;
+  }
+
+};
+
+#endif // REALTIME_UTILITIES_H
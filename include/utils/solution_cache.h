@@ -0,0 +1,59 @@
+#ifndef SOLUTION_CACHE_H
+#define SOLUTION_CACHE_H
+
+#include <algorithm>
+#include <Eigen/Dense>
+
+/**
+* @brief This h file contains the last reference solved by the control loop with
+* the generation counters of the N inputs it was computed from. A tick whose inputs
+* did not change can send it again instead of recomputing the matrices and the
+* inversion, but only if it was an exact solution: a reference degraded by the time
+* budget of the inversion (DLS or scaled previous solution) is kept as the last
+* solution to be sent, while the next tick recomputes it.
+*
+*/
+
+template <int N>
+class solutionCache {
+
+public:
+
+  /* STORE: saves the solution and the input generations (replayable only if exact) */
+  void store(const Eigen::VectorXd& solution_, const unsigned long* gen_, bool exact_){
+    solution = solution_;
+    std::copy(gen_, gen_ + N, gen);
+    have_solution = true;
+    replayable = exact_;
+  }
+
+  /* INVALIDATE: the next tick recomputes (the last solution can still be sent until then) */
+  void invalidate(){
+    replayable = false;
+  }
+
+  /* RESET: forgets the solution (e.g. at the end of a run) */
+  void reset(){
+    have_solution = false;
+    replayable = false;
+  }
+
+  /* CANREPLAY: true if an exact solution was computed from the same input generations */
+  bool canReplay(const unsigned long* gen_) const {
+    return replayable && std::equal(gen_, gen_ + N, gen);
+  }
+
+  /* QUERIES: if a solution was stored since the last reset and the solution itself */
+  bool hasSolution() const { return have_solution; }
+  const Eigen::VectorXd& getSolution() const { return solution; }
+
+private:
+
+  Eigen::VectorXd solution;
+  unsigned long gen[N] = {};
+  bool have_solution = false;
+  bool replayable = false;
+
+};
+
+#endif // SOLUTION_CACHE_H
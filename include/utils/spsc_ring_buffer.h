@@ -0,0 +1,61 @@
+#ifndef SPSC_RING_BUFFER_H
+#define SPSC_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+* @brief This h file contains a lock-free single producer single consumer
+* ring buffer. Only one thread may push and only one thread may pop; no
+* memory is allocated after construction. The capacity N must be a power of two.
+*
+*/
+
+template <typename T, size_t N>
+class spscRingBuffer {
+
+  static_assert(N > 0 && (N & (N - 1)) == 0, "spscRingBuffer capacity must be a power of two");
+
+public:
+
+  spscRingBuffer() : head(0), tail(0) {}
+
+  /* PUSH (producer only): returns false if the buffer is full */
+  bool push(const T& elem){
+    const size_t t = tail.load(std::memory_order_relaxed);
+    if(t - head.load(std::memory_order_acquire) >= N) return false;
+    buffer[t & (N - 1)] = elem;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* POP (consumer only): returns false if the buffer is empty */
+  bool pop(T& elem){
+    const size_t h = head.load(std::memory_order_relaxed);
+    if(h == tail.load(std::memory_order_acquire)) return false;
+    elem = buffer[h & (N - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* SIZE (approximate if called while the other side is working) */
+  size_t size() const {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+  }
+
+  /* CAPACITY */
+  static constexpr size_t capacity(){
+    return N;
+  }
+
+private:
+
+  T buffer[N];
+
+  // Head is written only by the consumer, tail only by the producer (on separate cache lines)
+  alignas(64) std::atomic<size_t> head;
+  alignas(64) std::atomic<size_t> tail;
+
+};
+
+#endif // SPSC_RING_BUFFER_H
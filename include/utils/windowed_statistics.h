@@ -0,0 +1,117 @@
+#ifndef WINDOWED_STATISTICS_H
+#define WINDOWED_STATISTICS_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+/**
+* @brief This h file contains the statistics of a scalar signal over a sliding
+* time window, updated incrementally: every push adds the new sample and drops the
+* ones older than the window (or over the capacity), keeping running sums for the
+* mean and the variance and a monotonic queue of the samples for the peak. Every
+* query is O(1) and no memory is allocated after configure. The sums are recomputed
+* from the window once every capacity pushes to cancel the rounding drift.
+*
+*/
+
+class windowedStatistics {
+
+public:
+
+  /* CONFIGURE: sets the window [s] and the maximum number of samples in it (preallocated) */
+  void configure(double window_, int capacity_ = 1024){
+    window = window_;
+    capacity = std::max(capacity_, 1);
+    values.assign(capacity, 0.0);
+    stamps.assign(capacity, 0.0);
+    peak_seqs.assign(capacity, 0);
+    reset();
+  }
+
+  /* RESET: empties the window */
+  void reset(){
+    first = next = 0;
+    peak_front = peak_back = 0;
+    sum = sum_sq = 0.0;
+  }
+
+  /* PUSH: adds a sample (stamps in seconds, not decreasing) and drops the old ones */
+  void push(double value, double stamp){
+    if(capacity == 0) configure(window);
+
+    // Dropping the samples out of the window (the newest one always stays) or over the capacity
+    while(first < next && (next - first >= uint64_t(capacity) || stamps[first % capacity] < stamp - window)) pop();
+
+    // Adding the sample (the smaller ones can never be the peak again)
+    values[next % capacity] = value;
+    stamps[next % capacity] = stamp;
+    while(peak_back > peak_front && values[peak_seqs[(peak_back - 1) % capacity] % capacity] <= value) peak_back--;
+    peak_seqs[peak_back % capacity] = next;
+    peak_back++;
+    next++;
+    sum += value;
+    sum_sq += value * value;
+
+    if(next % capacity == 0) recompute();
+  }
+
+  /* QUERIES: the number of samples, their mean, variance, peak (maximum), the latest, the span of their stamps
+   * and the rate of change from the oldest to the latest [1/s] (zero with less than two samples) */
+  int count() const { return int(next - first); }
+  double mean() const { return count() > 0 ? sum / count() : 0.0; }
+  double variance() const {
+    if(count() < 2) return 0.0;
+    double m = mean();
+    return std::max(sum_sq / count() - m * m, 0.0);
+  }
+  double peak() const { return count() > 0 ? values[peak_seqs[peak_front % capacity] % capacity] : 0.0; }
+  double latest() const { return count() > 0 ? values[(next - 1) % capacity] : 0.0; }
+  double latestStamp() const { return count() > 0 ? stamps[(next - 1) % capacity] : 0.0; }
+  double span() const { return count() > 1 ? stamps[(next - 1) % capacity] - stamps[first % capacity] : 0.0; }
+  double rateOfChange() const {
+    double dt = span();
+    return dt > 0.0 ? (values[(next - 1) % capacity] - values[first % capacity]) / dt : 0.0;
+  }
+
+private:
+
+  double window = 1.0;
+  int capacity = 0;
+
+  // The samples in a circular buffer indexed by their sequence number (first is the oldest, next the one to come)
+  std::vector<double> values;
+  std::vector<double> stamps;
+  uint64_t first = 0;
+  uint64_t next = 0;
+
+  // The monotonic (decreasing values) queue of the sequence numbers of the peak candidates
+  std::vector<uint64_t> peak_seqs;
+  uint64_t peak_front = 0;
+  uint64_t peak_back = 0;
+
+  // The running sums
+  double sum = 0.0;
+  double sum_sq = 0.0;
+
+  /* POP: drops the oldest sample */
+  void pop(){
+    double value = values[first % capacity];
+    sum -= value;
+    sum_sq -= value * value;
+    if(peak_back > peak_front && peak_seqs[peak_front % capacity] == first) peak_front++;
+    first++;
+  }
+
+  /* RECOMPUTE: the sums from the samples in the window */
+  void recompute(){
+    sum = sum_sq = 0.0;
+    for(uint64_t s = first; s < next; s++){
+      sum += values[s % capacity];
+      sum_sq += values[s % capacity] * values[s % capacity];
+    }
+  }
+
+};
+
+#endif // WINDOWED_STATISTICS_H
@@ -1,5 +1,7 @@
 #include "adaptiveGrasper.h"
 #include <eigen_conversions/eigen_msg.h>
+#include <algorithm>
+#include <cmath>
 
 #define EXEC_NAMESPACE    "adaptive_grasping"
 #define CLASS_NAMESPACE   "adaptive_grasper"
@@ -14,6 +16,19 @@
 
 using namespace adaptive_grasping;
 
+// The names of the timed stages of the control tick (same order as loopStage)
+const char* adaptiveGrasper::STAGE_NAMES[NUM_STAGES] = {"inputs", "readValues", "computeAllMatrices",
+    "task build", "solve", "command send", "publishes", "whole tick"};
+
+/* ADDDIAGNOSTICVALUE */
+template <typename T>
+static void addDiagnosticValue(diagnostic_msgs::DiagnosticStatus& status, std::string key, T value){
+    diagnostic_msgs::KeyValue key_value;
+    key_value.key = key;
+    key_value.value = std::to_string(value);
+    status.values.push_back(key_value);
+}
+
 /* CONSTRUCTOR */
 adaptiveGrasper::adaptiveGrasper(){
     // Nothing to do here
@@ -32,6 +47,10 @@ adaptiveGrasper::~adaptiveGrasper(){
 
 /* INITIALIZE */
 bool adaptiveGrasper::initialize(std::vector<std::string> param_names){
+    // Registering the needed joints in the hub (the hand joints are contiguous in the joint states)
+    this->joint_hub.setSynergyJoint("right_hand_synergy_joint");
+    this->hand_block = this->joint_hub.addBlock("right_hand_thumb_abd_joint", SYN_ROWS);
+
     // Subscribe to joint states
     this->js_sub = this->ag_nh.subscribe("joint_states", 1, &adaptiveGrasper::getJointsAndComputeSyn, this);
     ROS_INFO_STREAM("adaptiveGrasper::initialize A SUBSCRIBER SUBSCRIBED TO " << js_sub.getTopic() << ".");
@@ -42,14 +61,27 @@ bool adaptiveGrasper::initialize(std::vector<std::string> param_names){
     // Waiting for a message in joint states
     this->full_joint_state = ros::topic::waitForMessage<sensor_msgs::JointState>("/joint_states", this->ag_nh);
 
-    // Initializing the client to robot commander
-    this->client_rc = this->ag_nh.serviceClient<adaptive_grasping::velCommand>("rc_service");
+    // Initializing the connection to robot commander according to the command mode
+    if(!this->ag_nh.getParam("adaptive_grasping/command_mode", this->command_mode)){
+        ROS_WARN("adaptiveGrasper::initialize : Could not get parameter command_mode. Using default.");
+    }
+    if(this->command_mode == "service"){
+        this->client_rc = this->ag_nh.serviceClient<adaptive_grasping::velCommand>("rc_service");
+    } else if(this->command_mode == "topic"){
+        this->pub_command = this->ag_nh.advertise<std_msgs::Float64MultiArray>("rc_command", 1);
+        this->command_msg.data.resize(7);
+    } else if(this->command_mode != "in_process"){
+        ROS_ERROR_STREAM("adaptiveGrasper::initialize : Unknown command_mode " << this->command_mode << ". Using topic.");
+        this->command_mode = "topic";
+        this->pub_command = this->ag_nh.advertise<std_msgs::Float64MultiArray>("rc_command", 1);
+        this->command_msg.data.resize(7);
+    }
 
     // Initializing the server to adaptive grasper
     this->server_ag = this->ag_nh.advertiseService("adaptive_grasper_service", &adaptiveGrasper::agCallback, this);
 
-    // Initializing the client to end adaptive grasping
-    this->signal_client = this->ag_nh.serviceClient<std_srvs::Trigger>("adaptive_grasping_signal_trigger");
+    // Initializing the latched publisher of the grasp signal (to let full grasper know when and why adaptive grasping ended)
+    this->pub_signal = this->ag_nh.advertise<adaptive_grasping::GraspSignal>("adaptive_grasping_signal", 1, true);
 
     // Starting to parse the needed elements from parameter server
     ROS_INFO_STREAM("adaptiveGrasper::initialize STARTING TO PARSE THE NEEDED VARIABLES!");
@@ -59,7 +91,7 @@ bool adaptiveGrasper::initialize(std::vector<std::string> param_names){
         ROS_ERROR_STREAM("adaptiveGrasper::initialize could not find the needed params");
     }
     ROS_INFO_STREAM("adaptiveGrasper::initialize PARSING ONE BY ONE!");
-    this->initialized = this->parseParams(this->adaptive_params, param_names);
+    this->initialized = this->parseParams(this->adaptive_params, param_names) && this->initialized;
 
     // Subscribing to panda softhand safety
     this->safety_sub = this->ag_nh.subscribe("/panda_softhand_safety_info", 1, &adaptiveGrasper::getSafetyInfo, this);
@@ -90,18 +122,117 @@ bool adaptiveGrasper::initialize(std::vector<std::string> param_names){
     this->my_contact_preserver.initialize_tasks(this->num_tasks, this->dim_tasks, this->prio_tasks, this->lambda_max, this->epsilon);
 	this->my_contact_preserver.initialize_topics(this->object_twist_topic_name, this->ag_nh);
 
+    // Setting the per tick time budget of the kinematic inversion (optional params)
+    double tick_budget = 0.0;
+    double budget_fallback_scale = 1.0;
+    if(!this->ag_nh.getParam("adaptive_grasping/tick_budget", tick_budget)){
+        ROS_WARN("adaptiveGrasper::initialize : Could not get parameter tick_budget. Using default (no budget).");
+    }
+    if(!this->ag_nh.getParam("adaptive_grasping/budget_fallback_scale", budget_fallback_scale)){
+        ROS_WARN("adaptiveGrasper::initialize : Could not get parameter budget_fallback_scale. Using default.");
+    }
+    this->my_contact_preserver.setTimeBudget(tick_budget, budget_fallback_scale);
+
+    // Getting the real-time mode params (optional)
+    if(!this->ag_nh.getParam("adaptive_grasping/realtime_mode", this->realtime_mode)){
+        ROS_WARN("adaptiveGrasper::initialize : Could not get parameter realtime_mode. Using default.");
+    }
+    if(this->realtime_mode){
+        this->ag_nh.param("adaptive_grasping/rt_priority", this->rt_priority, this->rt_priority);
+        this->ag_nh.param("adaptive_grasping/rt_cpu", this->rt_cpu, this->rt_cpu);
+        this->ag_nh.param("adaptive_grasping/rt_lock_memory", this->rt_lock_memory, this->rt_lock_memory);
+        this->ag_nh.param("adaptive_grasping/callback_threads", this->callback_threads, this->callback_threads);
+    }
+
     // Resetting the reference motion to zero
     this->x_ref = Eigen::VectorXd::Zero(this->x_d.size());
+    this->x_send = Eigen::VectorXd::Zero(this->x_d.size());
 
-    // Setting up the RViz object marker publisher
+    // Setting up the RViz object marker publisher and its timer (marker_rate, 0 disables it)
     this->marker_pub = ag_nh.advertise<visualization_msgs::Marker>("object_marker", 1);
     this->obj_marker.header.frame_id = "/world";
+    this->obj_marker.ns = "adaptive_grasping";
+    this->obj_marker.id = 0;
+    this->obj_marker.type = shape;
+    this->obj_marker.action = visualization_msgs::Marker::ADD;
+    this->obj_marker.pose.orientation.w = 1.0;
+    this->obj_marker.scale.x = 0.05; this->obj_marker.scale.y = 0.05; this->obj_marker.scale.z = 0.05;
+    this->obj_marker.color.r = 0.0f; this->obj_marker.color.g = 1.0f; this->obj_marker.color.b = 0.0f; this->obj_marker.color.a = 1.0f;
+    this->obj_marker.lifetime = ros::Duration(0);
+    double marker_rate = 10.0;
+    if(!this->ag_nh.getParam("adaptive_grasping/marker_rate", marker_rate)){
+        ROS_WARN("adaptiveGrasper::initialize : Could not get parameter marker_rate. Using default.");
+    }
+    if(marker_rate > 0.0){
+        this->marker_timer = this->ag_nh.createTimer(ros::Duration(1.0 / marker_rate), &adaptiveGrasper::publishMarker, this);
+    }
 
-    // Setting up the publisher for twist and error
-    this->pub_twist_debug = this->ag_nh.advertise<geometry_msgs::WrenchStamped>("/x_ref_object_debug" , 1);
-    this->pub_error_tracking = this->ag_nh.advertise<std_msgs::Float64>("/x_ref_error" , 1);
+    // Setting up the loop diagnostics published at diagnostics_rate (0 disables them)
+    double diagnostics_rate = 1.0;
+    if(!this->ag_nh.getParam("adaptive_grasping/diagnostics_rate", diagnostics_rate)){
+        ROS_WARN("adaptiveGrasper::initialize : Could not get parameter diagnostics_rate. Using default.");
+    }
+    this->period_ns = uint64_t(1e9 / this->spin_rate);
+    if(diagnostics_rate > 0.0){
+        this->pub_diagnostics = this->ag_nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+        this->diag_timer = this->ag_nh.createTimer(ros::Duration(1.0 / diagnostics_rate), &adaptiveGrasper::publishDiagnostics, this);
+    }
+
+    // Setting the verbosity of the hot path logs (can be changed at runtime on the log_level topic)
+    int log_level = LOG_LEVEL_INFO;
+    if(!this->ag_nh.getParam("adaptive_grasping/log_level", log_level)){
+        ROS_WARN("adaptiveGrasper::initialize : Could not get parameter log_level. Using default.");
+    }
+    asyncLogger::setVerbosity(logLevel(std::max(int(LOG_LEVEL_DEBUG), std::min(log_level, int(LOG_LEVEL_OFF)))));
+    asyncLogger::instance().subscribeLevelTopic(this->ag_nh, "/adaptive_grasping/log_level");
+
+    // Multi-rate scheduling: each stage runs every spin_rate / rate ticks (a rate <= 0 or above spin_rate means every tick)
+    if(!this->ag_nh.getParam("adaptive_grasping/multi_rate", this->multi_rate)){
+        ROS_WARN("adaptiveGrasper::initialize : Could not get parameter multi_rate. Using default.");
+    }
+    if(this->multi_rate){
+        this->contacts_div = this->rateDivider("contacts_rate");
+        this->matrices_div = this->rateDivider("matrices_rate");
+        this->solve_div = this->rateDivider("solve_rate");
+        this->send_div = this->rateDivider("send_rate");
+        ROS_INFO_STREAM("adaptiveGrasper::initialize Multi-rate dividers: contacts " << this->contacts_div << ", matrices "
+            << this->matrices_div << ", solve " << this->solve_div << ", send " << this->send_div << ".");
+    }
+
+    // Skipping the matrices and the solver on ticks in which no input changed
+    if(!this->ag_nh.getParam("adaptive_grasping/skip_unchanged_ticks", this->skip_unchanged_ticks)){
+        ROS_WARN("adaptiveGrasper::initialize : Could not get parameter skip_unchanged_ticks. Using default.");
+    }
+
+    // Setting up the reference preview (by default one send period apart)
+    if(!this->ag_nh.getParam("adaptive_grasping/preview_knots", this->preview_knots)){
+        ROS_WARN("adaptiveGrasper::initialize : Could not get parameter preview_knots. Using default (no preview).");
+    }
+    this->preview_step = this->send_div / this->spin_rate;
+    this->ag_nh.param("adaptive_grasping/preview_step", this->preview_step, this->preview_step);
+    if(this->preview_knots > 0 && this->preview_step > 0.0){
+        this->preview_refs.resize(X_D_SIZE * this->preview_knots);
+        this->preview_times.resize(this->preview_knots);
+        for(int k = 0; k < this->preview_knots; k++) this->preview_times[k] = (k + 1) * this->preview_step;
+        this->ref_command.request.preview_times = this->preview_times;
+        if(this->command_mode == "topic"){
+            this->pub_preview = this->ag_nh.advertise<adaptive_grasping::ReferencePreview>("rc_preview", 1);
+            this->preview_msg.x_ref.resize(X_D_SIZE);
+            this->preview_msg.preview_times = this->preview_times;
+        }
+    } else {
+        this->preview_knots = 0;
+    }
+
+    // Setting up the telemetry channels for twist and error (published at their telemetry rates, 0 disables them)
+    this->twist_channel = this->telemetry.addChannel(this->ag_nh, "/x_ref_object_debug", TELEMETRY_WRENCH,
+        "adaptive_grasping/telemetry/x_ref_object_debug", 50.0);
+    this->error_channel = this->telemetry.addChannel(this->ag_nh, "/x_ref_error", TELEMETRY_FLOAT64,
+        "adaptive_grasping/telemetry/x_ref_error", 50.0);
+    this->telemetry.start();
 
     ROS_INFO_STREAM("adaptiveGrasper::initialize FINISHED BUILDING THE OBJECTS!");
+    return this->initialized;
 }
 
 /* PRINTPARSED */
@@ -175,52 +306,122 @@ void adaptiveGrasper::spinROS(){
 
 /* PARSEPARAMS */
 bool adaptiveGrasper::parseParams(XmlRpc::XmlRpcValue params_xml, std::vector<std::string> param_names){
-    // Starting to parse and save all needed single parameters
-    parseParameter(params_xml, this->touch_topic_name, param_names[0]);
-    parseParameter(params_xml, this->link_names_map, param_names[1]);
-    parseParameter(params_xml, this->params_map, param_names[2]);
-    parseParameter(params_xml, this->joint_numbers, param_names[3]);
-    parseParameter(params_xml, this->H_i, param_names[4]);
-	parseParameter(params_xml, this->Kc_i, param_names[5]);
+    // Starting to parse and save all needed single parameters (a missing or malformed one fails the initialization)
+    bool success = true;
+    success &= parseParameter(params_xml, this->touch_topic_name, param_names[0]);
+    success &= parseParameter(params_xml, this->link_names_map, param_names[1]);
+    success &= parseParameter(params_xml, this->params_map, param_names[2]);
+    success &= parseParameter(params_xml, this->joint_numbers, param_names[3]);
+    success &= parseParameter(params_xml, this->H_i, param_names[4]);
+	success &= parseParameter(params_xml, this->Kc_i, param_names[5]);
 
     // x_d (vector) needs to be parsed differently using the parsing function for matrix
     Eigen::MatrixXd temp_x_d;
-    parseParameter(params_xml, temp_x_d, param_names[6]);
+    success &= parseParameter(params_xml, temp_x_d, param_names[6]);
     this->x_d = temp_x_d.transpose().col(0);
 
 	// f_d_d (vector) needs to be parsed differently using the parsing function for matrix
 	Eigen::MatrixXd temp_f_d_d;
-	parseParameter(params_xml, temp_f_d_d, param_names[7]);
+	success &= parseParameter(params_xml, temp_f_d_d, param_names[7]);
 	this->f_d_d = temp_f_d_d.transpose().col(0);
 
-    parseParameter(params_xml, this->spin_rate, param_names[8]);
-    parseParameter(params_xml, this->object_topic_name, param_names[9]);
-	parseParameter(params_xml, this->object_twist_topic_name, param_names[10]);
-    parseParameter(params_xml, this->scaling, param_names[11]);
+    // The references received on the topics have fixed sizes (see X_D_SIZE and F_D_D_SIZE)
+    if(this->x_d.size() != X_D_SIZE || this->f_d_d.size() != F_D_D_SIZE){
+        ROS_ERROR_STREAM("adaptiveGrasper::parseParams : x_d and f_d_d should have sizes " << X_D_SIZE << " and " << F_D_D_SIZE
+            << " (got " << this->x_d.size() << " and " << this->f_d_d.size() << ").");
+        success = false;
+    }
+
+    success &= parseParameter(params_xml, this->spin_rate, param_names[8]);
+    success &= parseParameter(params_xml, this->object_topic_name, param_names[9]);
+	success &= parseParameter(params_xml, this->object_twist_topic_name, param_names[10]);
+    success &= parseParameter(params_xml, this->scaling, param_names[11]);
 
     // p_vector (vector) needs to be parsed differently using the parsing function for matrix
     Eigen::MatrixXd temp_p_vector;
-    parseParameter(params_xml, temp_p_vector, param_names[12]);
+    success &= parseParameter(params_xml, temp_p_vector, param_names[12]);
     this->p_vector = temp_p_vector.transpose().col(0);
 
 	// touch_indexes (vector) needs to be parsed differently using the parsing function for matrix
 	Eigen::MatrixXd temp_touch_indexes;
-	parseParameter(params_xml, temp_touch_indexes, param_names[13]);
+	success &= parseParameter(params_xml, temp_touch_indexes, param_names[13]);
 	this->touch_indexes = temp_touch_indexes.transpose().col(0);
 
-    parseParameter(params_xml, this->syn_thresh, param_names[14]);
-    parseParameter(params_xml, this->relax_to_zero, param_names[15]);
-    parseParameter(params_xml, this->touch_change, param_names[16]);
-    parseParameter(params_xml, this->num_tasks, param_names[17]);
-    parseParameter(params_xml, this->dim_tasks, param_names[18]);
-    parseParameter(params_xml, this->prio_tasks, param_names[19]);
-    parseParameter(params_xml, this->lambda_max, param_names[20]);
-    parseParameter(params_xml, this->epsilon, param_names[21]);
+    success &= parseParameter(params_xml, this->syn_thresh, param_names[14]);
+    success &= parseParameter(params_xml, this->relax_to_zero, param_names[15]);
+    success &= parseParameter(params_xml, this->touch_change, param_names[16]);
+    success &= parseParameter(params_xml, this->num_tasks, param_names[17]);
+    success &= parseParameter(params_xml, this->dim_tasks, param_names[18]);
+    success &= parseParameter(params_xml, this->prio_tasks, param_names[19]);
+    success &= parseParameter(params_xml, this->lambda_max, param_names[20]);
+    success &= parseParameter(params_xml, this->epsilon, param_names[21]);
+    return success;
+}
+
+/* BUILDPREVIEW */
+void adaptiveGrasper::buildPreview(Eigen::VectorXd& ref_vec){
+    // The time since the last send (no ramp at the first send of a run or after a pause longer than the preview)
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double dt = 0.0;
+    if(this->have_sent_ref) dt = std::chrono::duration<double>(now - this->last_sent_time).count();
+    bool ramp = dt > 0.0 && dt <= this->preview_times.back();
+
+    // The reference is sent one send period late: it starts from the previous one and reaches the new one after dt
+    // (held afterwards), so the previewed references are only interpolations between known ones
+    xdVector new_ref = ref_vec.head<X_D_SIZE>();
+    xdVector start_ref = ramp ? this->last_sent_ref : new_ref;
+    for(int k = 0; k < this->preview_knots; k++){
+        double s = ramp ? std::min(this->preview_times[k] / dt, 1.0) : 1.0;
+        xdVector::Map(this->preview_refs.data() + X_D_SIZE * k) = start_ref + s * (new_ref - start_ref);
+    }
+    ref_vec.head<X_D_SIZE>() = start_ref;
+
+    this->last_sent_ref = new_ref;
+    this->last_sent_time = now;
+    this->have_sent_ref = true;
 }
 
 /* SETCOMMANDANDSEND */
 bool adaptiveGrasper::setCommandAndSend(Eigen::VectorXd ref_vec, adaptive_grasping::velCommand comm){
-    // Clearing the previous service file
+    // Building the preview of the next references (if enabled; the reference to be sent becomes its first knot)
+    if(this->preview_knots > 0) this->buildPreview(ref_vec);
+
+    // In process: only posting in the commander mailbox
+    if(this->command_mode == "in_process"){
+      if(this->in_process_commander == nullptr){
+        if(DEBUG) ROS_INFO_STREAM("adaptiveGrasper::setCommandAndSend No commander attached!");
+        return false;
+      }
+      if(this->preview_knots > 0){
+        this->in_process_commander->postPreview(ref_vec.head<7>(), this->preview_refs.data(), this->preview_times.data(),
+          this->preview_knots);
+      } else {
+        this->in_process_commander->post(ref_vec.head<7>());
+      }
+      return true;
+    }
+
+    // Topic with preview: publishing the stamped reference and its preview
+    if(this->command_mode == "topic" && this->preview_knots > 0){
+      this->preview_msg.header.stamp = ros::Time::now();
+      for(int i = 0; i < 7; i++){
+        this->preview_msg.x_ref[i] = ref_vec(i);
+      }
+      this->preview_msg.preview = this->preview_refs;
+      this->pub_preview.publish(this->preview_msg);
+      return true;
+    }
+
+    // Topic: publishing without waiting for the commander
+    if(this->command_mode == "topic"){
+      for(int i = 0; i < 7; i++){
+        this->command_msg.data[i] = ref_vec(i);
+      }
+      this->pub_command.publish(this->command_msg);
+      return true;
+    }
+
+    // Service: clearing the previous service file
     comm.request.x_ref.clear();
     
     // Filling up the request
@@ -232,6 +433,9 @@ bool adaptiveGrasper::setCommandAndSend(Eigen::VectorXd ref_vec, adaptive_graspi
     comm.request.x_ref.push_back(ref_vec(5));
     comm.request.x_ref.push_back(ref_vec(6));
 
+    // Adding the preview (if enabled)
+    comm.request.preview = this->preview_refs;
+
     if(this->client_rc.call(comm)){
       if(DEBUG && false) ROS_INFO_STREAM("adaptiveGrasper::setCommandAndSend Success!");
       return true;
@@ -241,6 +445,13 @@ bool adaptiveGrasper::setCommandAndSend(Eigen::VectorXd ref_vec, adaptive_graspi
     }
 }
 
+/* ATTACHCOMMANDER */
+void adaptiveGrasper::attachCommander(robotCommander* commander){
+    // From now on the commands are posted to this commander
+    this->in_process_commander = commander;
+    this->command_mode = "in_process";
+}
+
 /* GETJOINTSANDCOMPUTESYN */
 void adaptiveGrasper::getJointsAndComputeSyn(const sensor_msgs::JointState::ConstPtr &msg){
     // Storing the message into another global message variable
@@ -248,39 +459,21 @@ void adaptiveGrasper::getJointsAndComputeSyn(const sensor_msgs::JointState::Cons
 	this->full_joint_state = msg;
 	ROS_DEBUG_STREAM("adaptiveGrasper::getJointsAndComputeSyn SAVED JOINTSTATE MSG!");
 
-    // Using the full joint state to compute the ratios
-    Eigen::MatrixXd Syn(33, 1);
-
-    // Copying the values of the joints
-    int index = find (this->full_joint_state->name.begin(),this->full_joint_state->name.end(), "right_hand_thumb_abd_joint") - this->full_joint_state->name.begin();
-    if(DEBUG && false) std::cout << "********************************* " << std::endl;
-    for(int j = 0; j < 33; j++){
-        if(DEBUG && false) std::cout << "Getting the joint " << this->full_joint_state->name[index + j] << " with value " << this->full_joint_state->position[index + j] << "." << std::endl;
-        Syn(j) = this->full_joint_state->position[index + j];
+    // Looking up the hand joints through the hub (the name table is only rebuilt if the layout changes)
+    double synergy;
+    if(!this->joint_hub.update(msg) || !this->joint_hub.getSynergy(synergy)){
+        ROS_WARN_STREAM_THROTTLE(1.0, "adaptiveGrasper::getJointsAndComputeSyn The hand joints are not in the joint states!");
+        return;
     }
-    if(DEBUG && false) std::cout << "********************************* " << std::endl;
 
-    // Dividing by synergy value to find the Matrix
-    this->adaptive_grasper_mutex.lock();
-    this->S = Syn / this->full_joint_state->position[index - 1];
-    this->adaptive_grasper_mutex.unlock();
+    // Dividing by synergy value to find the Matrix and passing it to the control loop
+    this->syn_buffer.noalias() = this->joint_hub.getBlock(this->hand_block) / synergy;
+    this->syn_mailbox.post(this->syn_buffer);
 
     // Checking if the synergy value is over a threshold and setting run bool accordingly (for stopping the grasping)
-    if(this->run && (this->full_joint_state->position[index - 1] > this->syn_thresh)){
-        this->adaptive_grasper_mutex.lock();
-        this->run = false;
-        this->adaptive_grasper_mutex.unlock();
-        // Resetting the contact state
-        this->my_contact_state.resetContact();       // Might cause crashing
-
-        // Calling the end adaptive grasping service to let full grasper know that it ended
-        if(this->signal_client.call(this->signal_srv)){
-            ROS_WARN_STREAM("adaptiveGrasper : Triggered stop adaptive grasping!");
-        } else {
-            ROS_ERROR_STREAM("adaptiveGrasper : something went wrong trying to trigger the stop..!");
-        }
-
-        ROS_INFO_STREAM("adaptiveGrasper : The hand is almost fully closed: stopping the grasping!");
+    // (the contacts reset and the signal to full grasper are done by the control loop)
+    if((synergy > this->syn_thresh) && this->run.exchange(false)){
+        this->pending_signal = adaptive_grasping::GraspSignal::HAND_CLOSED;
     }
 
 }
@@ -288,56 +481,47 @@ void adaptiveGrasper::getJointsAndComputeSyn(const sensor_msgs::JointState::Cons
 /* GETSAFETYINFO */
 void adaptiveGrasper::getSafetyInfo(const panda_softhand_safety::SafetyInfo::ConstPtr &msg){
     // Checking if the collision is going to happen and setting run bool accordingly (for stopping the grasping)
-    if( this->run && ((msg->collision) || (msg->joint_position_limits) || (msg->joint_velocity_limits)) ){
-        this->adaptive_grasper_mutex.lock();
-        this->run = false;
-        this->adaptive_grasper_mutex.unlock();
-        // Resetting the contact state
-        this->my_contact_state.resetContact();       // Might cause crashing
-
-        // Calling the end adaptive grasping service to let full grasper know that it ended
-        if(this->signal_client.call(this->signal_srv)){
-            ROS_WARN_STREAM("adaptiveGrasper : Triggered stop sequential computing!");
-        } else {
-            ROS_ERROR_STREAM("adaptiveGrasper : something went wrong trying to trigger the signal..!");
-        }
-
-        if(msg->collision) ROS_INFO_STREAM("adaptiveGrasper : The robot is about to collide: stopping the sequential computing!");
-        else ROS_INFO_STREAM("adaptiveGrasper : The robot is about to violate joint limits: stopping the sequential computing!");
+    // (the contacts reset and the signal to full grasper are done by the control loop)
+    if( ((msg->collision) || (msg->joint_position_limits) || (msg->joint_velocity_limits)) && this->run.exchange(false) ){
+        this->pending_signal = msg->collision ? adaptive_grasping::GraspSignal::COLLISION : adaptive_grasping::GraspSignal::JOINT_LIMITS;
     }
 }
 
 /* GETOBJECTPOSE */
 void adaptiveGrasper::getObjectPose(const geometry_msgs::Pose::ConstPtr &msg){
-    // Saving to the eigen affine
-    this->adaptive_grasper_mutex.lock();
-    tf::poseMsgToEigen(*msg, this->object_pose);
-    this->adaptive_grasper_mutex.unlock();
+    // Converting to eigen affine and passing it to the control loop and to the marker timer
+    Eigen::Affine3d new_object_pose;
+    tf::poseMsgToEigen(*msg, new_object_pose);
+    this->pose_mailbox.post(new_object_pose);
+}
 
-    // Publishing the object to RViz
+/* PUBLISHMARKER */
+void adaptiveGrasper::publishMarker(const ros::TimerEvent& event){
+    // Publishing the object to RViz (only the position changes)
+    Eigen::Affine3d marker_pose;
+    if(!this->pose_mailbox.fetch(marker_pose, this->marker_pose_version)) return;
     this->obj_marker.header.stamp = ros::Time::now();
-    this->obj_marker.ns = "adaptive_grasping";
-    this->obj_marker.id = 0;
-    this->obj_marker.type = shape;
-    this->obj_marker.action = visualization_msgs::Marker::ADD;
-    this->obj_marker.pose.position.x = this->object_pose.translation()[0]; this->obj_marker.pose.position.y = this->object_pose.translation()[1];
-    this->obj_marker.pose.position.z = this->object_pose.translation()[2];
-    this->obj_marker.scale.x = 0.05; this->obj_marker.scale.y = 0.05; this->obj_marker.scale.z = 0.05;
-    this->obj_marker.color.r = 0.0f; this->obj_marker.color.g = 1.0f; this->obj_marker.color.b = 0.0f; this->obj_marker.color.a = 1.0f;
-    this->obj_marker.lifetime = ros::Duration(0);
+    this->obj_marker.pose.position.x = marker_pose.translation()[0]; this->obj_marker.pose.position.y = marker_pose.translation()[1];
+    this->obj_marker.pose.position.z = marker_pose.translation()[2];
     this->marker_pub.publish(this->obj_marker);
 }
 
 /* GETXREFERENCE */
 void adaptiveGrasper::getXReference(const std_msgs::Float64MultiArray::ConstPtr &msg){
-    std::vector<double> tmp_vec(msg->data.begin(), msg->data.end());
-    this->x_d = Eigen::VectorXd::Map(tmp_vec.data(), tmp_vec.size());
+    if(msg->data.size() != X_D_SIZE){
+        ROS_WARN_STREAM_THROTTLE(1.0, "adaptiveGrasper::getXReference : x_d should have " << X_D_SIZE << " elements. Ignoring it.");
+        return;
+    }
+    this->x_d_mailbox.post(xdVector::Map(msg->data.data()));
 }
 
 /* GETFREFERENCE */
 void adaptiveGrasper::getFReference(const std_msgs::Float64MultiArray::ConstPtr &msg){
-    std::vector<double> tmp_vec(msg->data.begin(), msg->data.end());
-    this->f_d_d = Eigen::VectorXd::Map(tmp_vec.data(), tmp_vec.size());
+    if(msg->data.size() != F_D_D_SIZE){
+        ROS_WARN_STREAM_THROTTLE(1.0, "adaptiveGrasper::getFReference : f_d_d should have " << F_D_D_SIZE << " elements. Ignoring it.");
+        return;
+    }
+    this->f_d_d_mailbox.post(fddVector::Map(msg->data.data()));
 }
 
 /* AGCALLBACK */
@@ -347,53 +531,165 @@ bool adaptiveGrasper::agCallback(adaptive_grasping::adaptiveGrasp::Request &req,
     // Checking if request is true and return otherwise
     if(!req.run_adaptive_grasp){
         if(DEBUG) ROS_INFO_STREAM("The request run adaptive grasp is FALSE!");
-        this->adaptive_grasper_mutex.lock();
+        // The contact state is reset and full grasper is signalled by the control loop
         this->run = false;
-        this->adaptive_grasper_mutex.unlock();
-        // Resetting the contact state
-        this->my_contact_state.resetContact();
+        this->pending_signal = adaptive_grasping::GraspSignal::REQUESTED;
         res.success = false;
-
-        // Calling the end adaptive grasping service to let full grasper know that it ended
-        if(this->signal_client.call(this->signal_srv)){
-            ROS_WARN_STREAM("adaptiveGrasper : Triggered stop adaptive grasping!");
-        } else {
-            ROS_ERROR_STREAM("adaptiveGrasper : something went wrong trying to trigger the stop..!");
-        }
-
         return true;
     }
 
     if(DEBUG) ROS_INFO_STREAM("The request run adaptive grasp is TRUE!");
-    // Resetting the contact state
-    this->my_contact_state.resetContact();
+    // The contact state is reset by the control loop before the first running tick (the signal is set before run)
+    this->pending_signal = adaptive_grasping::GraspSignal::RUNNING;
     // Setting the run to true
-    this->adaptive_grasper_mutex.lock();
     this->run = true;
-    this->adaptive_grasper_mutex.unlock();
     res.success = true;
     return true;
 }
 
 /* SPINGRASPER */
 void adaptiveGrasper::spinGrasper(){
+    // Running the control loop on its own thread if in real-time mode
+    if(this->realtime_mode){
+        this->spinRealtime();
+        return;
+    }
+
     // Setting the ROS rate
     ros::Rate rate(this->spin_rate);
 
-    // (TODO: might need to start an AsyncSpinner here.)
-
-    // Creating tracking error message to be published
-    std_msgs::Float64 track_error;
-
     // Starting the ROS loop
     while(ros::ok()){
         // Spinning once to process callbacks
         ros::spinOnce();
 
-        if(this->run){
+        // Performing one step of the control
+        this->controlTick();
+
+        // Rate
+        rate.sleep();
+    }
+
+
+    // Finished adaptive grasping, returning
+    ROS_INFO_STREAM("Finished Adaptive Grasping: returning!!!");
+}
+
+/* SPINREALTIME */
+void adaptiveGrasper::spinRealtime(){
+    // Locking the memory before starting (no page faults in the loop)
+    if(this->rt_lock_memory) lockMemory();
+
+    // Processing the callbacks on their own threads
+    ros::AsyncSpinner spinner(this->callback_threads);
+    spinner.start();
+
+    // Starting the control loop thread and waiting for the shutdown
+    std::thread control_thread(&adaptiveGrasper::controlLoop, this);
+    ros::waitForShutdown();
+    control_thread.join();
+    spinner.stop();
+
+    // Finished adaptive grasping, returning
+    ROS_INFO_STREAM("Finished Adaptive Grasping: returning!!!");
+}
+
+/* CONTROLLOOP */
+void adaptiveGrasper::controlLoop(){
+    // Setting up the thread (only warnings on failure)
+    if(this->rt_cpu >= 0) setCpuAffinity(this->rt_cpu);
+    if(this->rt_priority > 0) setRealtimePriority(this->rt_priority);
+
+    // Running at fixed rate with absolute deadlines
+    periodicDeadline deadline;
+    deadline.start(1.0 / this->spin_rate);
+    while(ros::ok()){
+        this->controlTick();
+        deadline.wait();
+        this->deadline_overruns = deadline.getOverruns();
+    }
+
+    if(deadline.getOverruns() > 0){
+        ROS_WARN_STREAM("adaptiveGrasper::controlLoop The control loop missed " << deadline.getOverruns() << " deadlines.");
+    }
+}
+
+/* VALUECHANGED: true if the two matrices differ in size or in any value */
+template <typename T, typename U>
+static bool valueChanged(const T& current, const U& fetched){
+    return current.rows() != fetched.rows() || current.cols() != fetched.cols() || current != fetched;
+}
+
+/* FETCHINPUTS */
+void adaptiveGrasper::fetchInputs(){
+    // Getting the latest values posted by the callbacks (the old ones are kept if nothing new);
+    // the generation of a source is bumped only if the new value differs from the current one (the current
+    // values keep their size after the first copy, so no allocation happens here)
+    if(this->syn_mailbox.fetch(this->S_fetched) && valueChanged(this->S, this->S_fetched)){
+        this->S = this->S_fetched;
+        this->input_gen[INPUT_SYNERGY]++;
+    }
+    if(this->pose_mailbox.fetch(this->pose_fetched, this->pose_version) && valueChanged(this->object_pose.matrix(), this->pose_fetched.matrix())){
+        this->object_pose = this->pose_fetched;
+        this->input_gen[INPUT_POSE]++;
+    }
+    if(this->x_d_mailbox.fetch(this->x_d_fetched) && valueChanged(this->x_d, this->x_d_fetched)){
+        this->x_d = this->x_d_fetched;
+        this->input_gen[INPUT_X_D]++;
+    }
+    if(this->f_d_d_mailbox.fetch(this->f_d_d_fetched) && valueChanged(this->f_d_d, this->f_d_d_fetched)){
+        this->f_d_d = this->f_d_d_fetched;
+        this->input_gen[INPUT_F_D_D]++;
+    }
+    if(this->my_contact_preserver.updateObjectTwist()) this->input_gen[INPUT_TWIST]++;
+}
+
+/* CONTROLTICK */
+void adaptiveGrasper::controlTick(){
+    // Timing the tick and its stages (always on, few tens of ns per stage)
+    std::chrono::steady_clock::time_point t_tick = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point t_stage = t_tick;
+    uint64_t publish_ns = 0;
+    this->recordLoopTiming(t_tick);
+
+    // Reading run before the signal: a run set by the service is never seen before its contacts reset
+    bool running = this->run;
+
+    // The preview never ramps across a start or a stop of the run
+    if(running != this->preview_running){
+        this->have_sent_ref = false;
+        this->preview_running = running;
+    }
+    this->processSignal();
+
+    // Getting the inputs written by the callbacks
+    this->fetchInputs();
+
+    // Applying all the touches received since the last tick
+    this->my_contact_state.processPendingTouches();
+    this->recordStage(STAGE_INPUTS, t_stage);
+
+    if(running){
+        // In the single rate loop the contacts are read on every recomputed tick
+        if(!this->multi_rate) this->input_gen[INPUT_CONTACTS] = this->my_contact_state.getSnapshot()->generation;
+
+        if(this->multi_rate){
+            // The slow and the fast stages, each one at its own rate
+            publish_ns += this->multiRateStages();
+        } else if(this->skip_unchanged_ticks && this->solution_cache.canReplay(this->input_gen)){
+            // Skipping the matrices and the solver: no input changed since the last exact solution (the previous
+            // reference is sent again, so the command rate is kept)
+            this->skipped_ticks++;
+            this->x_ref = this->solution_cache.getSolution();
+        } else {
+            this->recomputed_ticks++;
+            bool exact = true;
+
             // Reading the values from contact state
+            t_stage = std::chrono::steady_clock::now();
             this->my_contact_state.readValues(this->read_contacts_map, this->read_joints_map);
             this->contacts_num = this->read_contacts_map.size();
+            this->recordStage(STAGE_READ_VALUES, t_stage);
 
             // Printing contacts info and synergy matrix
             if(DEBUG) ROS_INFO_STREAM("\nSynergy Matrix S: \n" << this->S << ".\n");
@@ -413,19 +709,19 @@ void adaptiveGrasper::spinGrasper(){
             this->my_matrices_creator.setOtherPermutationStuff(this->touch_indexes);
 
             // Computing all matrices
+            t_stage = std::chrono::steady_clock::now();
             this->my_matrices_creator.computeAllMatrices();
 
             // Reading and couting the matrices
             this->my_matrices_creator.readAllMatrices(this->read_J, this->read_G, this->read_T, this->read_H, this->read_Kc, this->read_P);
-            if(DEBUG){
-                ROS_INFO_STREAM("adaptiveGrasper::spinGrasper The created matrices are: ");
-                ROS_INFO_STREAM("\nJ = " << "\n" << this->read_J << "\n");
-                ROS_INFO_STREAM("\nG = " << "\n" << this->read_G << "\n");
-                ROS_INFO_STREAM("\nT = " << "\n" << this->read_T << "\n");
-                ROS_INFO_STREAM("\nH = " << "\n" << this->read_H << "\n");
-                ROS_INFO_STREAM("\nKc = " << "\n" << this->read_Kc << "\n");
-                ROS_INFO_STREAM("\nP = " << "\n" << this->read_P << "\n");
-            }
+            this->recordStage(STAGE_MATRICES, t_stage);
+            // The created matrices (queued in the async logger at most once per second if debug logging is enabled)
+            AG_LOG_MATRIX(LOG_LEVEL_DEBUG, 1.0, "adaptiveGrasper::controlTick J =", this->read_J);
+            AG_LOG_MATRIX(LOG_LEVEL_DEBUG, 1.0, "adaptiveGrasper::controlTick G =", this->read_G);
+            AG_LOG_MATRIX(LOG_LEVEL_DEBUG, 1.0, "adaptiveGrasper::controlTick T =", this->read_T);
+            AG_LOG_MATRIX(LOG_LEVEL_DEBUG, 1.0, "adaptiveGrasper::controlTick H =", this->read_H);
+            AG_LOG_MATRIX(LOG_LEVEL_DEBUG, 1.0, "adaptiveGrasper::controlTick Kc =", this->read_Kc);
+            AG_LOG_MATRIX(LOG_LEVEL_DEBUG, 1.0, "adaptiveGrasper::controlTick P =", this->read_P);
             // Printing out the contacts map
             if(this->read_contacts_map.size() > 0 && DEBUG){
               std::cout << "Current contacts are:" << std::endl;
@@ -456,16 +752,16 @@ void adaptiveGrasper::spinGrasper(){
                 bool no_relaxation = true;
                 no_relaxation = this->my_contact_preserver.performKinInversion(this->x_ref);
 
+                // Recording the task building and the solving times measured inside the preserver
+                solverBudgetStats solver_stats = this->my_contact_preserver.getBudgetStats();
+                exact = no_relaxation && solver_stats.last_fallback == FALLBACK_NONE;
+                this->stage_hist[STAGE_TASK_BUILD].record(uint64_t(solver_stats.last_build_duration * 1e9));
+                this->stage_hist[STAGE_SOLVE].record(uint64_t(solver_stats.last_solve_duration * 1e9));
+
                 // Publish the twist for debug
-                if (DEBUG_PUB){
-                    // Filling and publishing the twist for debug
-                    this->twist_wrench.header.frame_id = "world";
-                    this->twist_wrench.header.stamp = ros::Time::now();
-                    this->twist_wrench.wrench.force.x = this->x_ref(7); this->twist_wrench.wrench.torque.x = this->x_ref(10);
-                    this->twist_wrench.wrench.force.y = this->x_ref(8); this->twist_wrench.wrench.torque.y = this->x_ref(11);
-                    this->twist_wrench.wrench.force.z = this->x_ref(9); this->twist_wrench.wrench.torque.z = this->x_ref(12);
-                    this->pub_twist_debug.publish(this->twist_wrench);
-                }
+                t_stage = std::chrono::steady_clock::now();
+                if (DEBUG_PUB) this->publishTwistDebug();
+                publish_ns += elapsedNs(t_stage);
 
                 // If needed set reference to null twist
                 if(!no_relaxation && this->relax_to_zero){
@@ -475,32 +771,271 @@ void adaptiveGrasper::spinGrasper(){
                 if(DEBUG) ROS_DEBUG_STREAM("adaptiveGrasper::spinGrasper Performed Minimization!!!");
             }
 
-            // Scaling the reference and sending to the robot commander
-            this->x_ref = this->scaling * this->x_ref;
-            if(DEBUG) ROS_INFO_STREAM("The reference to be sent to the commander is: \n" << this->x_ref << ".");
+            // Saving the solution and the inputs it was computed from (a budget fallback or a failed inversion is not
+            // replayed while the inputs do not change: the next tick recomputes it)
+            this->solution_cache.store(this->x_ref, this->input_gen, exact);
+        }
+
+        // Scaling the reference and sending to the robot commander (at the send rate if multi rate)
+        // (scaled into x_send: x_ref keeps the unscaled solution, so a reference sent again is never scaled twice)
+        if(!this->multi_rate || this->tick_index % this->send_div == 0){
+            this->x_send = this->scaling * this->x_ref;
+            AG_LOG_MATRIX(LOG_LEVEL_DEBUG, 1.0, "The reference to be sent to the commander is:", this->x_send);
 
-            if(!this->setCommandAndSend(this->x_ref, this->ref_command)){
+            t_stage = std::chrono::steady_clock::now();
+            if(!this->setCommandAndSend(this->x_send, this->ref_command)){
                 // ROS_ERROR_STREAM("adaptiveGrasper::spinGrasper Something went wrong while sending the reference to the commander while sending x_ref!");
             }
+            this->recordStage(STAGE_SEND, t_stage);
 
-            // Publishing the tracking error
-            track_error.data = (this->x_ref - this->x_d).norm();
-            this->pub_error_tracking.publish(track_error);
-        } else {
-            // If the run bool is false send x_d as it is given (after scaling)
-            // Scaling the reference and sending to the robot commander
-            if(DEBUG) ROS_INFO_STREAM("The reference to be sent to the commander is: \n" << this->scaling * this->x_d << ".");
+            // Sampling the tracking error
+            this->telemetry.sample(this->error_channel, (this->x_send - this->x_d).norm());
+            publish_ns += elapsedNs(t_stage);
+        }
+        this->stage_hist[STAGE_PUBLISH].record(publish_ns);
+    } else {
+        // The next run starts with new contacts, factorization and solution
+        this->solution_cache.reset();
+        this->have_contacts = false;
+        this->factorization_ready = false;
+
+        // If the run bool is false send x_d as it is given (after scaling)
+        // Scaling the reference and sending to the robot commander
+        if(DEBUG) ROS_INFO_STREAM("The reference to be sent to the commander is: \n" << this->scaling * this->x_d << ".");
+
+        t_stage = std::chrono::steady_clock::now();
+        if(!this->setCommandAndSend(this->scaling * this->x_d, this->ref_command)){
+            // ROS_ERROR_STREAM("adaptiveGrasper::spinGrasper Something went wrong while sending the reference to the commander while sending zeros!");
+        }
+        this->recordStage(STAGE_SEND, t_stage);
+    }
+
+    // Recording the whole tick and checking if it took longer than the period
+    this->tick_index++;
+    uint64_t tick_ns = elapsedNs(t_tick);
+    this->stage_hist[STAGE_TICK].record(tick_ns);
+    if(tick_ns > this->period_ns) this->tick_overruns++;
+}
+
+/* PROCESSSIGNAL */
+void adaptiveGrasper::processSignal(){
+    // Taking the signal set by the callbacks (the last one wins if more were set in the same tick)
+    int reason = this->pending_signal.exchange(-1);
+    if(reason < 0) return;
+
+    // Resetting the contact state (here, so that it never races with the loop) and publishing the signal
+    this->my_contact_state.resetContact();
+    this->signal_msg.reason = reason;
+    this->pub_signal.publish(this->signal_msg);
+
+    switch(reason){
+        case adaptive_grasping::GraspSignal::RUNNING:
+            if(DEBUG) ROS_INFO_STREAM("adaptiveGrasper : Started adaptive grasping!");
+            break;
+        case adaptive_grasping::GraspSignal::HAND_CLOSED:
+            ROS_INFO_STREAM("adaptiveGrasper : The hand is almost fully closed: stopping the grasping!");
+            break;
+        case adaptive_grasping::GraspSignal::COLLISION:
+            ROS_INFO_STREAM("adaptiveGrasper : The robot is about to collide: stopping the sequential computing!");
+            break;
+        case adaptive_grasping::GraspSignal::JOINT_LIMITS:
+            ROS_INFO_STREAM("adaptiveGrasper : The robot is about to violate joint limits: stopping the sequential computing!");
+            break;
+        default:
+            ROS_WARN_STREAM("adaptiveGrasper : Triggered stop adaptive grasping!");
+            break;
+    }
+}
 
-            if(!this->setCommandAndSend(this->scaling * this->x_d, this->ref_command)){
-                // ROS_ERROR_STREAM("adaptiveGrasper::spinGrasper Something went wrong while sending the reference to the commander while sending zeros!");
+/* RATEDIVIDER */
+int adaptiveGrasper::rateDivider(std::string rate_name){
+    // Number of ticks between two runs of a stage with the given rate param
+    double rate = this->spin_rate;
+    if(!this->ag_nh.getParam("adaptive_grasping/" + rate_name, rate)){
+        ROS_WARN_STREAM("adaptiveGrasper::initialize : Could not get parameter " << rate_name << ". Using the spin rate.");
+    }
+    if(rate <= 0.0 || rate >= this->spin_rate) return 1;
+    return std::max(1, int(std::round(this->spin_rate / rate)));
+}
+
+/* MULTIRATESTAGES */
+uint64_t adaptiveGrasper::multiRateStages(){
+    // Each stage runs on the ticks multiple of its divider and only if its inputs changed
+    std::chrono::steady_clock::time_point t_stage;
+    uint64_t publish_ns = 0;
+
+    // Contacts (slow): reading the contact state only if a new snapshot was published
+    unsigned long contact_gen = this->my_contact_state.getSnapshot()->generation;
+    if(this->tick_index % this->contacts_div == 0 && (!this->have_contacts || contact_gen != this->input_gen[INPUT_CONTACTS])){
+        t_stage = std::chrono::steady_clock::now();
+        this->my_contact_state.readValues(this->read_contacts_map, this->read_joints_map);
+        this->contacts_num = this->read_contacts_map.size();
+        this->input_gen[INPUT_CONTACTS] = contact_gen;
+        this->have_contacts = true;
+        this->recordStage(STAGE_READ_VALUES, t_stage);
+    }
+
+    // Matrices and factorization (slow): only if the contacts, the synergy matrix or the object pose changed
+    bool geometry_changed = !this->factorization_ready
+        || this->factorized_gen[INPUT_CONTACTS] != this->input_gen[INPUT_CONTACTS]
+        || this->factorized_gen[INPUT_SYNERGY] != this->input_gen[INPUT_SYNERGY]
+        || this->factorized_gen[INPUT_POSE] != this->input_gen[INPUT_POSE];
+    if(this->have_contacts && this->tick_index % this->matrices_div == 0 && geometry_changed){
+        // Setting the necessary things in matrix creator and computing matrices
+        t_stage = std::chrono::steady_clock::now();
+        this->my_matrices_creator.setContactsMap(this->read_contacts_map);
+        this->my_matrices_creator.setJointsMap(this->read_joints_map);
+        this->my_matrices_creator.setObjectPose(this->object_pose);
+        this->my_matrices_creator.changeContactType(this->H_i, this->Kc_i);
+        this->my_matrices_creator.setPermutationVector(this->p_vector);
+        this->my_matrices_creator.setOtherPermutationStuff(this->touch_indexes);
+        this->my_matrices_creator.computeAllMatrices();
+        this->my_matrices_creator.readAllMatrices(this->read_J, this->read_G, this->read_T, this->read_H, this->read_Kc, this->read_P);
+        this->recordStage(STAGE_MATRICES, t_stage);
+
+        // Building and factorizing the task set (only if there are contacts, i.e. the matrices are not empty)
+        this->my_contact_preserver.changeHandType(this->S);
+        this->factorization_ready = false;
+        if(read_J.innerSize() > 0 && read_G.innerSize() > 0 && read_T.innerSize() > 0 && read_H.innerSize() > 0 && read_Kc.innerSize() > 0){
+            this->my_contact_preserver.setGraspState(this->read_J, this->read_G, this->read_T, this->read_H, this->read_Kc);
+            this->my_contact_preserver.setMinimizationParams(this->x_d, this->f_d_d);
+            this->my_contact_preserver.setPermutationParams(this->read_P, this->contacts_num);
+            this->my_contact_preserver.set_contacts_and_selection(this->read_contacts_map, this->H_i);
+            this->factorization_ready = this->my_contact_preserver.prepareInversion();
+            this->recordStage(STAGE_TASK_BUILD, t_stage);
+        }
+        std::copy(this->input_gen, this->input_gen + NUM_INPUTS, this->factorized_gen);
+        this->solution_cache.invalidate();
+    }
+
+    // Solve (fast): only the right hand side (x_d, f_d_d and object twist) changes
+    if(this->tick_index % this->solve_div == 0){
+        if(this->solution_cache.canReplay(this->input_gen)){
+            this->skipped_ticks++;
+        } else {
+            this->recomputed_ticks++;
+            t_stage = std::chrono::steady_clock::now();
+            this->x_ref = this->x_d;
+            bool exact = true;
+            if(this->factorization_ready){
+                this->my_contact_preserver.setMinimizationParams(this->x_d, this->f_d_d);
+                bool no_relaxation = this->my_contact_preserver.solveInversion(this->x_ref);
+                exact = no_relaxation;
+                if(!no_relaxation && this->relax_to_zero){
+                    this->x_ref = Eigen::VectorXd::Zero(this->x_ref.size());
+                }
             }
+            this->recordStage(STAGE_SOLVE, t_stage);
+
+            // Publish the twist for debug
+            if(DEBUG_PUB && this->factorization_ready) this->publishTwistDebug();
+            publish_ns += elapsedNs(t_stage);
+
+            // Saving the solution and the inputs it was computed from (the factorized solve has no budget fallback,
+            // but a failed one sends the previous solution and is not replayed either)
+            this->solution_cache.store(this->x_ref, this->input_gen, exact);
         }
+    }
 
-        // Rate
-        rate.sleep();
+    // The reference to be sent is the last solution of this run (also while the next one waits for a solve tick
+    // after a matrices refresh) or x_d as in the not running branch before the first solve of the run
+    if(this->solution_cache.hasSolution()) this->x_ref = this->solution_cache.getSolution();
+    else this->x_ref = this->x_d;
+    return publish_ns;
+}
+
+/* PUBLISHTWISTDEBUG */
+void adaptiveGrasper::publishTwistDebug(){
+    // Sampling the twist for debug (published as a wrench by the telemetry thread)
+    this->telemetry.sample(this->twist_channel, this->x_ref.segment(7, 6));
+}
+
+/* RECORDSTAGE */
+void adaptiveGrasper::recordStage(int stage, std::chrono::steady_clock::time_point& t_last){
+    // Recording the time since t_last and moving t_last to now
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    this->stage_hist[stage].record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - t_last).count());
+    t_last = now;
+}
+
+/* ELAPSEDNS */
+uint64_t adaptiveGrasper::elapsedNs(const std::chrono::steady_clock::time_point& t_from){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_from).count();
+}
+
+/* RECORDLOOPTIMING */
+void adaptiveGrasper::recordLoopTiming(const std::chrono::steady_clock::time_point& t_tick){
+    // The period is measured between the starts of two consecutive ticks (only in the control thread)
+    if(this->last_tick_start.time_since_epoch().count() != 0){
+        uint64_t period = std::chrono::duration_cast<std::chrono::nanoseconds>(t_tick - this->last_tick_start).count();
+        this->period_hist.record(period);
+        this->jitter_hist.record(period > this->period_ns ? period - this->period_ns : this->period_ns - period);
     }
+    this->last_tick_start = t_tick;
+    this->tick_count++;
+}
 
+/* PUBLISHDIAGNOSTICS */
+void adaptiveGrasper::publishDiagnostics(const ros::TimerEvent& event){
+    // Getting the window duration (since the last publish)
+    ros::WallTime now = ros::WallTime::now();
+    double window = this->last_diag_time.isZero() ? 0.0 : (now - this->last_diag_time).toSec();
+    this->last_diag_time = now;
+    unsigned long ticks = this->tick_count.exchange(0);
+    unsigned long overruns = this->tick_overruns.exchange(0);
+    this->total_overruns += overruns;
+
+    diagnostic_msgs::DiagnosticArray diag_array;
+    diag_array.header.stamp = ros::Time::now();
+
+    // The loop status: achieved rate, jitter and overruns
+    histogramSummary period = this->period_hist.drain();
+    histogramSummary jitter = this->jitter_hist.drain();
+    diagnostic_msgs::DiagnosticStatus loop_status;
+    loop_status.name = "adaptive_grasping: control loop";
+    loop_status.hardware_id = "adaptive_grasper";
+    loop_status.level = overruns > 0 ? diagnostic_msgs::DiagnosticStatus::WARN : diagnostic_msgs::DiagnosticStatus::OK;
+    loop_status.message = overruns > 0 ? "Ticks longer than the period" : "OK";
+    addDiagnosticValue(loop_status, "target rate [Hz]", this->spin_rate);
+    addDiagnosticValue(loop_status, "achieved rate [Hz]", window > 0.0 ? ticks / window : 0.0);
+    addDiagnosticValue(loop_status, "period mean [us]", period.mean * 1e-3);
+    addDiagnosticValue(loop_status, "period max [us]", period.max * 1e-3);
+    addDiagnosticValue(loop_status, "jitter p50 [us]", jitter.p50 * 1e-3);
+    addDiagnosticValue(loop_status, "jitter p99 [us]", jitter.p99 * 1e-3);
+    addDiagnosticValue(loop_status, "jitter max [us]", jitter.max * 1e-3);
+    addDiagnosticValue(loop_status, "overruns (window)", overruns);
+    addDiagnosticValue(loop_status, "overruns (total)", this->total_overruns);
+    addDiagnosticValue(loop_status, "missed deadlines (total)", this->deadline_overruns.load());
+    touchQueueStats touch_stats = this->my_contact_state.getTouchQueueStats();
+    unsigned long skipped = this->skipped_ticks.exchange(0);
+    unsigned long recomputed = this->recomputed_ticks.exchange(0);
+    this->total_skipped += skipped;
+    this->total_recomputed += recomputed;
+    addDiagnosticValue(loop_status, "ticks recomputed (window)", recomputed);
+    addDiagnosticValue(loop_status, "ticks skipped, inputs unchanged (window)", skipped);
+    addDiagnosticValue(loop_status, "ticks recomputed (total)", this->total_recomputed);
+    addDiagnosticValue(loop_status, "ticks skipped, inputs unchanged (total)", this->total_skipped);
+    addDiagnosticValue(loop_status, "touch events processed", touch_stats.processed);
+    addDiagnosticValue(loop_status, "touch events dropped", touch_stats.dropped);
+    addDiagnosticValue(loop_status, "touch queue high water", touch_stats.high_water);
+    diag_array.status.push_back(loop_status);
+
+    // One status per stage with its latency percentiles
+    for(int i = 0; i < NUM_STAGES; i++){
+        histogramSummary stage = this->stage_hist[i].drain();
+        diagnostic_msgs::DiagnosticStatus stage_status;
+        stage_status.name = std::string("adaptive_grasping: stage ") + STAGE_NAMES[i];
+        stage_status.hardware_id = "adaptive_grasper";
+        stage_status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        stage_status.message = "OK";
+        addDiagnosticValue(stage_status, "samples", stage.count);
+        addDiagnosticValue(stage_status, "mean [us]", stage.mean * 1e-3);
+        addDiagnosticValue(stage_status, "p50 [us]", stage.p50 * 1e-3);
+        addDiagnosticValue(stage_status, "p90 [us]", stage.p90 * 1e-3);
+        addDiagnosticValue(stage_status, "p99 [us]", stage.p99 * 1e-3);
+        addDiagnosticValue(stage_status, "max [us]", stage.max * 1e-3);
+        diag_array.status.push_back(stage_status);
+    }
 
-    // Finished adaptive grasping, returning
-    ROS_INFO_STREAM("Finished Adaptive Grasping: returning!!!");
+    this->pub_diagnostics.publish(diag_array);
 }
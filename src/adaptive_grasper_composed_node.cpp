@@ -0,0 +1,81 @@
+/*  Main file of the composed Adaptive Grasping node
+    It creates a ros node which has both the adaptive grasper and the robot commander:
+    the references are passed in process through a lock-free mailbox (no service calls)
+
+    authors: George Jose Pollayil, Mathew Jose Pollayil
+*/
+
+//BASIC INCLUDES
+#include <sstream>
+
+// ROS INCLUDES
+#include <ros/ros.h>
+
+// CLASS INCLUDES
+#include "adaptiveGrasper.h"
+#include "robotCommander.h"
+
+// DEFINES
+#define DEBUG       1       // Prints out additional info
+
+
+int main(int argc, char** argv){
+
+	// Initializing ROS node
+	ros::init(argc, argv, "adaptive_grasping_ag_composed_node");
+	ros::NodeHandle adaptive_nh;
+
+    // Creating the robot commander with its worker for in process commands
+    std::string hand_topic = "/right_hand/velocity_controller/command/";
+    std::string arm_topic = "/panda_arm/cartesian_velocity_controller/command/";
+    adaptive_grasping::robotCommander robot_commander(hand_topic, arm_topic, true);
+
+    // Creating the adaptive grasper class
+    adaptive_grasping::adaptiveGrasper adaptive_grasper;
+
+    // Initializing with a vector containing the names of items to be parsed
+    // For adaptive_grasper
+    std::vector<std::string> param_names;
+    param_names.push_back("touch_topic_name");
+    param_names.push_back("link_names_map");
+    param_names.push_back("params_map");
+    param_names.push_back("joints_num");
+    param_names.push_back("h_matrix");
+    param_names.push_back("k_matrix");
+    param_names.push_back("x_d");
+	param_names.push_back("f_d_d");
+    param_names.push_back("spin_rate");
+    param_names.push_back("object_topic_name");
+	param_names.push_back("object_twist_topic_name");
+    param_names.push_back("scaling");
+    param_names.push_back("p_vector");
+	param_names.push_back("touch_indexes");
+    param_names.push_back("syn_thresh");
+    param_names.push_back("relax_to_zero");
+    param_names.push_back("touch_change");
+    param_names.push_back("num_tasks");
+    param_names.push_back("dim_tasks");
+    param_names.push_back("prio_tasks");
+    param_names.push_back("lambda_max");
+    param_names.push_back("epsilon");
+
+    adaptive_grasper.initialize(param_names);
+
+    // Passing the commands directly to the robot commander
+    adaptive_grasper.attachCommander(&robot_commander);
+
+    // Printing the parsed parameters
+    if(DEBUG) adaptive_grasper.printParsed();
+
+    // Starting message
+	ROS_INFO("\nThe Composed Adaptive Grasper is starting to spin!");
+	ROS_DEBUG_STREAM("DEBUG ACTIVATED!");
+
+    // Starting to spin (the robot commander callbacks are processed here too)
+    adaptive_grasper.spinGrasper();
+
+    // Success message
+	ROS_INFO("\nTerminating Composed Adaptive Grasper!");
+
+    return 0;
+}
@@ -1,10 +1,12 @@
 #include "contactPreserver.h"
 #include "ros/ros.h"
+#include "utils/async_logger.h"
 #include "utils/pseudo_inversion.h"
 
 #define DEBUG               0   // print out additional info
 #define N_DEBUG             0   // sends as reference column of N(Q)
 #define USE_RP              0   // task inversion is performed using RP
+#define ESTIMATE_DECAY      0.95  // decay of the solve time estimates when they are not refreshed (lets the full solver be tried again)
 
 /**
 * @brief The following are functions of the class contactPreserver.
@@ -51,6 +53,7 @@ bool contactPreserver::initialize(Eigen::MatrixXd S_) {
 	x_d_old = Eigen::VectorXd::Ones(1 + 6);
 	ROS_WARN_STREAM("The number of rows of x_d_old is " << this->x_d_old.rows());
 	x_ref_old = Eigen::VectorXd::Zero(x_d_old.size());
+	return true;
 }
 
 /* INITIALIZETOPICS */
@@ -62,6 +65,7 @@ bool contactPreserver::initialize_topics(std::string object_twist_topic_name_, r
 			this->object_twist_topic_name, nh, ros::Duration(2.0));
 	this->obj_twist_sub = this->cp_nh_ptr->subscribe(this->object_twist_topic_name, 10,
 	                                                 &contactPreserver::object_twist_callback, this);
+	return true;
 }
 
 /* INITIALIZE */
@@ -85,6 +89,21 @@ bool contactPreserver::initialize_tasks(int num_tasks_, std::vector<int> dim_tas
 	} else {
 		this->sot_manager.set_basics(this->x_d_old.rows(), this->lambda_max, this->epsilon);
 	}
+	return this->dim_tasks.size() > this->num_tasks && this->dim_tasks.size() == this->prio_tasks.size();
+}
+
+/* SETTIMEBUDGET */
+void contactPreserver::setTimeBudget(double budget_, double fallback_scale_) {
+	// Setting the budget and the scaling for the previous solution fallback
+	this->time_budget = budget_;
+	this->fallback_scale = fallback_scale_;
+	ROS_INFO_STREAM("contactPreserver::setTimeBudget the budget of the kinematic inversion is " << this->time_budget
+		<< " s and the fallback scaling is " << this->fallback_scale << ".");
+}
+
+/* GETBUDGETSTATS */
+solverBudgetStats contactPreserver::getBudgetStats() {
+	return this->budget_stats;
 }
 
 /* CHANGEHANDTYPE */
@@ -134,16 +153,17 @@ bool contactPreserver::performKinInversion(Eigen::VectorXd &x_result) {
 	// Print message for debug
 	if (DEBUG) std::cout << "Entered performKinInversion in ContactPreserver!" << std::endl;
 
-	// Resize Q to be of correct size
-	Q.resize(H.rows(), x_d.size());
+	// Saving the starting time for checking the time budget
+	std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
 
-	// Print message for debug
-	if (DEBUG) std::cout << "Resized Q in contactPreserver!" << std::endl;
+	// Getting the latest object twist (if any new)
+	this->updateObjectTwist();
 
-	// Now create the block matrix
-	Q << Kc * H * J * S, Kc * H * T;
+	// Building Q_tilde (the factorized task set is not valid anymore, the managers get the full set below)
+	this->factorized = false;
+	this->build_Q_tilde();
 
-	// For debugging purposes (real line is above)
+	// For debugging purposes (sends a column of the null space of Q)
 	if (N_DEBUG) {
 		Eigen::FullPivLU<Eigen::MatrixXd> luN_debug(Q);
 		Eigen::MatrixXd N_debug = luN_debug.kernel();
@@ -151,6 +171,103 @@ bool contactPreserver::performKinInversion(Eigen::VectorXd &x_result) {
 		return true;
 	}
 
+	// Building y and the task set
+	this->build_y();
+	this->build_task_set();
+
+	// Checking if the full inversion fits into what is left of the time budget, otherwise choosing a cheaper solver
+	solverFallback fallback = FALLBACK_NONE;
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+	double full_solve_predicted = this->full_solve_estimate * this->tmp_task_vec.size();
+	if (this->time_budget > 0.0 && elapsed + full_solve_predicted > this->time_budget) {
+		if (elapsed + this->dls_solve_estimate > this->time_budget) {
+			fallback = FALLBACK_PREVIOUS;
+		} else {
+			fallback = FALLBACK_DLS;
+		}
+	}
+
+	// Insert tasks in manager and solve
+	bool solved = false;
+	std::chrono::steady_clock::time_point t_solve = std::chrono::steady_clock::now();
+	if (fallback == FALLBACK_NONE) {
+		if (USE_RP) {
+			// Pushing into RP Manager, printing out and solving
+			this->rp_manager.insert_tasks(this->tmp_task_vec);
+			if (DEBUG) this->rp_manager.print_set();
+			solved = this->rp_manager.solve_inv_kin(x_ref);
+		} else {
+			// Pushing into SOT Manager, printing out and solving
+			this->sot_manager.insert_tasks(this->tmp_task_vec);
+			if (DEBUG) this->sot_manager.print_set();
+			this->sot_manager.solve_inv_kin(x_ref);
+			solved = true;
+		}
+
+		// Updating the estimate of the full solve time per task (fast to grow, slow to shrink)
+		double per_task = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_solve).count()
+			/ std::max<int>(1, this->tmp_task_vec.size());
+		this->full_solve_estimate = std::max(per_task, 0.9 * this->full_solve_estimate + 0.1 * per_task);
+	} else if (fallback == FALLBACK_DLS) {
+		// Single damped least squares solve on the whole problem (priorities are not enforced)
+		this->solve_damped_least_squares(x_ref);
+		solved = x_ref.allFinite();
+
+		// Updating the estimate of the DLS time and letting the full solver estimate decay
+		double dls_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_solve).count();
+		this->dls_solve_estimate = std::max(dls_time, 0.9 * this->dls_solve_estimate + 0.1 * dls_time);
+		this->full_solve_estimate *= ESTIMATE_DECAY;
+		this->budget_stats.dls_fallbacks++;
+	} else {
+		// Reusing the last full or DLS solution (x_ref_old is not overwritten below, so the scale applies once and
+		// consecutive fallbacks hold the same scaled copy instead of decaying it towards zero)
+		x_ref = this->fallback_scale * x_ref_old;
+		solved = true;
+		this->full_solve_estimate *= ESTIMATE_DECAY;
+		this->dls_solve_estimate *= ESTIMATE_DECAY;
+		this->budget_stats.previous_fallbacks++;
+	}
+
+	// Recording the duration of this call and eventual overrun
+	double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+	this->budget_stats.ticks++;
+	this->budget_stats.last_fallback = fallback;
+	this->budget_stats.last_duration = duration;
+	this->budget_stats.max_duration = std::max(this->budget_stats.max_duration, duration);
+	this->budget_stats.last_build_duration = std::chrono::duration<double>(t_solve - t_start).count();
+	this->budget_stats.last_solve_duration = duration - this->budget_stats.last_build_duration;
+	if (this->time_budget > 0.0 && duration > this->time_budget) {
+		this->budget_stats.overruns++;
+		ROS_WARN_STREAM_THROTTLE(1.0, "contactPreserver::performKinInversion overran the time budget (" << duration
+			<< " s > " << this->time_budget << " s) with fallback " << fallback << "; " << this->budget_stats.overruns << " overruns so far.");
+	}
+
+	// Pass reference as solution of task inversion
+	if (solved) {
+		AG_LOG_MATRIX(LOG_LEVEL_DEBUG, 1.0, "The Task Set Solution is", x_ref);
+		if (fallback != FALLBACK_PREVIOUS) x_ref_old = x_ref;
+		x_result = x_ref;
+		if (DEBUG) ROS_WARN_STREAM("A new reference has been sent! Yahoo!");
+		return true;
+	} else {
+		ROS_ERROR("Task Inversion Manager could not find solution!");
+		x_result = x_ref_old;
+		return false;
+	}
+
+}
+
+/* BUILDQTILDE */
+void contactPreserver::build_Q_tilde() {
+	// Resize Q to be of correct size
+	Q.resize(H.rows(), x_d.size());
+
+	// Print message for debug
+	if (DEBUG) std::cout << "Resized Q in contactPreserver!" << std::endl;
+
+	// Now create the block matrix
+	Q << Kc * H * J * S, Kc * H * T;
+
 	// Print message for debug
 	if (DEBUG) std::cout << "Computed Q in contactPreserver!" << std::endl;
 
@@ -161,13 +278,19 @@ bool contactPreserver::performKinInversion(Eigen::VectorXd &x_result) {
 	// Print message for debug
 	if (DEBUG) std::cout << "Computed Q_tilde in contactPreserver!" << std::endl;
 
+	// The constant part of y_c
+	KcHGt = Kc * H * G.transpose();
+}
+
+/* BUILDY */
+void contactPreserver::build_y() {
 	// Rotating the contact wrenches to finger frames and appending
 	Eigen::VectorXd f_d_d_tot = this->create_force_ref_vec(this->read_contacts_map, this->f_d_d);
 
 	// Compute vector y
 	y.resize(x_d.size() + H.rows());
 	// Use also Kc
-	Eigen::VectorXd y_c = f_d_d_tot + Kc * H * G.transpose() * xi_o;
+	Eigen::VectorXd y_c = f_d_d_tot + KcHGt * xi_o;
 	y << x_d, y_c;
 
 	// DEBUG PRINTS
@@ -182,7 +305,10 @@ bool contactPreserver::performKinInversion(Eigen::VectorXd &x_result) {
 		std::cout << "H*G.transpose()*xi_o = " << H * G.transpose() * xi_o << std::endl;
 		std::cout << "----------------" << std::endl;
 	}
+}
 
+/* BUILDTASKSET */
+void contactPreserver::build_task_set() {
 	// Preparing to fill in the tasks in the RP Manager
 	Eigen::VectorXd tmp_x_dot;
 	Eigen::MatrixXd tmp_jacobian;
@@ -190,6 +316,7 @@ bool contactPreserver::performKinInversion(Eigen::VectorXd &x_result) {
 	int row_index;
 
 	this->tmp_task_vec.clear();     // Clearing the vector of tasks
+	this->task_rows.clear();
 
 	// Clearing the task set
 	if (USE_RP) {
@@ -207,6 +334,7 @@ bool contactPreserver::performKinInversion(Eigen::VectorXd &x_result) {
 		tmp_x_dot = y.block(row_index, 0, this->dim_tasks[i], y.cols());
 		tmp_jacobian = Q_tilde.block(row_index, 0, this->dim_tasks[i], Q_tilde.cols());
 		tmp_priority = this->prio_tasks[i];
+		this->task_rows.push_back(std::make_pair(row_index, this->dim_tasks[i]));
 		dim_reached += this->dim_tasks[i];
 
 		// Push in tmp variables
@@ -223,6 +351,7 @@ bool contactPreserver::performKinInversion(Eigen::VectorXd &x_result) {
 			tmp_x_dot = y.block(dim_reached, 0, this->dim_tasks[j], y.cols());
 			tmp_jacobian = Q_tilde.block(dim_reached, 0, this->dim_tasks[j], Q_tilde.cols());
 			tmp_priority = this->prio_tasks[j];
+			this->task_rows.push_back(std::make_pair(dim_reached, this->dim_tasks[j]));
 			dim_reached += this->dim_tasks[j];
 
 			// Push in tmp variables
@@ -244,35 +373,69 @@ bool contactPreserver::performKinInversion(Eigen::VectorXd &x_result) {
 			}
 		}
 	}
+}
 
-	// Insert tasks in manager and solve
-	bool solved = false;
+/* PREPAREINVERSION */
+bool contactPreserver::prepareInversion() {
+	// Building the task set with the current grasp state and velocities
+	this->updateObjectTwist();
+	this->build_Q_tilde();
+	this->build_y();
+	this->build_task_set();
+
+	// Factorizing it in the manager (the velocities will be given by solveInversion)
 	if (USE_RP) {
-		// Pushing into RP Manager, printing out and solving
 		this->rp_manager.insert_tasks(this->tmp_task_vec);
-		if (DEBUG) this->rp_manager.print_set();
-		solved = this->rp_manager.solve_inv_kin(x_ref);
+		this->factorized = this->rp_manager.prepare_factorization();
 	} else {
-		// Pushing into SOT Manager, printing out and solving
 		this->sot_manager.insert_tasks(this->tmp_task_vec);
-		if (DEBUG) this->sot_manager.print_set();
-		this->sot_manager.solve_inv_kin(x_ref);
-		solved = true;
+		this->factorized = this->sot_manager.prepare_factorization();
+	}
+	return this->factorized;
+}
+
+/* SOLVEINVERSION */
+bool contactPreserver::solveInversion(Eigen::VectorXd &x_result) {
+	// Nothing to solve without a factorization
+	if (!this->factorized) {
+		x_result = x_ref_old;
+		return false;
+	}
+
+	// Only y changes: slicing the task velocities out of it
+	this->updateObjectTwist();
+	this->build_y();
+	this->task_x_dots.resize(this->task_rows.size());
+	for (size_t i = 0; i < this->task_rows.size(); i++) {
+		this->task_x_dots[i] = this->y.segment(this->task_rows[i].first, this->task_rows[i].second);
+	}
+
+	// Solving with the cached factorization
+	bool solved;
+	if (USE_RP) {
+		solved = this->rp_manager.solve_with_factorization(this->task_x_dots, x_ref);
+	} else {
+		solved = this->sot_manager.solve_with_factorization(this->task_x_dots, x_ref);
 	}
 
-	// Pass reference as solution of task inversion
 	if (solved) {
-		ROS_INFO_STREAM("The Task Set Solution is \n" << x_ref);
 		x_ref_old = x_ref;
 		x_result = x_ref;
-		if (DEBUG) ROS_WARN_STREAM("A new reference has been sent! Yahoo!");
 		return true;
 	} else {
-		ROS_ERROR("Task Inversion Manager could not find solution!");
+		ROS_ERROR_THROTTLE(1.0, "contactPreserver::solveInversion could not solve with the factorized task set!");
 		x_result = x_ref_old;
 		return false;
 	}
+}
 
+/* SOLVEDAMPEDLEASTSQUARES */
+void contactPreserver::solve_damped_least_squares(Eigen::VectorXd &x_sol) {
+	// Solving (Q_tilde^T Q_tilde + lambda^2 I) x = Q_tilde^T y with a small LDLT instead of an SVD per task
+	Eigen::MatrixXd A = this->Q_tilde.transpose() * this->Q_tilde;
+	A.diagonal().array() += std::pow(this->lambda_max, 2);
+	x_sol = A.ldlt().solve(this->Q_tilde.transpose() * this->y);
+	if (DEBUG) std::cout << "Solved the DLS fallback in contactPreserver!" << std::endl;
 }
 
 /* PRINTALL */
@@ -353,16 +516,20 @@ Eigen::VectorXd contactPreserver::create_force_ref_vec(std::map<int, std::tuple<
 
 }
 
+/* UPDATEOBJECTTWIST */
+bool contactPreserver::updateObjectTwist() {
+	// Only a twist different from the current one counts as a change
+	Eigen::Matrix<double, 6, 1> new_xi_o;
+	if (!this->xi_o_mailbox.fetch(new_xi_o) || this->xi_o == new_xi_o) return false;
+	this->xi_o = new_xi_o;
+	return true;
+}
+
 /* OBJECTTWISTCALLBACK */
 void contactPreserver::object_twist_callback(const geometry_msgs::Twist::ConstPtr &msg) {
-	// Resizing the eigen vector
-	this->xi_o.resize(6);
-
-	// Saving the msg to the eigen vector
-	this->xi_o << msg->linear.x;
-	this->xi_o << msg->linear.y;
-	this->xi_o << msg->linear.z;
-	this->xi_o << msg->angular.x;
-	this->xi_o << msg->angular.y;
-	this->xi_o << msg->angular.z;
+	// Saving the msg to an eigen vector and passing it to the control loop
+	Eigen::Matrix<double, 6, 1> new_xi_o;
+	new_xi_o << msg->linear.x, msg->linear.y, msg->linear.z,
+		msg->angular.x, msg->angular.y, msg->angular.z;
+	this->xi_o_mailbox.post(new_xi_o);
 }
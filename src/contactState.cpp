@@ -1,8 +1,12 @@
 #include "contactState.h"
+#include <limits>
+#include <cmath>
+#include <algorithm>
 
 #define EXEC_NAMESPACE    "adaptive_grasping"
 #define CLASS_NAMESPACE   "contact_state"
 #define DEBUG             0                       // prints out additional info
+#define TOUCH_SUB_QUEUE   32                      // subscriber queue size for the touch topics
 
 /**
 * @brief The following are functions of the class contactState.
@@ -13,13 +17,17 @@ using namespace adaptive_grasping;
 
 /* DEFAULT CONSTRUCTOR */
 contactState::contactState(){
-    // Nothing to do here
+    // Starting with an empty snapshot
+    snapshot = std::make_shared<const contactSnapshot>();
 }
 
 /* CONSTRUCTOR */
 contactState::contactState(std::string topic_name,
   std::map<int, std::string> link_names_map_,
     std::map<std::string, std::string> params_map_){
+    // Starting with an empty snapshot
+    snapshot = std::make_shared<const contactSnapshot>();
+
     // Initialize the object
     this->initialized = intialize(topic_name, link_names_map_, params_map_);
 }
@@ -33,11 +41,15 @@ contactState::~contactState(){
 void contactState::readValues(std::map<int, std::tuple<std::string,
   Eigen::Affine3d, Eigen::Affine3d>>& input_map_,
     std::map<int, sensor_msgs::JointState>& input_map2_){
-    // Reading the contacts_map
-    contact_state_mutex.lock();                             // mutex on
-    input_map_ = contacts_map;
-    input_map2_ = joints_map;
-    contact_state_mutex.unlock();                           // mutex off
+    // Copying from the latest published snapshot (no lock taken)
+    std::shared_ptr<const contactSnapshot> snap = getSnapshot();
+    input_map_ = snap->contacts_map;
+    input_map2_ = snap->joints_map;
+}
+
+/* GETSNAPSHOT */
+std::shared_ptr<const contactSnapshot> contactState::getSnapshot(){
+    return std::atomic_load(&snapshot);
 }
 
 /* RESETCONTACTS */
@@ -45,10 +57,18 @@ bool contactState::resetContact(){
   // Clearing the maps
   ROS_INFO("Resetting maps in contactState!");
 
-  contact_state_mutex.lock();
+  // Touches still in the queue (received before now) are discarded when drained
+  last_reset_nsec = ros::Time::now().toNSec();
+  touching_links = 0;
+
+  std::lock_guard<std::mutex> writer_lock(writer_mutex);
   joints_map.clear();
   contacts_map.clear();
-  contact_state_mutex.unlock();
+  valid_contacts.clear();
+  transforms_pending = false;
+  publishSnapshot();
+
+  return true;
 }
 
 /* INITIALIZE */
@@ -58,69 +78,163 @@ bool contactState::intialize(std::string topic_name,
     // The finger_id is 0 as there are no contacts yet
     touching_finger = 0;
 
-    // Subscribing to topic (queue is 1 for quick processing)
-    finger_col_sub = node_contact_state.subscribe(topic_name, 1,
+    // Subscribing to topic (the callback only queues the touches, so no message needs to be discarded)
+    finger_col_sub = node_contact_state.subscribe(topic_name, TOUCH_SUB_QUEUE,
       &contactState::handleCollision, this);
 
-    // Initializing the service client
-    fj_client = node_contact_state.serviceClient<finger_fk::FingerJointsService>("fj_service");
+    // Subscribing also to the stamped multi finger touches topic
+    std::string touches_topic_name = "/finger_touches";
+    if(!node_contact_state.getParam("adaptive_grasping/touches_topic_name", touches_topic_name)){
+      ROS_WARN("contactState::intialize : Could not get parameter touches_topic_name. Using default.");
+    }
+    touches_sub = node_contact_state.subscribe(touches_topic_name, TOUCH_SUB_QUEUE,
+      &contactState::handleTouches, this);
+
+    // Subscribing to the joint states from which the finger joints are extracted
+    js_sub = node_contact_state.subscribe("joint_states", 1, &contactState::getJointState, this);
+
+    // Initializing the service client (only used as fallback if so configured)
+    if(!node_contact_state.getParam("adaptive_grasping/use_fj_service", use_fj_service)){
+      ROS_WARN("contactState::intialize : Could not get parameter use_fj_service. Using default.");
+    }
+    if(use_fj_service){
+      fj_client = node_contact_state.serviceClient<finger_fk::FingerJointsService>("fj_service");
+    }
 
     // Constructing the maps
     this->params_map = params_map_;
     this->link_names_map = link_names_map_;
 
+    // Preparing the finger chains (needed for the joint names and for the forward kinematics)
+    if(!node_contact_state.getParam("adaptive_grasping/use_fk", use_fk)){
+      ROS_WARN("contactState::intialize : Could not get parameter use_fk. Using default.");
+    }
+    if(!prepareKDL()) use_fk = false;
+
+    // Starting the tf2 listener with its own spinning thread
+    tf_listener.reset(new tf2_ros::TransformListener(tf_buffer, node_contact_state, true));
+
+    // Getting the stale transform handling params
+    if(!node_contact_state.getParam("adaptive_grasping/tf_max_age", tf_max_age)){
+      ROS_WARN("contactState::intialize : Could not get parameter tf_max_age. Using default.");
+    }
+    if(!node_contact_state.getParam("adaptive_grasping/tf_stale_policy", tf_stale_policy)){
+      ROS_WARN("contactState::intialize : Could not get parameter tf_stale_policy. Using default.");
+    }
+    if(tf_stale_policy != "use" && tf_stale_policy != "hold"){
+      ROS_ERROR_STREAM("contactState::intialize : Unknown tf_stale_policy " << tf_stale_policy << ". Using hold.");
+      tf_stale_policy = "hold";
+    }
+
     // Initializing the publisher
     this->pub_num_touches = this->node_contact_state.advertise<std_msgs::Int8>("/num_touches_contact_state", 1);
+    return true;
 }
 
 /* HANDLECOLLISION */
 void contactState::handleCollision(const std_msgs::Int8::ConstPtr& msg){
-  // This if-else is needed to avoid the zeros in touching finger topic to create
-  // problems in the contacts and joints maps updating
+  // Zeros in the touching finger topic mean that there are no touches yet
   if(msg->data == 0){
     if(DEBUG) ROS_INFO("There have been no touches yet! adaptive_grasping break!");
-  } else {
-    // Temporarily saving message
-    touching_finger = msg->data;
+    return;
   }
 
-  // This big if is needed to not updating the maps while there is no contact yet
-  if(touching_finger != 0){
-    // Checking if the echoed finger id is a good value
-    std::map<int, std::string>::iterator it_names = link_names_map.find(touching_finger);
-    if(it_names == link_names_map.end()){
-      ROS_ERROR("THE ECHOED ID IS NOT GOOD: IT SHOULD HAVE BEEN BETWEEN 1 AND 5");
-    }
+  // Checking if the echoed finger id is a good value
+  if(link_names_map.find(msg->data) == link_names_map.end()){
+    ROS_ERROR("THE ECHOED ID IS NOT GOOD: IT SHOULD HAVE BEEN BETWEEN 1 AND 5");
+    return;
+  }
 
-    // Creating a tuple with identity Affine3ds
+  // Only queueing the touch (as a single bit mask) with its receive time
+  touching_finger = msg->data;
+  queueTouches(touch_queue, uint8_t(1) << (touching_finger - 1), 0, ros::Time::now());
+}
+
+/* HANDLETOUCHES */
+void contactState::handleTouches(const adaptive_grasping::FingerTouches::ConstPtr& msg){
+  // An empty set carries no new contacts (removals are done by resetContact)
+  if(msg->finger_mask == 0 && msg->link_mask == 0) return;
+
+  // Queueing the whole set at once (using the receive time if the message is not stamped)
+  ros::Time stamp = msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp;
+  queueTouches(mask_queue, msg->finger_mask, msg->link_mask, stamp);
+}
+
+/* QUEUETOUCHES */
+void contactState::queueTouches(spscRingBuffer<touchEvent, TOUCH_QUEUE_SIZE>& queue,
+  uint8_t finger_mask, uint32_t link_mask, ros::Time stamp){
+  // The maps are updated by processPendingTouches
+  touchEvent event;
+  event.finger_mask = finger_mask;
+  event.link_mask = link_mask;
+  event.stamp = stamp;
+  if(!queue.push(event)){
+    dropped_touches++;
+    ROS_WARN_THROTTLE(1.0, "contactState::queueTouches : touch queue full, dropping a touch event.");
+    return;
+  }
+
+  // Updating the queue high water mark
+  size_t depth = queue.size();
+  if(depth > queue_high_water) queue_high_water = depth;
+}
+
+/* PROCESSPENDINGTOUCHES */
+int contactState::processPendingTouches(){
+  // Draining both queues and merging all the touches in a single set
+  ros::Time reset_stamp;
+  reset_stamp.fromNSec(last_reset_nsec.load());
+  int processed = 0;
+  uint8_t finger_mask = 0;
+  uint32_t link_mask = 0;
+  touchEvent event;
+  while(touch_queue.pop(event) || mask_queue.pop(event)){
+    // Events stamped before the last reset belong to the previous grasp
+    if(event.stamp < reset_stamp) continue;
+    finger_mask |= event.finger_mask;
+    link_mask |= event.link_mask;
+    processed++;
+  }
+
+  // Nothing to do if no touches arrived and no contact is waiting for its transforms
+  if(processed == 0 && !transforms_pending) return 0;
+  processed_touches += processed;
+  touching_links |= link_mask;
+
+  // Building the new state in the working maps (only the reader works on the published snapshot)
+  std::lock_guard<std::mutex> writer_lock(writer_mutex);
+  size_t valid_before = valid_contacts.size();
+
+  // Inserting all the touching fingers in the maps (already present ones keep their last transforms)
+  for(auto it_n : link_names_map){
+    if(it_n.first < 1 || it_n.first > 8 || !(finger_mask & (uint8_t(1) << (it_n.first - 1)))) continue;
+    if(DEBUG) std::cout << "The touching finger link is " << it_n.second << "." << std::endl;
+
+    // Creating a tuple with identity Affine3ds and an empty joint state
     Eigen::Affine3d identity_aff = Eigen::Affine3d::Identity();
-    std::string touched_link_name = link_names_map.at(touching_finger);
-    if(DEBUG) std::cout << "The touching finger link is " << touched_link_name << "." << std::endl;
     std::tuple<std::string, Eigen::Affine3d,
-      Eigen::Affine3d> empty_tuple (std::make_tuple(touched_link_name,
+      Eigen::Affine3d> empty_tuple (std::make_tuple(it_n.second,
         identity_aff, identity_aff));
-    if(DEBUG) std::cout << "The touching finger link in empty_tuple is " << std::get<0>(empty_tuple) << "." << std::endl;
-    
-    // Analogously creating an empty joint state
     sensor_msgs::JointState empty_joints;
 
-    // Just to be sure that the last touched finger id is in the map, inserting
-    // (eventually overwriting) the element in the contacts_map
-    contact_state_mutex.lock();                             // mutex on
-    contacts_map[touching_finger] = empty_tuple;
-    joints_map[touching_finger] = empty_joints;
-    contact_state_mutex.unlock();                           // mutex off
-
-    // Iteratively updating contacts_map and joints_map
-    iterateContacts();
-    iterateJoints();
-
-    // Getting the number of elements in the map and publishing
-    int number_contacts = this->contacts_map.size();
-    this->num_msg.data = number_contacts;
-    this->pub_num_touches.publish(this->num_msg);
+    contacts_map.insert(std::make_pair(it_n.first, empty_tuple));
+    joints_map.insert(std::make_pair(it_n.first, empty_joints));
   }
 
+  // Updating once joints_map and contacts_map for the whole set (the joints are needed by the forward kinematics)
+  iterateJoints();
+  iterateContacts();
+  transforms_pending = valid_contacts.size() < contacts_map.size();
+
+  // Publishing the new state to the readers with a single pointer swap (a retry publishes only if a contact got its transforms)
+  if(processed == 0 && valid_contacts.size() == valid_before) return 0;
+  publishSnapshot();
+
+  // Getting the number of published contacts and publishing
+  int number_contacts = this->valid_contacts.size();
+  this->num_msg.data = number_contacts;
+  this->pub_num_touches.publish(this->num_msg);
+
   // Printing out the contacts map
   if(DEBUG){
     std::cout << "Contacts map in contactState is:" << std::endl;
@@ -128,93 +242,256 @@ void contactState::handleCollision(const std_msgs::Int8::ConstPtr& msg){
       std::cout << elem.first << " : " << std::get<0>(elem.second) << "." << std::endl;
     }
   }
+
+  return processed;
+}
+
+/* PUBLISHSNAPSHOT */
+void contactState::publishSnapshot(){
+  // Copying the contacts with valid transforms into a new immutable snapshot and swapping it in
+  std::shared_ptr<contactSnapshot> new_snapshot = std::make_shared<contactSnapshot>();
+  for(auto& it_c : contacts_map){
+    if(valid_contacts.count(it_c.first) == 0) continue;
+    new_snapshot->contacts_map.insert(it_c);
+    auto it_j = joints_map.find(it_c.first);
+    if(it_j != joints_map.end()) new_snapshot->joints_map.insert(*it_j);
+  }
+  new_snapshot->generation = ++snapshot_generation;
+  new_snapshot->stamp = ros::Time::now();
+  std::atomic_store(&snapshot, std::shared_ptr<const contactSnapshot>(new_snapshot));
+}
+
+/* GETTOUCHINGLINKS */
+uint32_t contactState::getTouchingLinks(){
+  return touching_links.load();
+}
+
+/* GETTOUCHQUEUESTATS */
+touchQueueStats contactState::getTouchQueueStats(){
+  touchQueueStats stats;
+  stats.processed = processed_touches.load();
+  stats.dropped = dropped_touches.load();
+  stats.depth = touch_queue.size() + mask_queue.size();
+  stats.high_water = queue_high_water.load();
+  return stats;
 }
 
 /* ITERATECONTACTS */
 void contactState::iterateContacts(){
-  // Creating an iterator for contacts_map
-  // std::map<int, std::tuple<std::string, Eigen::Affine3d,
-  //   Eigen::Affine3d>>::iterator it_c;
+    // Getting the frame names
+    std::string frame_world = params_map.at("world_name");
+    std::string frame_palm = params_map.at("palm_name");
+
+    // Getting the world to palm transform once (with forward kinematics it is the only one coming from tf)
+    Eigen::Affine3d new_world_palm_aff = world_palm_aff;
+    double world_palm_age;
+    bool world_palm_fresh = getTrasform(frame_world, frame_palm, new_world_palm_aff, world_palm_age);
+    if(world_palm_fresh || (tf_stale_policy == "use" && std::isfinite(world_palm_age))){
+      world_palm_aff = new_world_palm_aff;
+      have_world_palm = true;
+    } else if(have_world_palm){
+      ROS_WARN_STREAM_THROTTLE(1.0, "contactState::iterateContacts : the palm transform is stale or missing (age "
+        << world_palm_age << " s), holding the previous one.");
+    }
 
-    // Now with a loop echoing and saving all needed transforms in contacts_map
+    // Without a palm transform no contact can be placed (they wait, out of the snapshot, for the next update)
+    if(!have_world_palm){
+      ROS_WARN_STREAM_THROTTLE(1.0, "contactState::iterateContacts : no palm transform received yet (age "
+        << world_palm_age << " s), the contacts are not updated.");
+      return;
+    }
+
+    // Now with a loop computing and saving all needed transforms in contacts_map
     for(auto it_c : contacts_map){
-      // Getting the frame names
+      // Getting the finger frame name
       std::string frame_fing = std::get<0>(it_c.second);
       if(DEBUG) std::cout << "Managing contacts for " << frame_fing << "." << std::endl;
-      std::string frame_world = params_map.at("world_name");
-      std::string frame_palm = params_map.at("palm_name");
 
-      // Getting all the needed transforms
-      Eigen::Affine3d fing_aff = getTrasform(frame_world, frame_fing);
-      Eigen::Affine3d palm_aff = getTrasform(frame_palm, frame_fing);
+      // Getting all the needed transforms (starting from the previously saved ones)
+      Eigen::Affine3d fing_aff = std::get<1>(it_c.second);
+      Eigen::Affine3d palm_aff = std::get<2>(it_c.second);
       // CLARIFICATION: The transformation palm_aff is from palm to finger
 
+      if(use_fk && computeFingerFK(it_c.first, joints_map[it_c.first], palm_aff)){
+        // Palm to finger from the joint state, world to finger through the common palm transform
+        fing_aff = world_palm_aff * palm_aff;
+        valid_contacts.insert(it_c.first);
+      } else {
+        // Falling back to tf for both transforms
+        Eigen::Affine3d new_fing_aff = fing_aff;
+        Eigen::Affine3d new_palm_aff = palm_aff;
+        double fing_age; double palm_age;
+        bool fing_ok = getTrasform(frame_world, frame_fing, new_fing_aff, fing_age);
+        bool palm_ok = getTrasform(frame_palm, frame_fing, new_palm_aff, palm_age);
+
+        // Stale transforms are used or held (if so configured) instead of waiting for new ones, missing ones are never used
+        if((fing_ok && palm_ok) || (tf_stale_policy == "use" && std::isfinite(fing_age) && std::isfinite(palm_age))){
+          fing_aff = new_fing_aff;
+          palm_aff = new_palm_aff;
+          valid_contacts.insert(it_c.first);
+        } else if(valid_contacts.count(it_c.first) > 0){
+          ROS_WARN_STREAM_THROTTLE(1.0, "contactState::iterateContacts : transforms of " << frame_fing
+            << " are stale or missing (ages " << fing_age << " s and " << palm_age << " s), holding the previous ones.");
+        } else {
+          ROS_WARN_STREAM_THROTTLE(1.0, "contactState::iterateContacts : no valid transforms of " << frame_fing
+            << " yet (ages " << fing_age << " s and " << palm_age << " s), the contact is not published.");
+        }
+      }
+
       // Writing the correct tuple into the map
       std::tuple<std::string, Eigen::Affine3d,
         Eigen::Affine3d> correct_tuple (std::make_tuple(frame_fing,
           fing_aff, palm_aff));
-      contact_state_mutex.lock();                             // mutex on
       contacts_map[it_c.first] = correct_tuple;
-      contact_state_mutex.unlock();                           // mutex off
     }
 }
 
 /* ITERATEJOINTS */
 void contactState::iterateJoints(){
-  // Creating an iterator for joints_map
-  std::map<int, sensor_msgs::JointState>::iterator it_j;
+  // Getting the latest joint state (no waiting, it is saved by the joint states callback)
+  joint_state_mutex.lock();                                 // mutex on
+  sensor_msgs::JointState::ConstPtr joint_state = latest_joint_state;
+  joint_state_mutex.unlock();                               // mutex off
+
+  // Checking (and if needed rebuilding) the name to index table of the hub
+  bool table_ok = joint_hub.update(joint_state);
 
-  // Now with another loop echoing and saving all needed joints in joints_map
-  for(it_j = joints_map.begin(); it_j != joints_map.end(); ++it_j){
-    // Getting the joint state from service
+  // Now with another loop extracting and saving all needed joints in joints_map
+  for(auto it_j : joints_map){
     sensor_msgs::JointState correct_joints;
 
-    // Creating an srv with touching_finger id and filling up
-    if(DEBUG) ROS_INFO("The Finger Joint srv is being filled!");
-    finger_fk::FingerJointsService srv;
-    srv.request.finger_id = it_j->first;
-
-    // Calling the service
-    if (fj_client.call(srv)) {
-      if(DEBUG){
-        ROS_INFO("The result is as follows:");
-        for(size_t i = 0; i < srv.response.joint_state.name.size(); i++) {
-          std::cout << i << ", " << srv.response.joint_state.name[i] << " : " <<
-            srv.response.joint_state.position[i] << ";" << std::endl;
+    if(table_ok && joint_hub.getFingerJoints(it_j.first, correct_joints.position)){
+      // The joints of the finger from the joint state
+      correct_joints.header = joint_state->header;
+      correct_joints.name = finger_joint_names[it_j.first];
+    } else if(use_fj_service){
+      // Falling back to the finger_joints_service
+      if(DEBUG) ROS_INFO("The Finger Joint srv is being filled!");
+      finger_fk::FingerJointsService srv;
+      srv.request.finger_id = it_j.first;
+
+      if(fj_client.call(srv)){
+        if(DEBUG){
+          ROS_INFO("The result is as follows:");
+          for(size_t i = 0; i < srv.response.joint_state.name.size(); i++) {
+            std::cout << i << ", " << srv.response.joint_state.name[i] << " : " <<
+              srv.response.joint_state.position[i] << ";" << std::endl;
+          }
         }
+      } else {
+        ROS_ERROR("Failed to call finger_joints_service");
       }
+
+      correct_joints = srv.response.joint_state;
     } else {
-      ROS_ERROR("Failed to call finger_joints_service");
+      ROS_WARN_STREAM_THROTTLE(1.0, "contactState::iterateJoints : No joints available for finger "
+        << it_j.first << ", holding the previous ones.");
+      continue;
     }
 
-    correct_joints = srv.response.joint_state;
-
     // Writing the correct JointState into the map
-    contact_state_mutex.lock();                             // mutex on
-    joints_map[it_j->first] = correct_joints;
-    contact_state_mutex.unlock();                           // mutex off
+    joints_map[it_j.first] = correct_joints;
   }
 }
 
+/* GETJOINTSTATE */
+void contactState::getJointState(const sensor_msgs::JointState::ConstPtr& msg){
+  // Only saving the pointer to the message, extraction happens on contact updates
+  joint_state_mutex.lock();                                 // mutex on
+  latest_joint_state = msg;
+  joint_state_mutex.unlock();                               // mutex off
+}
+
+/* PREPAREKDL */
+bool contactState::prepareKDL(){
+    // Load robot description from ROS parameter server
+    std::string robot_description_string;
+    node_contact_state.param("robot_description", robot_description_string, std::string());
+
+    // Get kinematic tree from robot description
+    if(!kdl_parser::treeFromString(robot_description_string, robot_kin_tree)){
+      ROS_ERROR("contactState::prepareKDL : Failed to get robot kinematic tree! Contacts will come from tf and joints only from fj_service.");
+      return false;
+    }
+
+    // Creating once the palm to finger chains and their position solvers
+    for(auto it : link_names_map){
+      KDL::Chain chain;
+      if(!robot_kin_tree.getChain(params_map.at("palm_name"), it.second, chain)){
+        ROS_WARN_STREAM("contactState::prepareKDL : No chain from palm to " << it.second << ". Using tf for it.");
+        continue;
+      }
+      finger_chains[it.first] = chain;
+      fk_solvers[it.first].reset(new KDL::ChainFkSolverPos_recursive(finger_chains[it.first]));
+
+      // Saving the names of the movable joints of the chain (in chain order)
+      std::vector<std::string> joint_names;
+      for(unsigned int i = 0; i < chain.getNrOfSegments(); i++){
+        if(chain.getSegment(i).getJoint().getType() != KDL::Joint::None){
+          joint_names.push_back(chain.getSegment(i).getJoint().getName());
+        }
+      }
+      finger_joint_names[it.first] = joint_names;
+      joint_hub.addFinger(it.first, joint_names);
+    }
+
+    return true;
+}
+
+/* COMPUTEFINGERFK */
+bool contactState::computeFingerFK(int finger_id, const sensor_msgs::JointState& finger_joints,
+  Eigen::Affine3d& palm_aff){
+    // Checking that there is a solver and that the joints are consistent with its chain
+    auto it_s = fk_solvers.find(finger_id);
+    if(it_s == fk_solvers.end()) return false;
+    unsigned int nr_joints = finger_chains[finger_id].getNrOfJoints();
+    if(finger_joints.position.size() != nr_joints) return false;
+
+    // Filling the joint array (by name if the names are given, else in chain order)
+    KDL::JntArray q(nr_joints);
+    const std::vector<std::string>& chain_names = finger_joint_names[finger_id];
+    for(unsigned int i = 0; i < nr_joints; i++){
+      q(i) = finger_joints.position[i];
+      if(finger_joints.name.size() == nr_joints && finger_joints.name[i] != chain_names[i]){
+        auto it_n = std::find(finger_joints.name.begin(), finger_joints.name.end(), chain_names[i]);
+        if(it_n == finger_joints.name.end()) return false;
+        q(i) = finger_joints.position[it_n - finger_joints.name.begin()];
+      }
+    }
+
+    // Computing the palm to finger frame
+    KDL::Frame palm_frame;
+    if(it_s->second->JntToCart(q, palm_frame) < 0){
+      ROS_WARN_STREAM_THROTTLE(1.0, "contactState::computeFingerFK : forward kinematics failed for finger " << finger_id << ".");
+      return false;
+    }
+
+    // Converting to Affine3d
+    tf::transformKDLToEigen(palm_frame, palm_aff);
+    return true;
+}
+
 /* GETTRANSFORM*/
-Eigen::Affine3d contactState::getTrasform(std::string frame1_name,
-  std::string frame2_name){
-    // tf echoing using input frame names
+bool contactState::getTrasform(std::string frame1_name, std::string frame2_name,
+  Eigen::Affine3d& affine, double& age){
+    // Looking up the latest transform in the buffer (this never waits)
+    geometry_msgs::TransformStamped stamped_transform;
     try {
-		tf_listener.waitForTransform(std::string("/") + frame1_name,
-      std::string("/") + frame2_name, ros::Time(0), ros::Duration(1.0) );
-		tf_listener.lookupTransform(std::string("/") + frame1_name,
-      std::string("/") + frame2_name, ros::Time(0), stamped_transform);
-    } catch (tf::TransformException ex){
-      ROS_ERROR("%s",ex.what());
-      ros::Duration(1.0).sleep();
+      stamped_transform = tf_buffer.lookupTransform(frame1_name, frame2_name, ros::Time(0));
+    } catch (tf2::TransformException& ex){
+      ROS_ERROR_STREAM_THROTTLE(1.0, "contactState::getTrasform : " << ex.what());
+      age = std::numeric_limits<double>::infinity();
+      return false;
     }
 
     // Converting to Affine3d
-    Eigen::Affine3d affine;
-    tf::Transform transform(stamped_transform.getRotation(),
-      stamped_transform.getOrigin());
-    tf::transformTFToEigen(transform, affine);
+    tf::transformMsgToEigen(stamped_transform.transform, affine);
 
-    return affine;
+    // Checking the age of the transform (static transforms have a null stamp)
+    if(stamped_transform.header.stamp.isZero()){
+      age = 0.0;
+    } else {
+      age = (ros::Time::now() - stamped_transform.header.stamp).toSec();
+    }
+    return (tf_max_age <= 0.0 || age <= tf_max_age);
 }
@@ -0,0 +1,150 @@
+#include "debugTelemetry.h"
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define DEBUG             0                       // prints out additional info
+
+/**
+* @brief The following are functions of the class debugTelemetry.
+*
+*/
+
+using namespace adaptive_grasping;
+
+// The nice value of the publishing thread and the longest sleep (to notice stop)
+#define TELEMETRY_NICE          10
+#define TELEMETRY_MAX_SLEEP_NS  100000000
+
+/* NOWNS */
+static int64_t nowNs(){
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* DEFAULT CONSTRUCTOR */
+debugTelemetry::debugTelemetry(){
+  // Nothing to do here
+}
+
+/* DESTRUCTOR */
+debugTelemetry::~debugTelemetry(){
+  this->stop();
+}
+
+/* ADDCHANNEL */
+int debugTelemetry::addChannel(ros::NodeHandle& nh, std::string topic, telemetryType type, std::string rate_param,
+  double default_rate, std::string frame_id){
+  // Channels can only be added before the thread starts
+  if(running){
+    ROS_ERROR_STREAM("debugTelemetry::addChannel : Could not add " << topic << " while publishing.");
+    return -1;
+  }
+
+  double rate = default_rate;
+  if(!nh.getParam(rate_param, rate)){
+    ROS_WARN_STREAM("debugTelemetry::addChannel : Could not get parameter " << rate_param << ". Using default.");
+  }
+  if(rate <= 0.0) return -1;
+
+  std::unique_ptr<telemetryChannel> channel(new telemetryChannel());
+  channel->type = type;
+  channel->frame_id = frame_id;
+  channel->period_ns = int64_t(1e9 / rate);
+  switch(type){
+    case TELEMETRY_FLOAT64: channel->pub = nh.advertise<std_msgs::Float64>(topic, 1); break;
+    case TELEMETRY_ARRAY: channel->pub = nh.advertise<std_msgs::Float64MultiArray>(topic, 1); break;
+    case TELEMETRY_TWIST: channel->pub = nh.advertise<geometry_msgs::Twist>(topic, 1); break;
+    case TELEMETRY_WRENCH: channel->pub = nh.advertise<geometry_msgs::WrenchStamped>(topic, 1); break;
+  }
+  channels.push_back(std::move(channel));
+
+  if(DEBUG) ROS_INFO_STREAM("debugTelemetry::addChannel : " << topic << " published at " << rate << " Hz.");
+  return int(channels.size() - 1);
+}
+
+/* START */
+void debugTelemetry::start(){
+  if(running || channels.empty()) return;
+  array_msg.data.reserve(TELEMETRY_MAX_VALUES);
+  running = true;
+  worker = std::thread(&debugTelemetry::workerLoop, this);
+}
+
+/* STOP */
+void debugTelemetry::stop(){
+  running = false;
+  if(worker.joinable()) worker.join();
+}
+
+/* SAMPLE */
+void debugTelemetry::sample(int handle, const double* values, int size){
+  if(handle < 0) return;
+  telemetrySample new_sample;
+  new_sample.size = std::min(size, TELEMETRY_MAX_VALUES);
+  std::memcpy(new_sample.values, values, new_sample.size * sizeof(double));
+  new_sample.stamp_ns = ros::Time::now().toNSec();
+  channels[handle]->mailbox.post(new_sample);
+}
+
+/* GETPUBLISHED */
+unsigned long debugTelemetry::getPublished() const {
+  return published.load(std::memory_order_relaxed);
+}
+
+/* WORKERLOOP */
+void debugTelemetry::workerLoop(){
+  // Lowering the priority of this thread only (the control loop must always win)
+  if(setpriority(PRIO_PROCESS, syscall(SYS_gettid), TELEMETRY_NICE) != 0){
+    ROS_WARN("debugTelemetry::workerLoop : Could not lower the priority of the publishing thread.");
+  }
+
+  telemetrySample last_sample;
+  while(running.load() && ros::ok()){
+    // Publishing the due channels (only if sampled since their last publish)
+    int64_t now = nowNs();
+    int64_t next_wake = now + TELEMETRY_MAX_SLEEP_NS;
+    for(auto& channel : channels){
+      if(now >= channel->next_ns){
+        if(channel->mailbox.fetch(last_sample, channel->version)) this->publishSample(*channel, last_sample);
+        // Late channels restart from now (no bursts)
+        channel->next_ns = std::max(channel->next_ns + channel->period_ns, now);
+      }
+      next_wake = std::min(next_wake, channel->next_ns);
+    }
+    std::this_thread::sleep_for(std::chrono::nanoseconds(std::max(next_wake - nowNs(), int64_t(0))));
+  }
+}
+
+/* PUBLISHSAMPLE */
+void debugTelemetry::publishSample(telemetryChannel& channel, const telemetrySample& sample){
+  // Filling the message of the channel type (missing values are zero)
+  double v[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  std::memcpy(v, sample.values, std::min(sample.size, 6) * sizeof(double));
+  switch(channel.type){
+    case TELEMETRY_FLOAT64:
+      float_msg.data = v[0];
+      channel.pub.publish(float_msg);
+      break;
+    case TELEMETRY_ARRAY:
+      array_msg.data.assign(sample.values, sample.values + sample.size);
+      channel.pub.publish(array_msg);
+      break;
+    case TELEMETRY_TWIST:
+      twist_msg.linear.x = v[0]; twist_msg.linear.y = v[1]; twist_msg.linear.z = v[2];
+      twist_msg.angular.x = v[3]; twist_msg.angular.y = v[4]; twist_msg.angular.z = v[5];
+      channel.pub.publish(twist_msg);
+      break;
+    case TELEMETRY_WRENCH:
+      wrench_msg.header.frame_id = channel.frame_id;
+      wrench_msg.header.stamp.fromNSec(sample.stamp_ns);
+      wrench_msg.wrench.force.x = v[0]; wrench_msg.wrench.force.y = v[1]; wrench_msg.wrench.force.z = v[2];
+      wrench_msg.wrench.torque.x = v[3]; wrench_msg.wrench.torque.y = v[4]; wrench_msg.wrench.torque.z = v[5];
+      channel.pub.publish(wrench_msg);
+      break;
+  }
+  published.fetch_add(1, std::memory_order_relaxed);
+}
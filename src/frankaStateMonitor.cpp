@@ -0,0 +1,103 @@
+#include "frankaStateMonitor.h"
+#include <limits>
+
+#define DEBUG             0                       // prints out additional info
+
+/**
+* @brief The following are functions of the class frankaStateMonitor.
+*
+*/
+
+using namespace adaptive_grasping;
+
+/* DEFAULT CONSTRUCTOR */
+frankaStateMonitor::frankaStateMonitor(){
+  this->configure(0.1, JOINT_SPEED, 0.005);
+}
+
+/* DESTRUCTOR */
+frankaStateMonitor::~frankaStateMonitor(){
+  // Nothing to do here
+}
+
+/* CONFIGURE */
+void frankaStateMonitor::configure(double window, monitorChannel still_channel_, double still_threshold_){
+  for(auto& channel : statistics) channel.configure(window);
+  still_channel = still_channel_;
+  still_threshold = still_threshold_;
+  still_since = -1.0;
+}
+
+/* UPDATE */
+void frankaStateMonitor::update(const franka_msgs::FrankaState::ConstPtr& msg_){
+  msg = msg_;
+  last_update = ros::Time::now();
+
+  // The robot time stamps the samples (the rates are not affected by the delays of the callbacks)
+  double stamp = msg->time;
+  double samples[NUM_CHANNELS];
+  samples[TAU_EXT_NORM] = Eigen::Map<const Eigen::Matrix<double, 7, 1>>(msg->tau_ext_hat_filtered.data()).norm();
+  samples[EE_SPEED] = Eigen::Map<const Eigen::Matrix<double, 6, 1>>(msg->O_dP_EE_c.data()).norm();
+  samples[JOINT_SPEED] = Eigen::Map<const Eigen::Matrix<double, 7, 1>>(msg->dq.data()).norm();
+  samples[EE_X] = msg->O_T_EE[12];
+  samples[EE_Y] = msg->O_T_EE[13];
+  samples[EE_Z] = msg->O_T_EE[14];
+  for(int i = 0; i < NUM_CHANNELS; i++) statistics[i].push(samples[i], stamp);
+
+  // The stillness (restarting whenever the speed goes over the threshold)
+  if(samples[still_channel] >= still_threshold) still_since = -1.0;
+  else if(still_since < 0.0) still_since = stamp;
+
+  if(DEBUG) ROS_INFO_STREAM("frankaStateMonitor::update : tau_ext norm " << samples[TAU_EXT_NORM] << ", still for "
+    << getStillTime() << " s.");
+}
+
+/* ISVALID */
+bool frankaStateMonitor::isValid() const {
+  return bool(msg);
+}
+
+/* GETSTATISTICS */
+const windowedStatistics& frankaStateMonitor::getStatistics(monitorChannel channel) const {
+  return statistics[channel];
+}
+
+/* GETTRANSFORM */
+Eigen::Map<const Eigen::Matrix4d> frankaStateMonitor::getTransform() const {
+  return Eigen::Map<const Eigen::Matrix4d>(msg->O_T_EE.data());
+}
+
+/* GETPOSITION */
+Eigen::Vector3d frankaStateMonitor::getPosition() const {
+  return getTransform().block<3, 1>(0, 3);
+}
+
+/* GETZAXIS */
+Eigen::Vector3d frankaStateMonitor::getZAxis() const {
+  return getTransform().block<3, 1>(0, 2);
+}
+
+/* GETJOINTS */
+Eigen::Map<const Eigen::Matrix<double, 7, 1>> frankaStateMonitor::getJoints() const {
+  return Eigen::Map<const Eigen::Matrix<double, 7, 1>>(msg->q.data());
+}
+
+/* GETTAUEXTNORM */
+double frankaStateMonitor::getTauExtNorm() const {
+  return statistics[TAU_EXT_NORM].latest();
+}
+
+/* GETSTILLTIME */
+double frankaStateMonitor::getStillTime() const {
+  return still_since < 0.0 ? 0.0 : statistics[still_channel].latestStamp() - still_since;
+}
+
+/* GETAGE */
+double frankaStateMonitor::getAge() const {
+  return msg ? (ros::Time::now() - last_update).toSec() : std::numeric_limits<double>::infinity();
+}
+
+/* GETMESSAGE */
+franka_msgs::FrankaState::ConstPtr frankaStateMonitor::getMessage() const {
+  return msg;
+}
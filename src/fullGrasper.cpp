@@ -2,6 +2,7 @@
 #include "utils/parsing_utilities.h"
 
 #include "adaptive_grasping/adaptiveGrasp.h"
+#include <future>
 
 #define EXEC_NAMESPACE    "adaptive_grasping"
 #define CLASS_NAMESPACE   "full_grasper"
@@ -15,6 +16,9 @@
 
 using namespace adaptive_grasping;
 
+// The names of the phases of the grasp sequencer (same order as graspPhase)
+const char* fullGrasper::PHASE_NAMES[] = {"idle", "approach", "pivot", "restrain", "close", "lift", "handover", "settle", "done", "failed"};
+
 /* CONSTRUCTOR */
 fullGrasper::fullGrasper(){
     // Nothing to do here
@@ -35,16 +39,27 @@ fullGrasper::fullGrasper(std::string arm_ns_, std::string hand_ns_, std::vector<
     this->normal_controllers_names = normal_controllers_names_;
     this->velocity_controllers_names = velocity_controllers_names_;
 
-    // Initializing the franka_state_sub subscriber and waiting
+    // Configuring the franka state monitor, initializing the franka_state_sub subscriber and waiting
+    this->franka_monitor.configure(this->monitor_window, this->still_source == "O_dP_EE" ? frankaStateMonitor::EE_SPEED
+        : frankaStateMonitor::JOINT_SPEED, this->still_threshold);
     this->franka_state_sub = this->nh.subscribe("/" + this->arm_name + this->franka_state_topic_name, 1, &fullGrasper::get_franka_state, this);
     ros::topic::waitForMessage<franka_msgs::FrankaState>("/" + this->arm_name + this->franka_state_topic_name, ros::Duration(2.0));
 
-    // Initializing the tau_ext norm and franka recovery publishers
+    // Initializing the franka recovery publisher and the telemetry of the tau_ext norm and of the franka state statistics
     this->pub_franka_recovery = this->nh.advertise<franka_control::ErrorRecoveryActionGoal>("/" + this->arm_name + "/franka_control/error_recovery/goal", 1);
-    this->pub_tau_ext_norm = this->nh.advertise<std_msgs::Float64>("tau_ext_norm", 1);
+    this->tau_ext_norm_channel = this->telemetry.addChannel(this->nh, "tau_ext_norm", TELEMETRY_FLOAT64,
+        "/full_grasper/telemetry/tau_ext_norm", 100.0);
+    this->monitor_stats_channel = this->telemetry.addChannel(this->nh, "franka_monitor_stats", TELEMETRY_ARRAY,
+        "/full_grasper/telemetry/franka_monitor_stats", 10.0);
+    this->telemetry.start();
     this->pub_x_d_reference = this->nh.advertise<std_msgs::Float64MultiArray>("/x_d_reference", 1);
     this->pub_f_d_d_reference = this->nh.advertise<std_msgs::Float64MultiArray>("/f_d_d_reference", 1);
 
+    // Configuring the pre-grasp cache and loading the saved entries
+    this->pregrasp_cache.configure(this->pregrasp_cache_position_quantum, this->pregrasp_cache_angle_quantum,
+        this->pregrasp_cache_start_tolerance, this->pregrasp_cache_max_entries, this->pregrasp_cache_file);
+    if(this->use_pregrasp_cache) this->pregrasp_cache.load();
+
     // Initializing Panda SoftHand Client (TODO: Return error if initialize returns false)
     this->panda_softhand_client.initialize(this->nh);
 
@@ -56,10 +71,14 @@ fullGrasper::fullGrasper(std::string arm_ns_, std::string hand_ns_, std::vector<
     this->num_contacts_sub = this->nh.subscribe("/num_touches_contact_state", 1, &fullGrasper::get_num_contacts, this);
     ros::topic::waitForMessage<std_msgs::Int8>("/num_touches_contact_state", ros::Duration(2.0));
 
-    // Initializing the num contacts subscriber and waiting (TODO: parse the topic name)
+    // Initializing the joint states subscriber and waiting (TODO: parse the topic name)
+    this->js_hub.setSynergyJoint("right_hand_synergy_joint");
     this->js_sub = this->nh.subscribe("/joint_states", 1, &fullGrasper::get_joints_compute_syn_joint, this);
     ros::topic::waitForMessage<sensor_msgs::JointState>("/joint_states", ros::Duration(2.0));
 
+    // Initializing the subscriber to the grasp signal of adaptive grasper (latched, no need to wait)
+    this->ag_signal_sub = this->nh.subscribe("adaptive_grasping_signal", 1, &fullGrasper::get_adaptive_grasping_signal, this);
+
     // Advertising the services (TODO: parse the service names)
     this->pregrasp_task_server = this->nh.advertiseService("pregrasp_task_service", &fullGrasper::call_pre_grasp_task, this);
     this->adaptive_task_server = this->nh.advertiseService("adaptive_task_service", &fullGrasper::call_adaptive_grasp_task, this);
@@ -75,6 +94,15 @@ fullGrasper::fullGrasper(std::string arm_ns_, std::string hand_ns_, std::vector<
     this->arm_switch_client.waitForExistence(ros::Duration(2.0));
     this->hand_switch_client = this->nh.serviceClient<controller_manager_msgs::SwitchController>(this->hand_name + this->switch_service_name);
     this->hand_switch_client.waitForExistence(ros::Duration(2.0));
+    this->arm_list_client = this->nh.serviceClient<controller_manager_msgs::ListControllers>(this->arm_name + this->list_service_name);
+    this->hand_list_client = this->nh.serviceClient<controller_manager_msgs::ListControllers>(this->hand_name + this->list_service_name);
+    this->arm_load_client = this->nh.serviceClient<controller_manager_msgs::LoadController>(this->arm_name + this->load_service_name);
+    this->hand_load_client = this->nh.serviceClient<controller_manager_msgs::LoadController>(this->hand_name + this->load_service_name);
+
+    // Starting the grasp cycle action server (the goals are executed in its own thread)
+    this->cycle_server.reset(new actionlib::SimpleActionServer<adaptive_grasping::GraspCycleAction>(this->nh, "grasp_cycle",
+        boost::bind(&fullGrasper::execute_grasp_cycle, this, _1), false));
+    this->cycle_server->start();
 }
 
 /* PARSETASKPARAMS */
@@ -155,6 +183,120 @@ bool fullGrasper::parse_task_params(){
 		success = false;
 	}
 
+    if(!ros::param::get("/full_grasper/sequencer_rate", this->sequencer_rate)){
+		ROS_WARN("The param 'sequencer_rate' not found in param server! Using default.");
+		this->sequencer_rate = 100.0;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/reference_rate", this->reference_rate)){
+		ROS_WARN("The param 'reference_rate' not found in param server! Using default.");
+		this->reference_rate = 50.0;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/close_synergy", this->close_synergy)){
+		ROS_WARN("The param 'close_synergy' not found in param server! Using default.");
+		this->close_synergy = 0.65;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/lift_duration", this->lift_duration)){
+		ROS_WARN("The param 'lift_duration' not found in param server! Using default.");
+		this->lift_duration = 6.0;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/approach_tolerance", this->approach_tolerance)){
+		ROS_WARN("The param 'approach_tolerance' not found in param server! Using default.");
+		this->approach_tolerance = 0.0005;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/approach_overshoot", this->approach_overshoot)){
+		ROS_WARN("The param 'approach_overshoot' not found in param server! Using default.");
+		this->approach_overshoot = 0.01;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/handover_timeout", this->handover_timeout)){
+		ROS_WARN("The param 'handover_timeout' not found in param server! Using default.");
+		this->handover_timeout = 10.0;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/monitor_window", this->monitor_window)){
+		ROS_WARN("The param 'monitor_window' not found in param server! Using default.");
+		this->monitor_window = 0.1;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/still_source", this->still_source)){
+		ROS_WARN("The param 'still_source' not found in param server! Using default.");
+		this->still_source = "dq";
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/still_threshold", this->still_threshold)){
+		ROS_WARN("The param 'still_threshold' not found in param server! Using default.");
+		this->still_threshold = 0.005;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/still_window", this->still_window)){
+		ROS_WARN("The param 'still_window' not found in param server! Using default.");
+		this->still_window = 0.1;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/still_timeout", this->still_timeout)){
+		ROS_WARN("The param 'still_timeout' not found in param server! Using default.");
+		this->still_timeout = 2.0;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/switch_timeout", this->switch_timeout)){
+		ROS_WARN("The param 'switch_timeout' not found in param server! Using default.");
+		this->switch_timeout = 3.0;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/use_pregrasp_cache", this->use_pregrasp_cache)){
+		ROS_WARN("The param 'use_pregrasp_cache' not found in param server! Using default.");
+		this->use_pregrasp_cache = true;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/pregrasp_cache_file", this->pregrasp_cache_file)){
+		ROS_WARN("The param 'pregrasp_cache_file' not found in param server! Using default.");
+		this->pregrasp_cache_file = "adaptive_grasping_pregrasp_cache.txt";
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/pregrasp_cache_position_quantum", this->pregrasp_cache_position_quantum)){
+		ROS_WARN("The param 'pregrasp_cache_position_quantum' not found in param server! Using default.");
+		this->pregrasp_cache_position_quantum = 0.005;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/pregrasp_cache_angle_quantum", this->pregrasp_cache_angle_quantum)){
+		ROS_WARN("The param 'pregrasp_cache_angle_quantum' not found in param server! Using default.");
+		this->pregrasp_cache_angle_quantum = 0.05;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/pregrasp_cache_start_tolerance", this->pregrasp_cache_start_tolerance)){
+		ROS_WARN("The param 'pregrasp_cache_start_tolerance' not found in param server! Using default.");
+		this->pregrasp_cache_start_tolerance = 0.01;
+		success = false;
+	}
+
+    if(!ros::param::get("/full_grasper/pregrasp_cache_max_entries", this->pregrasp_cache_max_entries)){
+		ROS_WARN("The param 'pregrasp_cache_max_entries' not found in param server! Using default.");
+		this->pregrasp_cache_max_entries = 100;
+		success = false;
+	}
+
     // Getting the XmlRpc value and parsing
     if(!ros::param::get("/full_grasper", this->task_seq_params)){
         ROS_ERROR("Could not get the XmlRpc value.");
@@ -267,35 +409,157 @@ geometry_msgs::Pose fullGrasper::convert_vector_to_pose(std::vector<double> inpu
 /* INITIALIZE */
 bool fullGrasper::initialize(std::vector<std::string> param_names){
     // Nothing to do here
+    return true;
 }
 
 /* SWITCHCONTROL */
 bool fullGrasper::switch_control(std::string robot_name, std::string from_controller, std::string to_controller){
-    // Temporary bool to be returned
-    bool success = false;
-
-    // Clearing the switch message
-    this->switch_controller.request.start_controllers.clear();
-    this->switch_controller.request.stop_controllers.clear();
+    // The switch message (local, the arm and the hand are switched in parallel)
+    controller_manager_msgs::SwitchController switch_controller;
 
     // Filling up the switch message
-    this->switch_controller.request.start_controllers.push_back(to_controller);
-    this->switch_controller.request.stop_controllers.push_back(from_controller);
-    this->switch_controller.request.strictness = controller_manager_msgs::SwitchController::Request::BEST_EFFORT;
+    switch_controller.request.start_controllers.push_back(to_controller);
+    switch_controller.request.stop_controllers.push_back(from_controller);
+    switch_controller.request.strictness = controller_manager_msgs::SwitchController::Request::BEST_EFFORT;
 
     // Swithching controller by calling the service
     if(robot_name == this->arm_name){
         this->arm_switch_client.waitForExistence(ros::Duration(5.0));
-        return this->arm_switch_client.call(this->switch_controller);
+        return this->arm_switch_client.call(switch_controller) && switch_controller.response.ok;
     } else if (robot_name == this->hand_name){
         this->hand_switch_client.waitForExistence(ros::Duration(5.0));
-        return this->hand_switch_client.call(this->switch_controller);
+        return this->hand_switch_client.call(switch_controller) && switch_controller.response.ok;
     }
 
     ROS_ERROR("fullGrasper : in switch_control unknown robot name!");
     return false;
 }
 
+/* WAITFORCONTROLLER */
+bool fullGrasper::wait_for_controller(std::string robot_name, std::string controller, double timeout){
+    // Getting the list controllers client of the robot
+    ros::ServiceClient* list_client = nullptr;
+    if(robot_name == this->arm_name) list_client = &this->arm_list_client;
+    else if(robot_name == this->hand_name) list_client = &this->hand_list_client;
+    if(list_client == nullptr){
+        ROS_ERROR("fullGrasper : in wait_for_controller unknown robot name!");
+        return false;
+    }
+
+    // Polling the state of the controller until it is running
+    ros::Time deadline = ros::Time::now() + ros::Duration(timeout);
+    controller_manager_msgs::ListControllers list_controllers;
+    while(ros::ok()){
+        if(list_client->call(list_controllers)){
+            for(auto& state : list_controllers.response.controller){
+                if(state.name == controller && state.state == "running") return true;
+            }
+        }
+        if(ros::Time::now() > deadline) break;
+        ros::Duration(0.01).sleep();
+    }
+    return false;
+}
+
+/* LOADCONTROLLER */
+bool fullGrasper::load_controller(std::string robot_name, std::string controller){
+    // Getting the list and load controller clients of the robot
+    ros::ServiceClient* list_client = nullptr;
+    ros::ServiceClient* load_client = nullptr;
+    if(robot_name == this->arm_name){
+        list_client = &this->arm_list_client;
+        load_client = &this->arm_load_client;
+    } else if(robot_name == this->hand_name){
+        list_client = &this->hand_list_client;
+        load_client = &this->hand_load_client;
+    }
+    if(list_client == nullptr){
+        ROS_ERROR("fullGrasper : in load_controller unknown robot name!");
+        return false;
+    }
+
+    // Nothing to do if controller manager already has the controller (stopped or running)
+    controller_manager_msgs::ListControllers list_controllers;
+    if(list_client->call(list_controllers)){
+        for(auto& state : list_controllers.response.controller){
+            if(state.name == controller) return true;
+        }
+    }
+
+    // Loading it (only loading, the switch starts it)
+    controller_manager_msgs::LoadController load_controller;
+    load_controller.request.name = controller;
+    if(!load_client->call(load_controller) || !load_controller.response.ok){
+        ROS_ERROR_STREAM("fullGrasper : Could not load the controller " << controller << " of " << robot_name << ".");
+        return false;
+    }
+    ROS_INFO_STREAM("fullGrasper : Loaded the controller " << controller << " of " << robot_name << ".");
+    return true;
+}
+
+/* WAITFORSTILLNESS */
+bool fullGrasper::wait_for_stillness(){
+    // Woken by every franka state while settling (the states must be recent, the motion is unknown otherwise)
+    std::unique_lock<std::mutex> lock(this->seq_mutex);
+    this->set_phase(PHASE_SETTLE);
+    bool still = this->seq_cv.wait_for(lock, std::chrono::duration<double>(this->still_timeout), [&]{
+        return !ros::ok() || (this->franka_monitor.getStillTime() >= this->still_window
+            && this->franka_monitor.getAge() < this->still_window);
+    });
+    if(!still) ROS_WARN_STREAM("fullGrasper : The arm is still moving (still for " << this->franka_monitor.getStillTime()
+        << " s, last state " << this->franka_monitor.getAge() << " s ago) after " << this->still_timeout << " s.");
+    this->set_phase(PHASE_IDLE);
+    return still;
+}
+
+/* SWITCHCONTROLLERS */
+bool fullGrasper::switch_controllers(std::string arm_from, std::string arm_to, std::string hand_from, std::string hand_to,
+    std::string& message){
+    // 1) Waiting for the arm to be still (switching anyway after the timeout)
+    ros::WallTime t_start = ros::WallTime::now();
+    bool still = this->wait_for_stillness();
+    ros::WallTime t_settled = ros::WallTime::now();
+
+    // 2) Switching the arm and the hand controllers in parallel
+    std::future<bool> arm_switch = std::async(std::launch::async, &fullGrasper::switch_control, this, this->arm_name, arm_from, arm_to);
+    std::future<bool> hand_switch = std::async(std::launch::async, &fullGrasper::switch_control, this, this->hand_name, hand_from, hand_to);
+    bool arm_ok = arm_switch.get();
+    bool hand_ok = hand_switch.get();
+    ros::WallTime t_switched = ros::WallTime::now();
+
+    // 3) Waiting for controller manager to report the new controllers running (also in parallel)
+    bool arm_running = false, hand_running = false;
+    if(arm_ok && hand_ok){
+        std::future<bool> arm_wait = std::async(std::launch::async, &fullGrasper::wait_for_controller, this, this->arm_name, arm_to, this->switch_timeout);
+        std::future<bool> hand_wait = std::async(std::launch::async, &fullGrasper::wait_for_controller, this, this->hand_name, hand_to, this->switch_timeout);
+        arm_running = arm_wait.get();
+        hand_running = hand_wait.get();
+    }
+    ros::WallTime t_confirmed = ros::WallTime::now();
+
+    // Reporting the time of each phase
+    std::ostringstream report;
+    report << "settle " << (t_settled - t_start).toSec() << " s" << (still ? "" : " (timeout)")
+        << ", switch " << (t_switched - t_settled).toSec() << " s, confirm " << (t_confirmed - t_switched).toSec()
+        << " s, total " << (t_confirmed - t_start).toSec() << " s";
+    message = report.str();
+    ROS_INFO_STREAM("fullGrasper : Switched to " << arm_to << " and " << hand_to << ": " << message << ".");
+
+    if(!arm_ok || !arm_running){
+        ROS_ERROR_STREAM("Could not switch to the arm controller " << arm_to << " from " << arm_from << ". Are these controllers loaded?");
+        return false;
+    }
+    if(!hand_ok || !hand_running){
+        ROS_ERROR_STREAM("Could not switch to the hand controller " << hand_to << " from " << hand_from << ". Are these controllers loaded?");
+        return false;
+    }
+    if(!this->franka_ok){
+        ROS_ERROR("The robot is not ok after switching the controllers.");
+        return false;
+    }
+    return true;
+}
+
 /* SPIN */
 void fullGrasper::spin(){
     // Nothing to do here
@@ -321,6 +585,7 @@ bool fullGrasper::call_set_object(adaptive_grasping::choose_object::Request &req
 
     // Setting the grasp pose as requested
     this->grasp_transform = this->poses_map.at(req.object_name);
+    this->object_name = req.object_name;
 
     // Converting the grasp_transform vector to geometry_msgs Pose
     this->grasp_T = this->convert_vector_to_pose(this->grasp_transform);
@@ -334,9 +599,6 @@ bool fullGrasper::call_set_object(adaptive_grasping::choose_object::Request &req
 /* GETFRANKASTATE */
 void fullGrasper::get_franka_state(const franka_msgs::FrankaState::ConstPtr &msg){
 
-    // Saving the message
-    this->latest_franka_state = *msg;
-
     // Checking for libfranka errors
     if(msg->robot_mode != 2 && msg->robot_mode != 5){       // The robot state is not "automatic" or "manual guiding"
         this->franka_ok = false;
@@ -346,60 +608,61 @@ void fullGrasper::get_franka_state(const franka_msgs::FrankaState::ConstPtr &msg
         if(DEBUG_FG && false) ROS_WARN("Now Franka is in a good mood!");
     }
 
-    // Getting the tau ext
-    if(DEBUG_FG && false){
-        std::cout << "The latest tau ext vector is \n [ ";
-        for(auto it : this->latest_franka_state.tau_ext_hat_filtered)  std::cout << it << " ";
-        std::cout << "]" << std::endl;
+    // Updating the monitor with the message (held, not copied) for the sequencer (waking it if settling, approaching
+    // or waiting for the handover) and taking the statistics to be published: tau_ext norm mean, std, peak and rate,
+    // EE speed mean and peak, joint speed mean and peak, still time
+    double norm, stats[9];
+    {
+        std::lock_guard<std::mutex> lock(this->seq_mutex);
+        this->franka_monitor.update(msg);
+        const windowedStatistics& tau = this->franka_monitor.getStatistics(frankaStateMonitor::TAU_EXT_NORM);
+        const windowedStatistics& ee_speed = this->franka_monitor.getStatistics(frankaStateMonitor::EE_SPEED);
+        const windowedStatistics& joint_speed = this->franka_monitor.getStatistics(frankaStateMonitor::JOINT_SPEED);
+        norm = tau.latest();
+        stats[0] = tau.mean(); stats[1] = std::sqrt(tau.variance()); stats[2] = tau.peak(); stats[3] = tau.rateOfChange();
+        stats[4] = ee_speed.mean(); stats[5] = ee_speed.peak();
+        stats[6] = joint_speed.mean(); stats[7] = joint_speed.peak();
+        stats[8] = this->franka_monitor.getStillTime();
+        if(this->seq_phase == PHASE_SETTLE) this->notify_sequencer();
+        else this->notify_sequencer(PHASE_APPROACH, PHASE_HANDOVER);
     }
 
-    // Computing the norm
-    this->tau_ext_norm = 0.0;
-    for(auto it : this->latest_franka_state.tau_ext_hat_filtered){
-        this->tau_ext_norm += std::pow(it, 2);
-    }
-    this->tau_ext_norm = std::sqrt(this->tau_ext_norm);
-
-    // Publishing norm
-    std_msgs::Float64 norm_msg; norm_msg.data = this->tau_ext_norm;
-    this->pub_tau_ext_norm.publish(norm_msg);
-
-    // Saving the present panda_EE position
-    std::vector<double> O_T_EE_vec (this->latest_franka_state.O_T_EE.begin(), this->latest_franka_state.O_T_EE.end());
-    this->T_EE = Eigen::Map<Eigen::Matrix<double, 4, 4>>(O_T_EE_vec.data());
-    std::vector<double>::const_iterator first = O_T_EE_vec.begin() + 12;
-    std::vector<double>::const_iterator last = O_T_EE_vec.begin() + 15;
-    std::vector<double> tmp_position(first, last);
-    this->ee_position_now = Eigen::Vector3d::Map(tmp_position.data(), tmp_position.size());
-    this->local_z_axis_now = this->T_EE.block<3,1>(0,2);
-
-    // std::cout << "O_T_EE_vec is" << std::endl;
-    // for (auto i = O_T_EE_vec.begin(); i != O_T_EE_vec.end(); ++i){
-    //     std::cout << *i << ' ';
-    // }
-
-    // std::cout << "tmp_position is" << std::endl;
-    // for (auto i = tmp_position.begin(); i != tmp_position.end(); ++i){
-    //     std::cout << *i << ' ';
-    // }
-    
-    // ROS_INFO_STREAM("The present position is " << this->ee_position_now);
-
-    // ROS_INFO_STREAM("The local_z_axis_now is " << this->local_z_axis_now);
-    
+    // Sampling the norm and the statistics (published by the telemetry thread at their rates)
+    this->telemetry.sample(this->tau_ext_norm_channel, norm);
+    this->telemetry.sample(this->monitor_stats_channel, stats, 9);
 }
 
 /* GETNUMCONTACTS */
 void fullGrasper::get_num_contacts(const std_msgs::Int8::ConstPtr &msg){
+    std::lock_guard<std::mutex> lock(this->seq_mutex);
     this->num_cont_msg = *msg;
+    this->notify_sequencer(PHASE_PIVOT, PHASE_RESTRAIN);
+}
+
+/* GETADAPTIVEGRASPINGSIGNAL */
+void fullGrasper::get_adaptive_grasping_signal(const adaptive_grasping::GraspSignal::ConstPtr &msg){
+    // Any reason other than running means that adaptive grasping ended
+    this->adaptive_grasping_reason = msg->reason;
+    this->adaptive_grasping_signal = (msg->reason != adaptive_grasping::GraspSignal::RUNNING);
+    if(this->adaptive_grasping_signal) ROS_INFO_STREAM("fullGrasper : Adaptive grasping ended with reason " << int(msg->reason) << ".");
+
+    std::lock_guard<std::mutex> lock(this->seq_mutex);
+    this->notify_sequencer();
 }
 
 /* GETJOINTSANDCOMPUTESYNJOINT */
 void fullGrasper::get_joints_compute_syn_joint(const sensor_msgs::JointState::ConstPtr &msg){
-    
-    this->js_msg = *msg;
-    int index = std::find (this->js_msg.name.begin(),this->js_msg.name.end(), "right_hand_synergy_joint") - this->js_msg.name.begin();
-    this->present_synergy = this->js_msg.position[index];
+    // Reading the synergy joint through the hub (no copy nor search of the message)
+    double synergy;
+    if(!this->js_hub.update(msg) || !this->js_hub.getSynergy(synergy)){
+        ROS_WARN_THROTTLE(1.0, "fullGrasper::get_joints_compute_syn_joint : No synergy joint in the joint states!");
+        return;
+    }
+
+    // Saving it for the sequencer (waking it if finishing the closure)
+    std::lock_guard<std::mutex> lock(this->seq_mutex);
+    this->present_synergy = synergy;
+    this->notify_sequencer(PHASE_CLOSE);
 
 }
 
@@ -431,17 +694,46 @@ bool fullGrasper::call_pre_grasp_task(std_srvs::SetBool::Request &req, std_srvs:
     tf::poseEigenToMsg(object_pose_aff * grasp_transform_aff * pre_grasp_transform_aff, pre_grasp_pose);
     tf::poseEigenToMsg(object_pose_aff * grasp_transform_aff, grasp_pose);
 
-    // 2) Going to pregrasp pose
-    if(!this->panda_softhand_client.call_pose_service(pre_grasp_pose, false) || !this->franka_ok){
-        ROS_ERROR("Could not go to the specified pre grasp pose.");
-        res.success = false;
-        res.message = "The service call_adaptive_grasp_task was NOT performed correctly!";
-        return false;
+    // 2) Going to pregrasp pose: to the cached joints of this object and pose if still valid from the present joints
+    // (a joint goal, no planning to the pose), planning to the pose and caching the reached joints otherwise
+    std::vector<double> start_joints;
+    {
+        std::lock_guard<std::mutex> lock(this->seq_mutex);
+        if(this->franka_monitor.isValid()) start_joints.assign(this->franka_monitor.getJoints().data(), this->franka_monitor.getJoints().data() + 7);
+    }
+    Eigen::Affine3d pre_grasp_aff = object_pose_aff * grasp_transform_aff * pre_grasp_transform_aff;
+    std::string cache_key = this->pregrasp_cache.makeKey(this->object_name, object_pose_aff);
+    std::vector<double> cached_joints;
+    bool reached = false;
+    if(this->use_pregrasp_cache && this->pregrasp_cache.lookup(cache_key, start_joints, pre_grasp_aff, cached_joints)){
+        reached = this->panda_softhand_client.call_joint_service(cached_joints) && this->franka_ok;
+        if(!reached){
+            ROS_WARN_STREAM("Could not go to the cached pre grasp joints of " << cache_key << ". Planning to the pose.");
+            this->pregrasp_cache.invalidate(cache_key);
+        }
+    }
+    if(!reached){
+        if(!this->panda_softhand_client.call_pose_service(pre_grasp_pose, false) || !this->franka_ok){
+            ROS_ERROR("Could not go to the specified pre grasp pose.");
+            res.success = false;
+            res.message = "The service call_adaptive_grasp_task was NOT performed correctly!";
+            return false;
+        }
+        if(this->use_pregrasp_cache){
+            std::vector<double> reached_joints;
+            {
+                std::lock_guard<std::mutex> lock(this->seq_mutex);
+                if(this->franka_monitor.isValid()) reached_joints.assign(this->franka_monitor.getJoints().data(), this->franka_monitor.getJoints().data() + 7);
+            }
+            this->pregrasp_cache.store(cache_key, start_joints, pre_grasp_aff, reached_joints);
+        }
     }
+    if(this->use_pregrasp_cache) ROS_INFO_STREAM("fullGrasper : Pre grasp cache " << this->pregrasp_cache.getReport() << ".");
 
     // Now, everything finished well
     res.success = true;
     res.message = "The service call_adaptive_grasp_task was correctly performed!";
+    if(this->use_pregrasp_cache) res.message += " (pre grasp cache " + this->pregrasp_cache.getReport() + ")";
     return true;
 }
 
@@ -457,6 +749,17 @@ bool fullGrasper::call_adaptive_grasp_task(std_srvs::SetBool::Request &req, std_
         return true;
     }
 
+    // The approach is checked on the EE pose of the franka states
+    {
+        std::lock_guard<std::mutex> lock(this->seq_mutex);
+        if(!this->franka_monitor.isValid()){
+            ROS_ERROR("No franka state received. Cannot perform the adaptive grasp task.");
+            res.success = false;
+            res.message = "The service call_adaptive_grasp_task was NOT performed correctly!";
+            return false;
+        }
+    }
+
     // Computing the grasp and pregrasp pose and converting to geometry_msgs Pose
     Eigen::Affine3d object_pose_aff; tf::poseMsgToEigen(this->object_pose_T, object_pose_aff);
     Eigen::Affine3d grasp_transform_aff; tf::poseMsgToEigen(this->grasp_T, grasp_transform_aff);
@@ -469,8 +772,7 @@ bool fullGrasper::call_adaptive_grasp_task(std_srvs::SetBool::Request &req, std_
     // Calling the adaptive grasp service, changing references and waiting for its completion
     this->adaptive_grasping_signal = false;                                  // Setting end trigger to false
 
-    adaptive_grasping::adaptiveGrasp ag_srv; ag_srv.request.run_adaptive_grasp = true;
-    if(!ros::service::call<adaptive_grasping::adaptiveGrasp>("adaptive_grasper_service", ag_srv)){
+    if(!this->call_adaptive_grasper(true)){
         ROS_ERROR("Could not call the adaptive_grasper_service.");
         res.success = false;
         res.message = "The service call_adaptive_grasp_task was NOT performed correctly!";
@@ -481,94 +783,167 @@ bool fullGrasper::call_adaptive_grasp_task(std_srvs::SetBool::Request &req, std_
 
     ROS_INFO("Called the adaptive_grasper_service!");
 
-    // 1) Sending the reference for going down till pregrasp pose reached
+    // Building the approach reference for going down till pregrasp pose reached
     // Attention: We need to go down along the EE z axis (not the global axis)
     double velocity = this->approach_ref_map.at("vel_p_d")[0];
-    Eigen::Vector3d approach_vec = velocity * this->local_z_axis_now;
+    Eigen::Vector3d approach_vec;
+    {
+        std::lock_guard<std::mutex> lock(this->seq_mutex);
+        approach_vec = velocity * this->franka_monitor.getZAxis();
+    }
     std::vector<double> approach_vel(approach_vec.data(), approach_vec.data() + approach_vec.rows() * approach_vec.cols());
     std::vector<double> approach_x_d = this->approach_ref_map.at("sigma_d");
     approach_x_d.insert(approach_x_d.end(), approach_vel.begin(), approach_vel.end());
     std::vector<double> zeros_vec(3, 0.0);
     approach_x_d.insert(approach_x_d.end(), zeros_vec.begin(), zeros_vec.end());
-    bool pose_reached = false;
-    while(!pose_reached && !this->adaptive_grasping_signal){
-        // Checking if the present position of panda_EE is near grasp position
-        if ((this->ee_position_now - grasp_pose.translation()).norm() < 0.0005 || this->ee_position_now(2) - grasp_pose.translation()(2) < -0.01) {
-            // ROS_INFO_STREAM("GOT INTO IF!! GETTING OUT");
-            pose_reached = true;
-            this->x_d_msg.data.clear();
-            this->x_d_msg.data = this->null_x_d;
-            this->f_d_d_msg.data.clear();
-            this->f_d_d_msg.data = this->null_f_d_d;
-            this->pub_x_d_reference.publish(this->x_d_msg);
-            this->pub_f_d_d_reference.publish(this->f_d_d_msg);
-        } else {
-            ROS_INFO_STREAM("I'm in else with norm " << (this->ee_position_now - grasp_pose.translation()).norm());
-            ROS_INFO_STREAM("And difference between zs is " << this->ee_position_now(2) - grasp_pose.translation()(2));
-            this->x_d_msg.data = approach_x_d;
-            this->f_d_d_msg.data = this->approach_ref_map.at("f_d_d");
-            this->pub_x_d_reference.publish(this->x_d_msg);
-            this->pub_f_d_d_reference.publish(this->f_d_d_msg);
-        }
+
+    // Running the sequence: approach, pivot / restrain, finish closing and lift
+    if(!this->run_grasp_sequence(grasp_pose, approach_x_d)){
+        ROS_ERROR("The adaptive grasp sequence did not complete.");
+        res.success = false;
+        res.message = "The service call_adaptive_grasp_task was NOT performed correctly!";
+        return false;
     }
 
-    // 2) Sending the references for adaptive grasping until the signal of stopping condition by adaptive grasper
-    while(!this->adaptive_grasping_signal) {
+    // Now, everything finished well
+    res.success = true;
+    res.message = "The service call_adaptive_grasp_task was correctly performed!";
+    return true;
+}
+
+/* RUNGRASPSEQUENCE */
+bool fullGrasper::run_grasp_sequence(const Eigen::Affine3d& grasp_pose, const std::vector<double>& approach_x_d){
+    // The references held by the finish closing and the lift phases and the start of the lift
+    std::vector<double> hold_x_d;
+    std::vector<double> hold_f_d_d;
+    ros::Time lift_start;
+    bool restrain_requested = false;
+
+    this->last_ref_publish = ros::Time(0);
+    this->set_phase(PHASE_APPROACH);
+    std::chrono::duration<double> tick(1.0 / this->sequencer_rate);
+
+    std::unique_lock<std::mutex> lock(this->seq_mutex);
+    while(ros::ok()){
+        // Reading the inputs written by the callbacks
+        Eigen::Vector3d ee_position = this->franka_monitor.getPosition();
         int n_cont = this->num_cont_msg.data;
-        if (n_cont < 2) {   // Pivoting
-            this->x_d_msg.data = this->adaptive_ref_map.at("x_d");
-            this->f_d_d_msg.data = this->approach_ref_map.at("f_d_d");
-        } else {            // Restraining
-
-            ag_srv.request.run_adaptive_grasp = false;
-            if(!ros::service::call<adaptive_grasping::adaptiveGrasp>("adaptive_grasper_service", ag_srv)){
-                ROS_ERROR("Could not call the adaptive_grasper_service.");
-                res.success = false;
-                res.message = "The service call_adaptive_grasp_task was NOT performed correctly!";
-                return false;
+        double synergy = this->present_synergy;
+        unsigned long seen_events = this->seq_events;
+        lock.unlock();
+
+        // Checking the transitions of the present phase and publishing its references
+        int phase = this->seq_phase;
+        bool signal = this->adaptive_grasping_signal;
+        switch(phase){
+            case PHASE_APPROACH: {
+                // 1) Going down till the grasp pose is reached (or adaptive grasping ended)
+                double distance = (ee_position - grasp_pose.translation()).norm();
+                if(signal){
+                    this->set_phase(PHASE_CLOSE);
+                } else if(distance < this->approach_tolerance || ee_position(2) - grasp_pose.translation()(2) < -this->approach_overshoot){
+                    this->publish_references(this->null_x_d, this->null_f_d_d, true);
+                    this->set_phase(PHASE_PIVOT);
+                } else {
+                    if(DEBUG_FG) ROS_INFO_STREAM_THROTTLE(0.5, "Approaching with norm " << distance << " and difference between zs "
+                        << ee_position(2) - grasp_pose.translation()(2) << ".");
+                    this->publish_references(approach_x_d, this->approach_ref_map.at("f_d_d"));
+                }
+                break;
             }
-
-            this->x_d_msg.data = this->restrain_ref_map.at("x_d");
-            this->f_d_d_msg.data = this->restrain_ref_map.at("f_d_d");
+            case PHASE_PIVOT:
+            case PHASE_RESTRAIN:
+                // 2) Pivoting with less than two contacts, restraining otherwise, until the signal of adaptive grasper
+                if(signal){
+                    this->set_phase(PHASE_CLOSE);
+                } else if(n_cont < 2){
+                    if(phase != PHASE_PIVOT) this->set_phase(PHASE_PIVOT);
+                    this->publish_references(this->adaptive_ref_map.at("x_d"), this->approach_ref_map.at("f_d_d"));
+                } else {
+                    // Stopping the inversion of adaptive grasper once
+                    if(!restrain_requested){
+                        if(!this->call_adaptive_grasper(false)){
+                            ROS_ERROR("Could not call the adaptive_grasper_service.");
+                            this->set_phase(PHASE_FAILED);
+                            break;
+                        }
+                        restrain_requested = true;
+                    }
+                    if(phase != PHASE_RESTRAIN) this->set_phase(PHASE_RESTRAIN);
+                    this->publish_references(this->restrain_ref_map.at("x_d"), this->restrain_ref_map.at("f_d_d"));
+                }
+                break;
+            case PHASE_CLOSE:
+                // 3) Stop the palm and finish closing with the last reference (here there is no more task inversion
+                // in adaptive grasper; CHECK: if adaptive reference has palm movement this is not valid!!!)
+                if(hold_x_d.empty()){
+                    ROS_INFO("Someone triggered the adaptive grasp end!");
+                    hold_x_d = this->x_d_msg.data.empty() ? this->null_x_d : this->x_d_msg.data;
+                    hold_f_d_d = this->f_d_d_msg.data.empty() ? this->null_f_d_d : this->f_d_d_msg.data;
+                }
+                if(synergy >= this->close_synergy){
+                    lift_start = ros::Time::now();
+                    this->set_phase(PHASE_LIFT);
+                } else {
+                    this->publish_references(hold_x_d, hold_f_d_d);
+                }
+                break;
+            case PHASE_LIFT:
+                // 4) Lift the object for the lift duration, then 5) stop the lift by sending null reference
+                if((ros::Time::now() - lift_start).toSec() >= this->lift_duration){
+                    this->publish_references(this->null_x_d, hold_f_d_d, true);
+                    this->set_phase(PHASE_DONE);
+                } else {
+                    this->publish_references(this->lift_ref_map.at("x_d"), hold_f_d_d);
+                }
+                break;
         }
-        
-        this->pub_x_d_reference.publish(this->x_d_msg);
-        this->pub_f_d_d_reference.publish(this->f_d_d_msg);
-    }
 
-    ROS_INFO("Someone triggered the adaptive grasp end!");
+        // Ending the sequence or checking the new phase at once
+        int new_phase = this->seq_phase;
+        if(new_phase == PHASE_DONE || new_phase == PHASE_FAILED) break;
+        lock.lock();
+        if(new_phase != phase) continue;
 
-    // 3) Stop the palm and finish closing (here there is no more task inversion in adaptive grasper)
-    while (this->present_synergy < 0.65) { // Close until threshold (TODO: Parse this!)
+        // Waiting for an event of interest of the callbacks or for the next tick
+        this->seq_cv.wait_for(lock, tick, [&]{ return this->seq_events != seen_events; });
+    }
 
-        // No need to set anything as long as x_d of adaptive ref has non palm moving reference
-        // Send the same x_d reference as adaptive (CHECK: if adaptive reference has palm movement this is not valid!!!)
-        this->pub_x_d_reference.publish(this->x_d_msg);
-        // ROS_INFO_STREAM("The reference being sent to hand and palm is " << this->x_d_msg << " because syn is " << this->present_synergy);
+    bool success = this->seq_phase == PHASE_DONE;
+    this->seq_phase = PHASE_IDLE;
+    return success;
+}
 
+/* SETPHASE */
+void fullGrasper::set_phase(graspPhase phase){
+    if(DEBUG_FG || phase == PHASE_FAILED){
+        ROS_INFO_STREAM("fullGrasper : Grasp sequence phase " << PHASE_NAMES[this->seq_phase] << " -> " << PHASE_NAMES[phase] << ".");
     }
+    this->seq_phase = phase;
+}
 
-    // 4) Lift the object for a specified number of time (here there is no more task inversion in adaptive grasper)
-    this->x_d_msg.data = this->lift_ref_map.at("x_d");      // Change reference to lift
-    double time_before = ros::Time::now().toSec();
-    double duration_close = 0.0;
-    while (duration_close < 6.0) { // Lift for 6 seconds
-        // Check duration
-        duration_close = ros::Time::now().toSec() - time_before;
+/* NOTIFYSEQUENCER */
+void fullGrasper::notify_sequencer(int phase_a, int phase_b){
+    // Only the events of interest of the present phase wake the sequencer
+    int phase = this->seq_phase;
+    if(phase_a >= 0 && phase != phase_a && phase != phase_b) return;
+    this->seq_events++;
+    this->seq_cv.notify_one();
+}
 
-        // Send the same x_d reference as adaptive (CHECK: if adaptive reference has palm movement this is not valid!!!)
-        this->pub_x_d_reference.publish(this->x_d_msg);
-    }
+/* PUBLISHREFERENCES */
+void fullGrasper::publish_references(const std::vector<double>& x_d, const std::vector<double>& f_d_d, bool force){
+    // Publishing only changed references or at the reference rate
+    ros::Time now = ros::Time::now();
+    bool changed = x_d != this->x_d_msg.data || f_d_d != this->f_d_d_msg.data;
+    bool due = this->reference_rate > 0.0 && (now - this->last_ref_publish).toSec() >= 1.0 / this->reference_rate;
+    if(!force && !changed && !due) return;
 
-    // 5) Stop the lift by sending null reference
-    this->x_d_msg.data.clear();
-    this->x_d_msg.data = this->null_x_d;
+    this->x_d_msg.data = x_d;
+    this->f_d_d_msg.data = f_d_d;
     this->pub_x_d_reference.publish(this->x_d_msg);
-
-    // Now, everything finished well
-    res.success = true;
-    res.message = "The service call_adaptive_grasp_task was correctly performed!";
-    return true;
+    this->pub_f_d_d_reference.publish(this->f_d_d_msg);
+    this->last_ref_publish = now;
 }
 
 /* CALLPOSTGRASPTASK */
@@ -590,26 +965,21 @@ bool fullGrasper::call_post_grasp_task(std_srvs::SetBool::Request &req, std_srvs
         return false;
     }
 
-    // 7) Waiting for threshold or for some time
+    // 7) Waiting for threshold or for some time (woken by every franka state while waiting)
     sleep(1);       // Sleeping for a second to avoid robot stopping peaks
-    bool hand_open = false; ros::Time init_time = ros::Time::now(); ros::Time now_time;
-    double base_tau_ext = this->tau_ext_norm;           // Saving the present tau for later computation of variation
-    while(!hand_open){
-        now_time = ros::Time::now();
-        usleep(500);                         // Don't know why, but the threshold works with this sleeping
-        if(DEBUG_FG) ROS_WARN_STREAM("The tau_ext difference is " << std::abs(this->tau_ext_norm - base_tau_ext) << " and the threshold is " << this->handover_thresh << ".");
-
-        if(std::abs(this->tau_ext_norm - base_tau_ext) > this->handover_thresh){
-            hand_open = true;
-            if(DEBUG_FG) ROS_WARN_STREAM("Opening condition reached!" << " SOMEONE PULLED!");
-            if(DEBUG_FG) ROS_WARN_STREAM("The tau_ext difference is " << std::abs(this->tau_ext_norm - base_tau_ext) << " and the threshold is " << this->handover_thresh << ".");
-        }
-        if((now_time - init_time) > ros::Duration(10, 0)){
-            hand_open = true;
-            if(DEBUG_FG) ROS_WARN_STREAM("Opening condition reached!" << " TIMEOUT!");
-            if(DEBUG_FG) ROS_WARN_STREAM("The initial time was " << init_time << ", now it is " << now_time
-                                                                 << ", the difference is " << (now_time - init_time) << " and the timeout thresh is " << ros::Duration(10, 0));
-        }
+    {
+        std::unique_lock<std::mutex> lock(this->seq_mutex);
+        // The pull is checked on the windowed mean of the tau_ext norm (a single noisy sample does not open the hand)
+        const windowedStatistics& tau = this->franka_monitor.getStatistics(frankaStateMonitor::TAU_EXT_NORM);
+        double base_tau_ext = tau.mean();                   // Saving the present tau for later computation of variation
+        this->set_phase(PHASE_HANDOVER);
+        bool pulled = this->seq_cv.wait_for(lock, std::chrono::duration<double>(this->handover_timeout), [&]{
+            return std::abs(tau.mean() - base_tau_ext) > this->handover_thresh || !ros::ok();
+        });
+        if(DEBUG_FG) ROS_WARN_STREAM("Opening condition reached! " << (pulled ? "SOMEONE PULLED!" : "TIMEOUT!") << " The tau_ext difference is "
+            << std::abs(tau.mean() - base_tau_ext) << " (peak " << tau.peak() << ", rate " << tau.rateOfChange()
+            << ") and the threshold is " << this->handover_thresh << ".");
+        this->set_phase(PHASE_IDLE);
     }
 
     // 8) Opening hand
@@ -625,6 +995,7 @@ bool fullGrasper::call_post_grasp_task(std_srvs::SetBool::Request &req, std_srvs
     res.message = "The service call_adaptive_grasp_task was correctly performed!";
 
     // Resetting the number of touches
+    std::lock_guard<std::mutex> lock(this->seq_mutex);
     this->num_cont_msg.data = 0;
     
     return true;
@@ -632,35 +1003,31 @@ bool fullGrasper::call_post_grasp_task(std_srvs::SetBool::Request &req, std_srvs
 
 /* CALLENDADAPTIVEGRASP */
 bool fullGrasper::call_signal_adaptive_grasp(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res){
-    // Setting the trigger bool
+    // Setting the trigger bool and waking the sequencer
     this->adaptive_grasping_signal = true;
+    {
+        std::lock_guard<std::mutex> lock(this->seq_mutex);
+        this->notify_sequencer();
+    }
+    res.success = true;
+    return true;
 }
 
 /* CALLSWITCHPOS2VEL */
 bool fullGrasper::call_switch_pos2vel(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res){
 
-    sleep(2);       // TODO: listen to robot and make sure it's not moving
-
-    // Switching to velocity controllers from position controllers
-    if(!this->switch_control(this->arm_name, this->arm_pos_controller, this->arm_vel_controller) || !this->franka_ok){
-        ROS_ERROR_STREAM("Could not switch to the arm velocity controller "
-                                 << this->arm_vel_controller << " from " << this->arm_pos_controller << ". Are these controllers loaded?");
+    // Switching to velocity controllers from position controllers (once the arm is still)
+    std::string report;
+    if(!this->switch_controllers(this->arm_pos_controller, this->arm_vel_controller, this->hand_pos_controller,
+        this->hand_vel_controller, report)){
         res.success = false;
-        res.message = "The service call_switch_pos2vel was NOT performed correctly!";
-        return false;
-    }
-    sleep(1);     // Giving some time to controller manager
-    if(!this->switch_control(this->hand_name, this->hand_pos_controller, this->hand_vel_controller) || !this->franka_ok){
-        ROS_ERROR_STREAM("Could not switch to the hand velocity controller "
-                                 << this->hand_vel_controller << " from " << this->hand_pos_controller << ". Are these controllers loaded?");
-        res.success = false;
-        res.message = "The service call_switch_pos2vel was NOT performed correctly!";
+        res.message = "The service call_switch_pos2vel was NOT performed correctly! (" + report + ")";
         return false;
     }
 
     // Now, everything finished well
     res.success = true;
-    res.message = "The service call_switch_pos2vel was correctly performed!";
+    res.message = "The service call_switch_pos2vel was correctly performed! (" + report + ")";
     return true;
 
 }
@@ -668,30 +1035,150 @@ bool fullGrasper::call_switch_pos2vel(std_srvs::SetBool::Request &req, std_srvs:
 /* CALLSWITCHVEL2POS */
 bool fullGrasper::call_switch_vel2pos(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res){
 
-    sleep(2);       // TODO: listen to robot and make sure it's not moving
-
-    // Switching to position controllers from velocity controllers
-    if(!this->switch_control(this->arm_name, this->arm_vel_controller, this->arm_pos_controller) || !this->franka_ok){
-        ROS_ERROR_STREAM("Could not switch to the arm position controller "
-                                 << this->arm_pos_controller << " from " << this->arm_vel_controller << ". Are these controllers loaded?");
-        res.success = false;
-        res.message = "The service call_switch_vel2pos was NOT performed correctly!";
-        return false;
-    }
-
-    sleep(1);     // Giving some time to controller manager
-
-    if(!this->switch_control(this->hand_name, this->hand_vel_controller, this->hand_pos_controller) || !this->franka_ok){
-        ROS_ERROR_STREAM("Could not switch to the hand position controller "
-                                 << this->hand_pos_controller << " from " << this->hand_vel_controller << ". Are these controllers loaded?");
+    // Switching to position controllers from velocity controllers (once the arm is still)
+    std::string report;
+    if(!this->switch_controllers(this->arm_vel_controller, this->arm_pos_controller, this->hand_vel_controller,
+        this->hand_pos_controller, report)){
         res.success = false;
-        res.message = "The service call_switch_vel2pos was NOT performed correctly!";
+        res.message = "The service call_switch_vel2pos was NOT performed correctly! (" + report + ")";
         return false;
     }
 
     // Now, everything finished well
     res.success = true;
-    res.message = "The service call_switch_vel2pos was correctly performed!";
+    res.message = "The service call_switch_vel2pos was correctly performed! (" + report + ")";
     return true;
 
-}
\ No newline at end of file
+}
+
+/* EXECUTEGRASPCYCLE */
+void fullGrasper::execute_grasp_cycle(const adaptive_grasping::GraspCycleGoalConstPtr &goal){
+    adaptive_grasping::GraspCycleResult result;
+    result.completed = 0;
+    result.phase_names = {"pregrasp", "switch_pos2vel", "adaptive", "switch_vel2pos", "postgrasp"};
+
+    // Checking all the objects before moving (no goal is stopped halfway for a misspelled name)
+    for(auto& object : goal->objects){
+        if(this->poses_map.find(object) == this->poses_map.end()){
+            ROS_ERROR_STREAM("fullGrasper : The object " << object << " of the grasp cycle is not present in the poses map.");
+            this->cycle_server->setAborted(result, "The object " + object + " is not present in the poses map.");
+            return;
+        }
+    }
+    int cycles = goal->objects.empty() ? 1 : int(goal->objects.size());
+    adaptive_grasping::choose_object choose;
+    if(!goal->objects.empty()){
+        choose.request.object_name = goal->objects[0];
+        this->call_set_object(choose.request, choose.response);
+    }
+
+    this->cycle_start = ros::WallTime::now();
+    bool success = true;
+    bool preempted = false;
+    for(int cycle = 0; cycle < cycles && success && ros::ok(); cycle++){
+        // A preemption is only accepted between cycles (stopping halfway would leave the object in the hand)
+        if(this->cycle_server->isPreemptRequested()){
+            preempted = true;
+            break;
+        }
+        std::string object = goal->objects.empty() ? "" : goal->objects[cycle];
+
+        // 1) Pregrasp, while the velocity controllers are loaded and adaptive grasper is connected
+        std::future<bool> prepared = std::async(std::launch::async, &fullGrasper::prepare_velocity_control, this);
+        success = this->run_cycle_phase("pregrasp", &fullGrasper::call_pre_grasp_task, cycle, object, result);
+        if(!prepared.get()) ROS_WARN("fullGrasper : Could not prepare the velocity control during the pregrasp.");
+
+        // 2-4) Switching to velocity, adaptive grasping and switching back to position
+        success = success && this->run_cycle_phase("switch_pos2vel", &fullGrasper::call_switch_pos2vel, cycle, object, result);
+        success = success && this->run_cycle_phase("adaptive", &fullGrasper::call_adaptive_grasp_task, cycle, object, result);
+        success = success && this->run_cycle_phase("switch_vel2pos", &fullGrasper::call_switch_vel2pos, cycle, object, result);
+
+        // 5) Postgrasp, with the next object already selected (its grasp transform is only used by the next pregrasp)
+        if(success && cycle + 1 < cycles){
+            choose.request.object_name = goal->objects[cycle + 1];
+            this->call_set_object(choose.request, choose.response);
+        }
+        success = success && this->run_cycle_phase("postgrasp", &fullGrasper::call_post_grasp_task, cycle, object, result);
+        if(success) result.completed++;
+    }
+
+    // The throughput and the mean latency of each phase over the cycles
+    result.total_time = (ros::WallTime::now() - this->cycle_start).toSec();
+    result.picks_per_hour = result.total_time > 0.0 ? 3600.0 * result.completed / result.total_time : 0.0;
+    std::ostringstream report;
+    report << result.completed << " / " << cycles << " cycles in " << result.total_time << " s (" << result.picks_per_hour << " picks per hour), mean latency";
+    for(size_t i = 0; i < result.phase_names.size(); i++){
+        double sum = 0.0; int count = 0;
+        for(size_t j = i; j < result.phase_latencies.size(); j += result.phase_names.size()){
+            sum += result.phase_latencies[j]; count++;
+        }
+        report << " " << result.phase_names[i] << " " << (count > 0 ? sum / count : 0.0) << " s";
+    }
+    ROS_INFO_STREAM("fullGrasper : Grasp cycle ended: " << report.str() << ".");
+
+    if(preempted){
+        this->cycle_server->setPreempted(result, report.str());
+    } else if(!success || !ros::ok()){
+        this->cycle_server->setAborted(result, report.str());
+    } else {
+        this->cycle_server->setSucceeded(result, report.str());
+    }
+}
+
+/* RUNCYCLEPHASE */
+bool fullGrasper::run_cycle_phase(std::string phase, taskCallback callback, int cycle, std::string object,
+    adaptive_grasping::GraspCycleResult& result){
+    // Running the task as its service would
+    std_srvs::SetBool::Request req; req.data = true;
+    std_srvs::SetBool::Response res;
+    ros::WallTime t_start = ros::WallTime::now();
+    bool success = (this->*callback)(req, res) && res.success;
+    double latency = (ros::WallTime::now() - t_start).toSec();
+
+    // Saving the latency and sending the feedback
+    result.phase_latencies.push_back(latency);
+    adaptive_grasping::GraspCycleFeedback feedback;
+    feedback.cycle = cycle;
+    feedback.object = object;
+    feedback.phase = phase;
+    feedback.success = success;
+    feedback.phase_latency = latency;
+    feedback.elapsed = (ros::WallTime::now() - this->cycle_start).toSec();
+    this->cycle_server->publishFeedback(feedback);
+
+    if(DEBUG_FG || !success) ROS_INFO_STREAM("fullGrasper : Cycle " << cycle << " phase " << phase << (success ? " done" : " FAILED")
+        << " in " << latency << " s: " << res.message);
+    return success;
+}
+
+/* PREPAREVELOCITYCONTROL */
+bool fullGrasper::prepare_velocity_control(){
+    // Loading the velocity controllers (if needed) and connecting to adaptive grasper
+    bool arm_loaded = this->load_controller(this->arm_name, this->arm_vel_controller);
+    bool hand_loaded = this->load_controller(this->hand_name, this->hand_vel_controller);
+    bool connected = this->connect_adaptive_grasper();
+    if(!connected) ROS_WARN("fullGrasper : Could not connect to the adaptive_grasper_service.");
+    return arm_loaded && hand_loaded && connected;
+}
+
+/* CONNECTADAPTIVEGRASPER */
+bool fullGrasper::connect_adaptive_grasper(){
+    std::lock_guard<std::mutex> lock(this->ag_client_mutex);
+    if(this->ag_client.isValid()) return true;
+    this->ag_client = this->nh.serviceClient<adaptive_grasping::adaptiveGrasp>("adaptive_grasper_service", true);
+    return this->ag_client.waitForExistence(ros::Duration(2.0));
+}
+
+/* CALLADAPTIVEGRASPER */
+bool fullGrasper::call_adaptive_grasper(bool run){
+    adaptive_grasping::adaptiveGrasp ag_srv; ag_srv.request.run_adaptive_grasp = run;
+    for(int attempt = 0; attempt < 2; attempt++){
+        if(!this->connect_adaptive_grasper()) continue;
+        std::lock_guard<std::mutex> lock(this->ag_client_mutex);
+        if(this->ag_client.call(ag_srv)) return true;
+
+        // The persistent connection broke (e.g. adaptive grasper restarted): reopening it
+        this->ag_client.shutdown();
+    }
+    return false;
+}
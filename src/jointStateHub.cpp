@@ -0,0 +1,184 @@
+#include "jointStateHub.h"
+
+#define DEBUG             0                       // prints out additional info
+
+/**
+* @brief The following are functions of the class jointStateHub.
+*
+*/
+
+using namespace adaptive_grasping;
+
+/* DEFAULT CONSTRUCTOR */
+jointStateHub::jointStateHub(){
+  // Nothing to do here
+}
+
+/* DESTRUCTOR */
+jointStateHub::~jointStateHub(){
+  // Nothing to do here
+}
+
+/* SLOTOF */
+int jointStateHub::slotOf(const std::string& name){
+  // Registering the name only once (registration is not in the hot path)
+  for(size_t i = 0; i < slot_names.size(); i++){
+    if(slot_names[i] == name) return int(i);
+  }
+  slot_names.push_back(name);
+  slot_indices.push_back(0);
+  valid = false;
+  layout_size = 0;
+  return int(slot_names.size() - 1);
+}
+
+/* ADDJOINT */
+int jointStateHub::addJoint(const std::string& name){
+  return addGroup(std::vector<std::string>(1, name));
+}
+
+/* ADDGROUP */
+int jointStateHub::addGroup(const std::vector<std::string>& names){
+  std::vector<int> slots;
+  for(auto name : names) slots.push_back(slotOf(name));
+  groups.push_back(slots);
+  group_names.push_back(names);
+  return int(groups.size() - 1);
+}
+
+/* ADDBLOCK */
+int jointStateHub::addBlock(const std::string& first_name, int size){
+  blocks.push_back(std::make_pair(slotOf(first_name), size));
+  return int(blocks.size() - 1);
+}
+
+/* SETSYNERGYJOINT */
+void jointStateHub::setSynergyJoint(const std::string& name){
+  synergy_handle = addJoint(name);
+}
+
+/* ADDFINGER */
+void jointStateHub::addFinger(int finger_id, const std::vector<std::string>& names){
+  finger_handles[finger_id] = addGroup(names);
+}
+
+/* SETARMJOINTS */
+void jointStateHub::setArmJoints(const std::vector<std::string>& names){
+  arm_handle = addGroup(names);
+}
+
+/* CHECKLAYOUT */
+bool jointStateHub::checkLayout(const sensor_msgs::JointState& js) const {
+  // The layout is the same if the size matches and the names at the saved indices are still the registered ones
+  if(layout_size == 0 || js.name.size() != layout_size || js.position.size() < layout_size) return false;
+  for(size_t i = 0; i < slot_names.size(); i++){
+    if(js.name[slot_indices[i]] != slot_names[i]) return false;
+  }
+  return true;
+}
+
+/* BUILDLAYOUT */
+bool jointStateHub::buildLayout(const sensor_msgs::JointState& js){
+  // Building the name to index table once for the whole message
+  rebuilds++;
+  layout_size = 0;
+  std::map<std::string, size_t> name_indices;
+  for(size_t i = 0; i < js.name.size(); i++) name_indices[js.name[i]] = i;
+
+  for(size_t i = 0; i < slot_names.size(); i++){
+    auto it = name_indices.find(slot_names[i]);
+    if(it == name_indices.end() || it->second >= js.position.size()){
+      ROS_WARN_STREAM_THROTTLE(1.0, "jointStateHub::buildLayout : Joint " << slot_names[i] << " not in the joint states.");
+      return false;
+    }
+    slot_indices[i] = it->second;
+  }
+
+  // The blocks must fit in the message
+  for(auto block : blocks){
+    if(slot_indices[block.first] + block.second > js.position.size()){
+      ROS_WARN_STREAM_THROTTLE(1.0, "jointStateHub::buildLayout : The block starting at " << slot_names[block.first]
+        << " does not fit in the joint states.");
+      return false;
+    }
+  }
+
+  layout_size = js.name.size();
+  if(DEBUG) ROS_INFO_STREAM("jointStateHub::buildLayout : table built for " << slot_names.size() << " joints.");
+  return true;
+}
+
+/* UPDATE */
+bool jointStateHub::update(const sensor_msgs::JointState::ConstPtr& msg_){
+  msg = msg_;
+  valid = msg && (checkLayout(*msg) || buildLayout(*msg));
+  return valid;
+}
+
+/* ISVALID */
+bool jointStateHub::isValid() const {
+  return valid;
+}
+
+/* GETJOINT */
+double jointStateHub::getJoint(int handle) const {
+  return msg->position[slot_indices[groups[handle][0]]];
+}
+
+/* GETGROUP */
+bool jointStateHub::getGroup(int handle, Eigen::VectorXd& values) const {
+  if(!valid || handle < 0 || handle >= int(groups.size())) return false;
+  const std::vector<int>& slots = groups[handle];
+  if(values.size() != int(slots.size())) values.resize(slots.size());
+  for(size_t i = 0; i < slots.size(); i++) values(i) = msg->position[slot_indices[slots[i]]];
+  return true;
+}
+
+/* GETGROUP */
+bool jointStateHub::getGroup(int handle, std::vector<double>& values) const {
+  if(!valid || handle < 0 || handle >= int(groups.size())) return false;
+  const std::vector<int>& slots = groups[handle];
+  values.resize(slots.size());
+  for(size_t i = 0; i < slots.size(); i++) values[i] = msg->position[slot_indices[slots[i]]];
+  return true;
+}
+
+/* GETBLOCK */
+Eigen::Map<const Eigen::VectorXd> jointStateHub::getBlock(int handle) const {
+  return Eigen::Map<const Eigen::VectorXd>(msg->position.data() + slot_indices[blocks[handle].first], blocks[handle].second);
+}
+
+/* GETSYNERGY */
+bool jointStateHub::getSynergy(double& synergy) const {
+  if(!valid || synergy_handle < 0) return false;
+  synergy = getJoint(synergy_handle);
+  return true;
+}
+
+/* GETFINGERJOINTS */
+bool jointStateHub::getFingerJoints(int finger_id, std::vector<double>& values) const {
+  auto it = finger_handles.find(finger_id);
+  if(it == finger_handles.end()) return false;
+  return getGroup(it->second, values);
+}
+
+/* GETARMJOINTS */
+bool jointStateHub::getArmJoints(Eigen::VectorXd& values) const {
+  if(arm_handle < 0) return false;
+  return getGroup(arm_handle, values);
+}
+
+/* GETGROUPNAMES */
+const std::vector<std::string>& jointStateHub::getGroupNames(int handle) const {
+  return group_names[handle];
+}
+
+/* GETMESSAGE */
+sensor_msgs::JointState::ConstPtr jointStateHub::getMessage() const {
+  return msg;
+}
+
+/* GETREBUILDS */
+unsigned long jointStateHub::getRebuilds() const {
+  return rebuilds;
+}
@@ -54,6 +54,7 @@ bool matricesCreator::initialize(Eigen::MatrixXd H_i_, std::string world_frame_n
 
 	// Print message for debug
 	if (DEBUG) std::cout << "Built matricesCreator!" << std::endl;
+	return true;
 }
 
 /* INITIALIZE 2 */
@@ -75,6 +76,7 @@ bool matricesCreator::initialize(Eigen::MatrixXd H_i_, Eigen::MatrixXd Kc_i_, st
 
 	// Print message for debug
 	if (DEBUG) std::cout << "Built matricesCreator!" << std::endl;
+	return true;
 }
 
 /* CHANGECONTACTTYPE */
@@ -0,0 +1,229 @@
+#include "preGraspCache.h"
+#include <cmath>
+#include <cctype>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#define DEBUG             0                       // prints out additional info
+#define MAX_JOINTS        7                       // the joints of an entry (the arm group); other sizes in the file are malformed
+
+/**
+* @brief The following are functions of the class preGraspCache.
+*
+*/
+
+using namespace adaptive_grasping;
+
+/* DEFAULT CONSTRUCTOR */
+preGraspCache::preGraspCache(){
+  // Nothing to do here
+}
+
+/* DESTRUCTOR */
+preGraspCache::~preGraspCache(){
+  // Nothing to do here
+}
+
+/* CONFIGURE */
+void preGraspCache::configure(double position_quantum_, double angle_quantum_, double start_tolerance_, int max_entries_,
+  std::string file_){
+  position_quantum = position_quantum_;
+  angle_quantum = angle_quantum_;
+  start_tolerance = start_tolerance_;
+  max_entries = max_entries_;
+
+  // A relative file is taken in $ROS_HOME (~/.ros if not set) and not in the working directory of the node
+  file = file_;
+  if(!file.empty() && file[0] != '/'){
+    const char* ros_home = std::getenv("ROS_HOME");
+    const char* home = std::getenv("HOME");
+    std::string dir = ros_home ? std::string(ros_home) : std::string(home ? home : ".") + "/.ros";
+    file = dir + "/" + file;
+  }
+}
+
+/* MAKEKEY */
+std::string preGraspCache::makeKey(const std::string& object, const Eigen::Affine3d& object_pose) const {
+  // The quaternion is taken with positive w (q and -q are the same rotation); its components change by about
+  // half the rotation angle, hence the half quantum
+  Eigen::Quaterniond q(object_pose.linear());
+  if(q.w() < 0.0) q.coeffs() = -q.coeffs();
+
+  std::ostringstream key;
+  for(auto c : object) key << (std::isspace(static_cast<unsigned char>(c)) ? '_' : c);
+  for(int i = 0; i < 3; i++) key << ":" << std::lround(object_pose.translation()(i) / position_quantum);
+  for(int i = 0; i < 4; i++) key << ":" << std::lround(q.coeffs()(i) / (0.5 * angle_quantum));
+  return key.str();
+}
+
+/* LOOKUP */
+bool preGraspCache::lookup(const std::string& key, const std::vector<double>& start_joints, const Eigen::Affine3d& target,
+  std::vector<double>& joints){
+  auto it = entries.find(key);
+  if(it == entries.end()){
+    misses++;
+    return false;
+  }
+
+  // The entry is valid only from (about) the same start joints and for (about) the same target
+  const preGraspEntry& entry = it->second;
+  bool valid = entry.start_joints.size() == start_joints.size() && !start_joints.empty();
+  for(size_t i = 0; valid && i < start_joints.size(); i++){
+    valid = std::abs(start_joints[i] - entry.start_joints[i]) <= start_tolerance;
+  }
+  valid = valid && (target.translation() - entry.target_position).norm() <= position_quantum
+    && Eigen::Quaterniond(target.linear()).angularDistance(entry.target_orientation) <= angle_quantum;
+  if(!valid){
+    if(DEBUG) ROS_INFO_STREAM("preGraspCache::lookup : The entry " << key << " is not valid from here.");
+    misses++;
+    rejects++;
+    return false;
+  }
+
+  hits++;
+  it->second.last_use = ++uses;
+  joints = entry.joints;
+  return true;
+}
+
+/* STORE */
+void preGraspCache::store(const std::string& key, const std::vector<double>& start_joints, const Eigen::Affine3d& target,
+  const std::vector<double>& joints){
+  if(start_joints.empty() || joints.empty()) return;
+
+  preGraspEntry& entry = entries[key];
+  entry.start_joints = start_joints;
+  entry.target_position = target.translation();
+  entry.target_orientation = Eigen::Quaterniond(target.linear());
+  entry.joints = joints;
+  entry.last_use = ++uses;
+
+  evict();
+  save();
+}
+
+/* INVALIDATE */
+void preGraspCache::invalidate(const std::string& key){
+  if(entries.erase(key) > 0) save();
+}
+
+/* EVICT */
+void preGraspCache::evict(){
+  while(int(entries.size()) > max_entries && !entries.empty()){
+    auto oldest = entries.begin();
+    for(auto it = entries.begin(); it != entries.end(); ++it){
+      if(it->second.last_use < oldest->second.last_use) oldest = it;
+    }
+    entries.erase(oldest);
+  }
+}
+
+/* LOAD */
+bool preGraspCache::load(){
+  if(file.empty()) return true;
+  std::ifstream in(file);
+  if(!in.is_open()){
+    ROS_WARN_STREAM("preGraspCache::load : No cache file " << file << ". Starting with an empty cache.");
+    return false;
+  }
+
+  // One entry per line: key, start joints (size first), target position and quaternion (x y z w), joints (size first), last use
+  std::string line;
+  while(std::getline(in, line)){
+    if(line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    std::string key;
+    preGraspEntry entry;
+    size_t size;
+    double x, y, z, w;
+    // The sizes are checked before resizing (a corrupt or edited file must not allocate without bound)
+    bool ok = bool(fields >> key >> size) && size > 0 && size <= MAX_JOINTS;
+    entry.start_joints.resize(ok ? size : 0);
+    for(auto& joint : entry.start_joints) ok = ok && (fields >> joint);
+    ok = ok && (fields >> entry.target_position(0) >> entry.target_position(1) >> entry.target_position(2) >> x >> y >> z >> w >> size);
+    ok = ok && size > 0 && size <= MAX_JOINTS;
+    entry.joints.resize(ok ? size : 0);
+    for(auto& joint : entry.joints) ok = ok && (fields >> joint);
+    ok = ok && (fields >> entry.last_use);
+    if(!ok){
+      ROS_WARN_STREAM("preGraspCache::load : Skipping a malformed line of " << file << ".");
+      continue;
+    }
+    entry.target_orientation = Eigen::Quaterniond(w, x, y, z).normalized();
+    uses = std::max(uses, entry.last_use);
+    entries[key] = entry;
+  }
+  evict();
+
+  if(DEBUG) ROS_INFO_STREAM("preGraspCache::load : " << entries.size() << " entries loaded from " << file << ".");
+  return true;
+}
+
+/* SAVE */
+bool preGraspCache::save() const {
+  if(file.empty()) return true;
+
+  // Writing a temporary file and renaming it (a crash never leaves a truncated cache)
+  std::string tmp_file = file + ".tmp";
+  {
+    std::ofstream out(tmp_file);
+    if(!out.is_open()){
+      ROS_WARN_STREAM("preGraspCache::save : Could not write " << tmp_file << ".");
+      return false;
+    }
+    out.precision(17);
+    out << "# key n start_joints[n] x y z qx qy qz qw m joints[m] last_use" << std::endl;
+    for(auto& it : entries){
+      const preGraspEntry& entry = it.second;
+      out << it.first << " " << entry.start_joints.size();
+      for(auto joint : entry.start_joints) out << " " << joint;
+      out << " " << entry.target_position(0) << " " << entry.target_position(1) << " " << entry.target_position(2)
+        << " " << entry.target_orientation.x() << " " << entry.target_orientation.y() << " " << entry.target_orientation.z()
+        << " " << entry.target_orientation.w() << " " << entry.joints.size();
+      for(auto joint : entry.joints) out << " " << joint;
+      out << " " << entry.last_use << std::endl;
+    }
+    if(!out.good()) return false;
+  }
+  if(std::rename(tmp_file.c_str(), file.c_str()) != 0){
+    ROS_WARN_STREAM("preGraspCache::save : Could not rename " << tmp_file << " to " << file << ".");
+    return false;
+  }
+  return true;
+}
+
+/* GETHITS */
+unsigned long preGraspCache::getHits() const {
+  return hits;
+}
+
+/* GETMISSES */
+unsigned long preGraspCache::getMisses() const {
+  return misses;
+}
+
+/* GETREJECTS */
+unsigned long preGraspCache::getRejects() const {
+  return rejects;
+}
+
+/* GETHITRATE */
+double preGraspCache::getHitRate() const {
+  return (hits + misses) > 0 ? double(hits) / double(hits + misses) : 0.0;
+}
+
+/* GETSIZE */
+size_t preGraspCache::getSize() const {
+  return entries.size();
+}
+
+/* GETREPORT */
+std::string preGraspCache::getReport() const {
+  std::ostringstream report;
+  report << "hits " << hits << ", misses " << misses << " (" << rejects << " rejected), hit rate "
+    << 100.0 * getHitRate() << " %, " << entries.size() << " entries";
+  return report.str();
+}
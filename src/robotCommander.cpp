@@ -1,9 +1,11 @@
 #include "robotCommander.h"
+#include <chrono>
+#include <cmath>
+#include <algorithm>
 
 #define EXEC_NAMESPACE    "adaptive_grasping"
 #define CLASS_NAMESPACE   "robot_commander"
 #define DEBUG             0   // print out additional info
-#define DEBUG_PUB         1   // publishes additional info for rqt_plot
 
 /**
 * @brief The following are functions of the class robotCommander.
@@ -12,14 +14,31 @@
 
 using namespace adaptive_grasping;
 
+/* NOWNS */
+static int64_t nowNs(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* ADDDIAGNOSTICVALUE */
+template <typename T>
+static void addDiagnosticValue(diagnostic_msgs::DiagnosticStatus& status, std::string key, T value){
+    diagnostic_msgs::KeyValue key_value;
+    key_value.key = key;
+    key_value.value = std::to_string(value);
+    status.values.push_back(key_value);
+}
+
 /* CONSTRUCTOR */
-robotCommander::robotCommander(std::string hand_topic_, std::string arm_topic_) : 
-    ref_1_filter("double"), ref_2_filter("double"), ref_3_filter("double"), ref_4_filter("double"),
-    ref_5_filter("double"), ref_6_filter("double"), ref_7_filter("double") {
+robotCommander::robotCommander(std::string hand_topic_, std::string arm_topic_, bool in_process_){
     // Initializing service servers
     this->rc_server = this->nh_rc.advertiseService("rc_service", &robotCommander::performRobotCommand, this);
     this->emerg_server = this->nh_rc.advertiseService("rc_emergency_stop", &robotCommander::emergencyStop, this);
 
+    // Initializing the command topic subscriber (no reply is sent back, so the sender never waits)
+    this->command_sub = this->nh_rc.subscribe("rc_command", 1, &robotCommander::getCommand, this);
+    this->preview_sub = this->nh_rc.subscribe("rc_preview", 1, &robotCommander::getPreview, this);
+
     // Setting emergency to false
     this->emergency = false;
 
@@ -29,63 +48,386 @@ robotCommander::robotCommander(std::string hand_topic_, std::string arm_topic_)
     // Initializing the publishers
     this->pub_hand = nh_rc.advertise<std_msgs::Float64>(this->hand_topic , 1);
     this->pub_arm = nh_rc.advertise<geometry_msgs::Twist>(this->arm_topic , 1);
-    this->pub_twist_debug = nh_rc.advertise<geometry_msgs::WrenchStamped>("/rob_comm_twist_debug" , 1);
-    this->pub_sigma_debug = nh_rc.advertise<std_msgs::Float64>("/rob_comm_sigma_debug" , 1);
-    this->pub_twist_init = nh_rc.advertise<geometry_msgs::Twist>("/rob_comm_twist_init", 1);
+
+    // Initializing the debug telemetry (published at the telemetry rates, 0 disables a channel)
+    this->twist_init_channel = this->telemetry.addChannel(this->nh_rc, "/rob_comm_twist_init", TELEMETRY_TWIST,
+        "robot_commander/telemetry/rob_comm_twist_init", 50.0);
+    this->twist_channel = this->telemetry.addChannel(this->nh_rc, "/rob_comm_twist_debug", TELEMETRY_WRENCH,
+        "robot_commander/telemetry/rob_comm_twist_debug", 50.0);
+    this->sigma_channel = this->telemetry.addChannel(this->nh_rc, "/rob_comm_sigma_debug", TELEMETRY_FLOAT64,
+        "robot_commander/telemetry/rob_comm_sigma_debug", 50.0);
+    this->telemetry.start();
     
     // Resizing the Eigen Vector
     this->x_ref.resize(7);
     this->filtered_x_ref.resize(7);
 
-    // Setting up the filters
-    this->ref_1_filter.configure("low_pass_filter", this->nh_rc);
-    this->ref_2_filter.configure("low_pass_filter", this->nh_rc);
-    this->ref_3_filter.configure("low_pass_filter", this->nh_rc);
-    this->ref_4_filter.configure("low_pass_filter", this->nh_rc);
-    this->ref_5_filter.configure("low_pass_filter", this->nh_rc);
-    this->ref_6_filter.configure("low_pass_filter", this->nh_rc);
-    this->ref_7_filter.configure("low_pass_filter", this->nh_rc);
-
     // Getting needed parameters
     if (!this->nh_rc.getParam("robot_commander/enable_filter", this->enable_filter)) {
         ROS_WARN("robotCommander::robotCommander : Could not get parameter enable_filter. Using default.");
     }
+
+    // Setting up the filter bank for the 7 references (not filtering if the chain is not valid)
+    if (!this->ref_filter.configure(7, "low_pass_filter", this->nh_rc) && this->enable_filter) {
+        ROS_ERROR("robotCommander::robotCommander : Could not configure the low_pass_filter chain. Not filtering the references.");
+        this->enable_filter = false;
+    }
     if (!this->nh_rc.getParam("robot_commander/vel_limit", this->vel_limit)) {
         ROS_WARN("robotCommander::robotCommander : Could not get parameter vel_limit. Using default.");
     }
+
+    // Getting the streaming params (in streaming mode all the command sources queue the references)
+    if (!this->nh_rc.getParam("robot_commander/streaming", this->streaming)) {
+        ROS_WARN("robotCommander::robotCommander : Could not get parameter streaming. Using default.");
+    }
+    if(this->streaming){
+        std::string mode = "decay";
+        std::string interpolation_mode = "linear";
+        double diagnostics_rate = 1.0;
+        this->nh_rc.param("robot_commander/stream_rate", this->stream_rate, this->stream_rate);
+        this->nh_rc.param("robot_commander/stream_priority", this->stream_priority, this->stream_priority);
+        this->nh_rc.param("robot_commander/stale_timeout", this->stale_timeout, this->stale_timeout);
+        this->nh_rc.param("robot_commander/hold_time", this->hold_time, this->hold_time);
+        this->nh_rc.param("robot_commander/decay_time", this->decay_time, this->decay_time);
+        this->nh_rc.param("robot_commander/watchdog_mode", mode, mode);
+        this->nh_rc.param("robot_commander/interpolation", interpolation_mode, interpolation_mode);
+        this->nh_rc.param("robot_commander/diagnostics_rate", diagnostics_rate, diagnostics_rate);
+        if(mode == "hold") this->watchdog_mode = WATCHDOG_HOLD;
+        else if(mode == "zero") this->watchdog_mode = WATCHDOG_ZERO;
+        else if(mode == "decay") this->watchdog_mode = WATCHDOG_DECAY;
+        else ROS_ERROR_STREAM("robotCommander::robotCommander : Unknown watchdog_mode " << mode << ". Using decay.");
+        if(interpolation_mode == "none") this->interpolation = INTERPOLATION_NONE;
+        else if(interpolation_mode == "cubic") this->interpolation = INTERPOLATION_CUBIC;
+        else if(interpolation_mode == "linear") this->interpolation = INTERPOLATION_LINEAR;
+        else ROS_ERROR_STREAM("robotCommander::robotCommander : Unknown interpolation " << interpolation_mode << ". Using linear.");
+
+        if(diagnostics_rate > 0.0){
+            this->pub_diagnostics = this->nh_rc.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+            this->diag_timer = this->nh_rc.createTimer(ros::Duration(1.0 / diagnostics_rate), &robotCommander::publishDiagnostics, this);
+        }
+        this->stream_running = true;
+        this->stream_worker = std::thread(&robotCommander::streamLoop, this);
+        ROS_INFO_STREAM("robotCommander::robotCommander : Streaming the commands at " << this->stream_rate << " Hz (watchdog "
+            << mode << " after " << this->stale_timeout << " s).");
+    }
+
+    // Starting the worker for in process commands (not needed in streaming mode: post queues the references)
+    if(in_process_ && !this->streaming){
+        if (!this->nh_rc.getParam("robot_commander/command_rate", this->command_rate)) {
+            ROS_WARN("robotCommander::robotCommander : Could not get parameter command_rate. Using default.");
+        }
+        this->worker_running = true;
+        this->command_worker = std::thread(&robotCommander::commandLoop, this);
+    }
 }
 
 /* DESTRUCTOR */
 robotCommander::~robotCommander(){
-    // Nothing to do here
+    // Stopping the workers if running
+    this->worker_running = false;
+    if(this->command_worker.joinable()) this->command_worker.join();
+    this->stream_running = false;
+    if(this->stream_worker.joinable()) this->stream_worker.join();
+}
+
+/* POST */
+void robotCommander::post(const Eigen::Matrix<double, 7, 1>& x_ref_){
+    // Only writing in the mailbox (or in the stream mailbox), the worker will send it
+    if(this->streaming){
+        this->queueReference(SOURCE_IN_PROCESS, x_ref_);
+        return;
+    }
+    this->command_mailbox.post(x_ref_);
+}
+
+/* POSTPREVIEW */
+void robotCommander::postPreview(const Eigen::Matrix<double, 7, 1>& x_ref_, const double* preview_,
+    const double* preview_times_, int preview_size_){
+    // The preview is only used by the output thread
+    if(this->streaming){
+        this->queueReference(SOURCE_IN_PROCESS, x_ref_, preview_, preview_times_, preview_size_);
+        return;
+    }
+    this->command_mailbox.post(x_ref_);
+}
+
+/* QUEUEREFERENCE */
+bool robotCommander::queueReference(referenceSource source_, const Eigen::Matrix<double, 7, 1>& x_ref_, const double* preview_,
+    const double* preview_times_, int preview_size_, double latency_){
+    // Copying the knots (the preview ends at the first time which is not increasing)
+    timedReference timed_ref;
+    timed_ref.knots.col(0) = x_ref_;
+    timed_ref.knot_ns[0] = 0;
+    timed_ref.size = 1;
+    for(int i = 0; i < preview_size_ && timed_ref.size < MAX_KNOTS; i++){
+        int64_t knot_ns = int64_t(preview_times_[i] * 1e9);
+        if(knot_ns <= timed_ref.knot_ns[timed_ref.size - 1]){
+            ROS_WARN_THROTTLE(1.0, "robotCommander::queueReference : The preview times are not increasing. Cutting the preview.");
+            break;
+        }
+        timed_ref.knots.col(timed_ref.size) = Eigen::Matrix<double, 7, 1>::Map(preview_ + 7 * i);
+        timed_ref.knot_ns[timed_ref.size] = knot_ns;
+        timed_ref.size++;
+    }
+
+    // Stamping with the arrival time and posting in the mailbox of the source (the output thread is not involved;
+    // the service callbacks may run concurrently, so only they are serialized)
+    timed_ref.stamp_ns = nowNs() - int64_t(latency_ * 1e9);
+    if(source_ == SOURCE_SERVICE){
+        std::lock_guard<std::mutex> lock(this->service_stream_mutex);
+        this->stream_mailboxes[source_].post(timed_ref);
+    } else {
+        this->stream_mailboxes[source_].post(timed_ref);
+    }
+    this->stream_received++;
+    return true;
+}
+
+/* STREAMLOOP */
+void robotCommander::streamLoop(){
+    if(this->stream_priority > 0) setRealtimePriority(this->stream_priority);
+
+    periodicDeadline deadline;
+    deadline.start(1.0 / this->stream_rate);
+    timedReference latest, candidate;
+    bool have_ref = false;
+    Eigen::VectorXd command(7);
+    while(this->stream_running && ros::ok()){
+        // Taking the references posted since the last cycle (the newest one of all the sources is followed; a source
+        // being written now is read at the next cycle, the output thread never waits for a producer)
+        for(int s = 0; s < NUM_SOURCES; s++){
+            uint64_t last_version = this->stream_versions[s];
+            if(!this->stream_mailboxes[s].tryFetch(candidate, last_version)) continue;
+            if(this->stream_versions[s] > 0 && last_version > this->stream_versions[s] + 1){
+                this->stream_overwritten += last_version - this->stream_versions[s] - 1;
+            }
+            this->stream_versions[s] = last_version;
+            if(!have_ref || candidate.stamp_ns >= latest.stamp_ns){
+                latest = candidate;
+                have_ref = true;
+            }
+        }
+
+        // Nothing is sent before the first reference
+        if(have_ref){
+            // Evaluating the reference (and its preview) now; it becomes stale stale_timeout after its last knot
+            int64_t age_ns = nowNs() - latest.stamp_ns;
+            this->interpolate(latest, age_ns, command);
+            double stale_for = (age_ns - latest.knot_ns[latest.size - 1]) * 1e-9 - this->stale_timeout;
+            if(stale_for <= 0.0){
+                this->stream_is_stale = false;
+            } else {
+                // The watchdog: counting a trip when the reference becomes stale
+                if(!this->stream_is_stale.exchange(true)){
+                    this->watchdog_trips++;
+                    ROS_WARN_STREAM("robotCommander::streamLoop : No reference for " << this->stale_timeout << " s, watchdog active.");
+                }
+                this->stream_stale++;
+                switch(this->watchdog_mode){
+                    case WATCHDOG_HOLD:
+                        if(stale_for > this->hold_time) command.setZero();
+                        break;
+                    case WATCHDOG_DECAY:
+                        command *= std::exp(-stale_for / this->decay_time);
+                        break;
+                    case WATCHDOG_ZERO:
+                        command.setZero();
+                        break;
+                }
+            }
+            this->sendCommand(command);
+
+            // Recording the staleness of the sent reference
+            this->stream_sent++;
+            this->sum_staleness_ns += age_ns;
+            int64_t old_max = this->max_staleness_ns.load();
+            while(age_ns > old_max && !this->max_staleness_ns.compare_exchange_weak(old_max, age_ns)){}
+        }
+        deadline.wait();
+        this->missed_deadlines.store(deadline.getOverruns(), std::memory_order_relaxed);
+    }
+}
+
+/* INTERPOLATE */
+void robotCommander::interpolate(const timedReference& ref, int64_t t_ns, Eigen::VectorXd& command) const {
+    // Before the first knot and after the last one the knot is held
+    const int last = ref.size - 1;
+    if(t_ns <= 0 || last == 0){
+        command = ref.knots.col(0);
+        return;
+    }
+    if(t_ns >= ref.knot_ns[last]){
+        command = ref.knots.col(last);
+        return;
+    }
+
+    // Finding the segment containing t (few knots, linear search)
+    int i = 0;
+    while(ref.knot_ns[i + 1] <= t_ns) i++;
+    double h = (ref.knot_ns[i + 1] - ref.knot_ns[i]) * 1e-9;
+    double s = (t_ns - ref.knot_ns[i]) * 1e-9 / h;
+
+    switch(this->interpolation){
+        case INTERPOLATION_NONE:
+            command = ref.knots.col(i);
+            break;
+        case INTERPOLATION_LINEAR:
+            command = (1.0 - s) * ref.knots.col(i) + s * ref.knots.col(i + 1);
+            break;
+        case INTERPOLATION_CUBIC: {
+            // Hermite basis with the slopes at the knots from central (one sided at the ends) differences
+            int i0 = std::max(i - 1, 0), i2 = std::min(i + 2, last);
+            Eigen::Matrix<double, 7, 1> m1 = (ref.knots.col(i + 1) - ref.knots.col(i0)) / ((ref.knot_ns[i + 1] - ref.knot_ns[i0]) * 1e-9);
+            Eigen::Matrix<double, 7, 1> m2 = (ref.knots.col(i2) - ref.knots.col(i)) / ((ref.knot_ns[i2] - ref.knot_ns[i]) * 1e-9);
+            double s2 = s * s, s3 = s2 * s;
+            command = (2.0 * s3 - 3.0 * s2 + 1.0) * ref.knots.col(i) + (s3 - 2.0 * s2 + s) * h * m1
+                + (-2.0 * s3 + 3.0 * s2) * ref.knots.col(i + 1) + (s3 - s2) * h * m2;
+            break;
+        }
+    }
+}
+
+/* PUBLISHDIAGNOSTICS */
+void robotCommander::publishDiagnostics(const ros::TimerEvent& event){
+    // Getting the window duration (since the last publish) and the counters of the window
+    ros::WallTime now = ros::WallTime::now();
+    double window = this->last_diag_time.isZero() ? 0.0 : (now - this->last_diag_time).toSec();
+    this->last_diag_time = now;
+    unsigned long sent = this->stream_sent.exchange(0);
+    unsigned long received = this->stream_received.exchange(0);
+    unsigned long stale = this->stream_stale.exchange(0);
+    unsigned long trips = this->watchdog_trips.exchange(0);
+    int64_t sum_staleness = this->sum_staleness_ns.exchange(0);
+    int64_t max_staleness = this->max_staleness_ns.exchange(0);
+    this->total_trips += trips;
+
+    diagnostic_msgs::DiagnosticArray diag_array;
+    diag_array.header.stamp = ros::Time::now();
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = "robot_commander: command streaming";
+    status.hardware_id = "robot_commander";
+    status.level = this->stream_is_stale ? diagnostic_msgs::DiagnosticStatus::WARN : diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = this->stream_is_stale ? "Watchdog active: references are stale" : "OK";
+    addDiagnosticValue(status, "target rate [Hz]", this->stream_rate);
+    addDiagnosticValue(status, "publish rate [Hz]", window > 0.0 ? sent / window : 0.0);
+    addDiagnosticValue(status, "input rate [Hz]", window > 0.0 ? received / window : 0.0);
+    addDiagnosticValue(status, "staleness mean [ms]", sent > 0 ? sum_staleness * 1e-6 / sent : 0.0);
+    addDiagnosticValue(status, "staleness max [ms]", max_staleness * 1e-6);
+    addDiagnosticValue(status, "stale cycles (window)", stale);
+    addDiagnosticValue(status, "watchdog trips (window)", trips);
+    addDiagnosticValue(status, "watchdog trips (total)", this->total_trips);
+    addDiagnosticValue(status, "overwritten references (total)", this->stream_overwritten.load());
+    addDiagnosticValue(status, "missed deadlines (total)", this->missed_deadlines.load());
+    diag_array.status.push_back(status);
+    this->pub_diagnostics.publish(diag_array);
+}
+
+/* COMMANDLOOP */
+void robotCommander::commandLoop(){
+    // Executing the latest posted command at the command rate
+    ros::Rate rate(this->command_rate);
+    Eigen::Matrix<double, 7, 1> posted_ref;
+    Eigen::VectorXd command(7);
+    while(this->worker_running && ros::ok()){
+        if(this->command_mailbox.fetch(posted_ref)){
+            command = posted_ref;
+            this->sendCommand(command);
+        }
+        rate.sleep();
+    }
+}
+
+/* GETCOMMAND */
+void robotCommander::getCommand(const std_msgs::Float64MultiArray::ConstPtr &msg){
+    // Checking the size of the reference
+    if(msg->data.size() != 7){
+        ROS_WARN_STREAM_THROTTLE(1.0, "robotCommander::getCommand : The command has size " << msg->data.size() << " instead of 7. Ignoring it.");
+        return;
+    }
+
+    // Sending the command (or queueing it for the output thread)
+    if(this->streaming){
+        this->queueReference(SOURCE_COMMAND_TOPIC, Eigen::Matrix<double, 7, 1>::Map(msg->data.data()));
+        return;
+    }
+    Eigen::VectorXd command = Eigen::Map<const Eigen::VectorXd>(msg->data.data(), 7);
+    this->sendCommand(command);
+}
+
+/* GETPREVIEW */
+void robotCommander::getPreview(const adaptive_grasping::ReferencePreview::ConstPtr &msg){
+    // Checking the size of the reference and of the preview (a wrong preview is ignored)
+    if(msg->x_ref.size() != 7){
+        ROS_WARN_STREAM_THROTTLE(1.0, "robotCommander::getPreview : The command has size " << msg->x_ref.size() << " instead of 7. Ignoring it.");
+        return;
+    }
+    int preview_size = int(msg->preview_times.size());
+    if(msg->preview.size() != 7 * msg->preview_times.size()){
+        ROS_WARN_STREAM_THROTTLE(1.0, "robotCommander::getPreview : The preview has " << msg->preview.size() << " values for "
+            << preview_size << " times. Ignoring the preview.");
+        preview_size = 0;
+    }
+
+    // Queueing the reference with its preview shifted by the transport latency (if stamped)
+    if(this->streaming){
+        double latency = msg->header.stamp.isZero() ? 0.0 : (ros::Time::now() - msg->header.stamp).toSec();
+        latency = std::max(0.0, std::min(latency, this->stale_timeout));
+        this->queueReference(SOURCE_PREVIEW_TOPIC, Eigen::Matrix<double, 7, 1>::Map(msg->x_ref.data()), msg->preview.data(),
+            msg->preview_times.data(), preview_size, latency);
+        return;
+    }
+    Eigen::VectorXd command = Eigen::Map<const Eigen::VectorXd>(msg->x_ref.data(), 7);
+    this->sendCommand(command);
 }
 
 /* PERFORMROBOTCOMMAND */
 bool robotCommander::performRobotCommand(adaptive_grasping::velCommand::Request &req,
     adaptive_grasping::velCommand::Response &res){
-    // The bool to be returned and a tmp array var
-    bool success = true;
-    std::array<float, 7> x_ref_arr;
-
-    // Saving the velocity reference in req to array and then to Eigen class variable
-    std::copy(std::begin(req.x_ref), std::end(req.x_ref), std::begin(x_ref_arr));
-    for(int i = 0; i < x_ref_arr.size(); i++){
-        this->x_ref(i) = x_ref_arr[i];
+    // Checking the size of the reference
+    if(req.x_ref.size() != 7){
+        ROS_WARN_STREAM("robotCommander::performRobotCommand : The requested vector has size " << req.x_ref.size() << " instead of 7.");
+        res.success = false;
+        return false;
     }
 
-    if (DEBUG_PUB) {
-        this->tmp_twist.linear.x = this->x_ref(0); this->tmp_twist.linear.y = this->x_ref(2); this->tmp_twist.linear.z = this->x_ref(3);
-        this->tmp_twist.angular.x = this->x_ref(3); this->tmp_twist.angular.y = this->x_ref(4); this->tmp_twist.angular.z = this->x_ref(5);
-        this->pub_twist_init.publish(this->tmp_twist);
+    // Sending the command (or queueing it for the output thread) and returning the result
+    if(this->streaming){
+        int preview_size = int(req.preview_times.size());
+        if(req.preview.size() != 7 * req.preview_times.size()){
+            ROS_WARN_STREAM_THROTTLE(1.0, "robotCommander::performRobotCommand : The preview has " << req.preview.size()
+                << " values for " << preview_size << " times. Ignoring the preview.");
+            preview_size = 0;
+        }
+        res.success = this->queueReference(SOURCE_SERVICE, Eigen::Matrix<double, 7, 1>::Map(req.x_ref.data()), req.preview.data(),
+            req.preview_times.data(), preview_size);
+        return res.success;
     }
+    Eigen::VectorXd command = Eigen::Map<const Eigen::VectorXd>(req.x_ref.data(), 7);
+    res.success = this->sendCommand(command);
+    return res.success;
+}
+
+/* SENDCOMMAND */
+bool robotCommander::sendCommand(const Eigen::VectorXd& x_ref_){
+    // Only one command at a time (service, topic and worker might call concurrently)
+    std::lock_guard<std::mutex> lock(this->robot_commander_mutex);
+
+    // The bool to be returned
+    bool success = true;
+
+    // Saving the velocity reference to the class variable
+    this->x_ref = x_ref_;
+
+    // Sampling the requested palm twist for debug
+    this->telemetry.sample(this->twist_init_channel, this->x_ref.tail(6));
     
     // Debug message
-    if(DEBUG) ROS_INFO_STREAM("robotCommander::performRobotCommand : The requested velocity vector is:" 
+    if(DEBUG) ROS_INFO_STREAM("robotCommander::sendCommand : The requested velocity vector is:" 
         << "\n" << this->x_ref << ".");
 
     // Checking if the reference contains NaNs
     if(!this->x_ref.allFinite()){
-        ROS_WARN_STREAM("robotCommander::performRobotCommand : The requested velocity vector contains NaNs or Infs, setting x_ref to null.");
+        ROS_WARN_STREAM("robotCommander::sendCommand : The requested velocity vector contains NaNs or Infs, setting x_ref to null.");
         this->x_ref = Eigen::VectorXd::Zero(this->x_ref.size());
     }
 
@@ -99,24 +441,18 @@ bool robotCommander::performRobotCommand(adaptive_grasping::velCommand::Request
     // Checking velocity limits and eventually scaling them
     if(!this->enforceLimits(this->x_ref)){
         if(DEBUG){
-            ROS_WARN("robotCommander::performRobotCommand : velocity limits violated, scaling the reference.");
+            ROS_WARN("robotCommander::sendCommand : velocity limits violated, scaling the reference.");
         }
     }
 
     // Filtering the command in order to avoid peaks
     if(this->enable_filter){
-        this->ref_1_filter.update(this->x_ref(0), this->filtered_x_ref(0));
-        this->ref_2_filter.update(this->x_ref(1), this->filtered_x_ref(1));
-        this->ref_3_filter.update(this->x_ref(2), this->filtered_x_ref(2));
-        this->ref_4_filter.update(this->x_ref(3), this->filtered_x_ref(3));
-        this->ref_5_filter.update(this->x_ref(4), this->filtered_x_ref(4));
-        this->ref_6_filter.update(this->x_ref(5), this->filtered_x_ref(5));
-        this->ref_7_filter.update(this->x_ref(6), this->filtered_x_ref(6));
+        this->ref_filter.update(this->x_ref, this->filtered_x_ref);
     } else {
         this->filtered_x_ref = this->x_ref;
     }
 
-    if(DEBUG) ROS_INFO_STREAM("robotCommander::performRobotCommand : The to be sent velocity vector is:" 
+    if(DEBUG) ROS_INFO_STREAM("robotCommander::sendCommand : The to be sent velocity vector is:" 
         << "\n" << this->filtered_x_ref << ".");
 
     // Filling up the messages to be published
@@ -129,17 +465,11 @@ bool robotCommander::performRobotCommand(adaptive_grasping::velCommand::Request
     this->pub_hand.publish(this->cmd_syn);
     this->pub_arm.publish(this->cmd_twist);
 
-    // Filling and publishing the twist for debug
-    if(DEBUG_PUB) this->twist_wrench.header.frame_id = "world";
-    if(DEBUG_PUB) this->twist_wrench.header.stamp = ros::Time::now();
-    if(DEBUG_PUB) this->twist_wrench.wrench.force.x = filtered_x_ref(1); this->twist_wrench.wrench.torque.x = filtered_x_ref(4);
-    if(DEBUG_PUB) this->twist_wrench.wrench.force.y = filtered_x_ref(2); this->twist_wrench.wrench.torque.y = filtered_x_ref(5);
-    if(DEBUG_PUB) this->twist_wrench.wrench.force.z = filtered_x_ref(3); this->twist_wrench.wrench.torque.z = filtered_x_ref(6);
-    if(DEBUG_PUB) this->pub_twist_debug.publish(this->twist_wrench);
-    if(DEBUG_PUB) this->pub_sigma_debug.publish(this->cmd_syn);
-
-    // Return the callback result
-    res.success = success;
+    // Sampling the sent twist and synergy for debug (published by the telemetry thread)
+    this->telemetry.sample(this->twist_channel, this->filtered_x_ref.tail(6));
+    this->telemetry.sample(this->sigma_channel, double(this->cmd_syn.data));
+
+    // Return the result
     return success;
 }
 
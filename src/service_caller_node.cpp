@@ -9,19 +9,60 @@
 
 // ROS INCLUDES
 #include <ros/ros.h>
+#include <actionlib/client/simple_action_client.h>
 
 // MSG INCLUEDS
 #include "std_srvs/SetBool.h"
+#include "adaptive_grasping/GraspCycleAction.h"
 
 // DEFINES
 #define DEBUG       1       // Prints out additional info
 
+// Prints the feedback of the grasp cycle (sent at the end of every phase)
+void cycleFeedbackCallback(const adaptive_grasping::GraspCycleFeedbackConstPtr& feedback){
+    ROS_INFO_STREAM("Cycle " << feedback->cycle << " (" << feedback->object << "): " << feedback->phase
+        << (feedback->success ? " success" : " FAILED") << " in " << feedback->phase_latency << " s (elapsed "
+        << feedback->elapsed << " s).");
+}
+
+// Runs the grasp cycle action of full grasper over the objects (the present one once if empty)
+bool callGraspCycle(std::vector<std::string> objects){
+    actionlib::SimpleActionClient<adaptive_grasping::GraspCycleAction> cycle_client("/grasp_cycle", true);
+    if(!cycle_client.waitForServer(ros::Duration(5.0))){
+        ROS_ERROR("Could not connect to the grasp cycle action server!");
+        return false;
+    }
+
+    adaptive_grasping::GraspCycleGoal goal;
+    goal.objects = objects;
+    cycle_client.sendGoal(goal, actionlib::SimpleActionClient<adaptive_grasping::GraspCycleAction>::SimpleDoneCallback(),
+        actionlib::SimpleActionClient<adaptive_grasping::GraspCycleAction>::SimpleActiveCallback(), &cycleFeedbackCallback);
+    cycle_client.waitForResult();
+
+    // The state text reports the completed cycles, the picks per hour and the mean latency of each phase
+    ROS_INFO_STREAM("Grasp cycle " << cycle_client.getState().toString() << ": " << cycle_client.getState().getText());
+    return cycle_client.getState() == actionlib::SimpleClientGoalState::SUCCEEDED;
+}
+
 
 int main(int argc, char** argv){
 
 	// Initializing ROS node
 	ros::init(argc, argv, "adaptive_grasping_service_caller_node");
 	ros::NodeHandle service_caller_nh;
+    ros::NodeHandle private_nh("~");
+
+    // Running the whole cycle through the grasp cycle action if requested (back to back over the objects)
+    bool use_action = false;
+    std::vector<std::string> objects;
+    private_nh.param("use_action", use_action, false);
+    private_nh.param("objects", objects, std::vector<std::string>());
+    if(use_action){
+        ROS_INFO("\nThe Service caller is running the grasp cycle action!");
+        bool success = callGraspCycle(objects);
+        ROS_INFO("\nTerminating Service caller!");
+        return success ? 0 : 1;
+    }
 
     // Params for building full_grasper
     std::string pre_grasp_service_name = "/pregrasp_task_service";
@@ -2,6 +2,9 @@
 
 // ROS Includes
 #include <ros/ros.h>
+#include "utils/async_logger.h"
+#include <numeric>
+#include <algorithm>
 
 #define DEBUG           0           // Prints out additional info (additional to ROS_DEBUG)
 #define USE_DAMPING     1           // If true the manager makes use of damping while pseudo inverting
@@ -48,6 +51,7 @@ bool reversePriorityManager::set_basics(int dim_config_space, double lambda_max,
     this->epsilon_ = epsilon;
 
     ROS_INFO_STREAM("This RP Manager has dim_config_space_ " << this->dim_config_space_ << " lambda_max_ " << this->lambda_max_ << " epsilon " << this->epsilon_ << ".");
+    return true;
 }
 
 
@@ -68,6 +72,7 @@ bool reversePriorityManager::insert_tasks(std::vector<basicTask> tasks) {
 
     // Appending the input task vector to the existing task set
     this->task_set_.insert(this->task_set_.end(), tasks.begin(), tasks.end());
+    return true;
 }
 
 void reversePriorityManager::remove_task(int task_priority) {
@@ -86,7 +91,8 @@ void reversePriorityManager::remove_task(int task_priority) {
 }
 
 void reversePriorityManager::reorder_set() {
-    std::sort(this->task_set_.begin(), this->task_set_.end());
+    // Stable as reorder_set_with_order: tasks which compare equal keep their insertion order in both paths
+    std::stable_sort(this->task_set_.begin(), this->task_set_.end());
 }
 
 void reversePriorityManager::clear_set() {
@@ -94,15 +100,16 @@ void reversePriorityManager::clear_set() {
 }
 
 void reversePriorityManager::print_set() {
-    ROS_INFO_STREAM("The task set is: ");
+    // Queuing the set in the async logger (it is formatted and printed out of the control loop)
+    static logSite set_site(__FILE__, __LINE__, LOG_LEVEL_DEBUG, 0.0);
+    asyncLogger& logger = asyncLogger::instance();
+    logger.push(set_site, "The task set is: ");
     for (std::vector<basicTask>::iterator it = this->task_set_.begin(); it != this->task_set_.end(); ++it) {
-        std::cout << "---------------------" << std::endl;
-        std::cout << "priority: " << it->get_task_priority() << std::endl;
-        std::cout << "sec_priority: " << it->get_sec_priority() << std::endl;
-        std::cout << "x_dot: \n" << it->get_task_x_dot() << std::endl;
-        std::cout << "jacobian: \n" << it->get_task_jacobian() << std::endl;
+        logger.push(set_site, "priority:", it->get_task_priority());
+        logger.push(set_site, "sec_priority:", it->get_sec_priority());
+        logger.push(set_site, "x_dot:", it->get_task_x_dot());
+        logger.push(set_site, "jacobian:", it->get_task_jacobian());
     }
-    std::cout << "---------------------" << std::endl;
 }
 
 bool reversePriorityManager::solve_inv_kin(Eigen::VectorXd &q_sol) {
@@ -111,7 +118,9 @@ bool reversePriorityManager::solve_inv_kin(Eigen::VectorXd &q_sol) {
 
     // Ordering the task set
     this->reorder_set();
-    if (DEBUG || true) this->print_set();
+    // Printing the set at most once per second and only if debug logging is enabled
+    static logSite print_site(__FILE__, __LINE__, LOG_LEVEL_DEBUG, 1.0);
+    if (AG_LOG_ENABLED(LOG_LEVEL_DEBUG) && asyncLogger::instance().allow(print_site)) this->print_set();
 
     // Computing all the Projection matrices
     if (!this->compute_proj_mats()) {      // If this fails, return false and solution is zeros
@@ -159,6 +168,54 @@ bool reversePriorityManager::solve_inv_kin(Eigen::VectorXd &q_sol) {
     return true;
 }
 
+bool reversePriorityManager::prepare_factorization() {
+    // Ordering the task set (remembering where each task was inserted) and computing the projection matrices
+    this->pinv_set_.clear();
+    this->reorder_set_with_order();
+    if (!this->compute_proj_mats()) return false;
+
+    // The same recursion of solve_inv_kin, only keeping what does not depend on the task velocities
+    auto task_set_dim = this->task_set_.size();
+    this->jac_set_.resize(task_set_dim);
+    this->pinv_set_.resize(task_set_dim);
+    for (size_t i = 0; i < task_set_dim; i++) {
+        this->jac_set_[i] = this->task_set_.at(i).get_task_jacobian();
+        if (USE_DAMPING) {
+            this->pinv_set_[i] = damped_pseudo_inv((this->jac_set_[i] * this->proj_mat_set_.at(i+1)), this->lambda_max_, this->epsilon_);
+        } else {
+            this->pinv_set_[i] = trunk_pseudo_inv((this->jac_set_[i] * this->proj_mat_set_.at(i+1)), this->epsilon_);
+        }
+    }
+
+    return true;
+}
+
+bool reversePriorityManager::solve_with_factorization(const std::vector<Eigen::VectorXd> &x_dots, Eigen::VectorXd &q_sol) {
+    // Checking that the factorization is there and matches the given task velocities
+    if (this->pinv_set_.empty() || x_dots.size() != this->order_.size()) return false;
+
+    // The RP recursion with the cached pseudo inverses (only matrix vector products)
+    q_sol.setZero(this->dim_config_space_);
+    for (int i = int (this->pinv_set_.size()) - 1; i >= 0; i--) {
+        const Eigen::VectorXd &x_dot_i = x_dots[this->order_[i]];
+        if (x_dot_i.size() != this->jac_set_[i].rows()) return false;
+        q_sol += this->pinv_set_[i] * (x_dot_i - this->jac_set_[i] * q_sol);
+    }
+
+    return true;
+}
+
+void reversePriorityManager::reorder_set_with_order() {
+    // Sorting the indices with the task order and then the tasks accordingly
+    this->order_.resize(this->task_set_.size());
+    std::iota(this->order_.begin(), this->order_.end(), 0);
+    std::stable_sort(this->order_.begin(), this->order_.end(),
+        [this](int a, int b) { return this->task_set_[a] < this->task_set_[b]; });
+    std::vector<basicTask> ordered_set;
+    for (auto i : this->order_) ordered_set.push_back(this->task_set_[i]);
+    this->task_set_.swap(ordered_set);
+}
+
 bool reversePriorityManager::compute_proj_mats() {
     // Checking if there are any tasks in the set
     if (this->task_set_.empty()) {
@@ -6,6 +6,8 @@
 
 // ROS Includes
 #include <ros/ros.h>
+#include <numeric>
+#include <algorithm>
 
 #define DEBUG           0           // Prints out additional info (additional to ROS_DEBUG)
 #define USE_DAMPING     0           // If true the manager makes use of damping while pseudo inverting
@@ -52,6 +54,7 @@ bool stackOfTasksManager::set_basics(int dim_config_space, double lambda_max, do
 	this->epsilon_ = epsilon;
 
 	ROS_INFO_STREAM("This RP Manager has dim_config_space_ " << this->dim_config_space_ << " lambda_max_ " << this->lambda_max_ << " epsilon " << this->epsilon_ << ".");
+	return true;
 }
 
 
@@ -72,6 +75,7 @@ bool stackOfTasksManager::insert_tasks(std::vector<basicTask> tasks) {
 
 	// Appending the input task vector to the existing task set
 	this->task_set_.insert(this->task_set_.end(), tasks.begin(), tasks.end());
+	return true;
 }
 
 void stackOfTasksManager::remove_task(int task_priority) {
@@ -90,7 +94,8 @@ void stackOfTasksManager::remove_task(int task_priority) {
 }
 
 void stackOfTasksManager::reorder_set() {
-	std::sort(this->task_set_.begin(), this->task_set_.end());
+	// Stable as reorder_set_with_order: tasks which compare equal keep their insertion order in both paths
+	std::stable_sort(this->task_set_.begin(), this->task_set_.end());
 }
 
 void stackOfTasksManager::clear_set() {
@@ -160,3 +165,58 @@ void stackOfTasksManager::solve_inv_kin(Eigen::VectorXd &q_sol) {
 	// Returning
 	q_sol = q_res;
 }
+
+bool stackOfTasksManager::prepare_factorization() {
+	// Checking if there are any tasks in the set
+	this->pinv_set_.clear();
+	if (this->task_set_.empty()) {
+		ROS_ERROR("There are no tasks in the set! Won't factorize anything!");
+		return false;
+	}
+
+	// Ordering the task set (remembering where each task was inserted)
+	this->reorder_set_with_order();
+
+	// The same recursion of solve_inv_kin, only keeping what does not depend on the task velocities
+	int n_cols_init = this->task_set_.at(0).get_task_jacobian().cols();
+	Eigen::MatrixXd P_i_1 = Eigen::MatrixXd::Identity(n_cols_init, n_cols_init);
+	this->jac_set_.resize(this->task_set_.size());
+	this->pinv_set_.resize(this->task_set_.size());
+	for (size_t i = 0; i < this->task_set_.size(); i++) {
+		this->jac_set_[i] = this->task_set_[i].get_task_jacobian();
+		if (USE_DAMPING) {
+			this->pinv_set_[i] = damped_pseudo_inv(this->jac_set_[i] * P_i_1, this->lambda_max_, this->epsilon_);
+		} else {
+			this->pinv_set_[i] = trunk_pseudo_inv(this->jac_set_[i] * P_i_1, this->epsilon_);
+		}
+		P_i_1 = P_i_1 - this->pinv_set_[i] * this->jac_set_[i] * P_i_1;
+	}
+
+	return true;
+}
+
+bool stackOfTasksManager::solve_with_factorization(const std::vector<Eigen::VectorXd> &x_dots, Eigen::VectorXd &q_sol) {
+	// Checking that the factorization is there and matches the given task velocities
+	if (this->pinv_set_.empty() || x_dots.size() != this->order_.size()) return false;
+
+	// Recursion with the cached pseudo inverses (only matrix vector products)
+	q_sol.setZero(this->dim_config_space_);
+	for (size_t i = 0; i < this->pinv_set_.size(); i++) {
+		const Eigen::VectorXd &x_dot_i = x_dots[this->order_[i]];
+		if (x_dot_i.size() != this->jac_set_[i].rows()) return false;
+		q_sol += this->pinv_set_[i] * (x_dot_i - this->jac_set_[i] * q_sol);
+	}
+
+	return true;
+}
+
+void stackOfTasksManager::reorder_set_with_order() {
+	// Sorting the indices with the task order and then the tasks accordingly
+	this->order_.resize(this->task_set_.size());
+	std::iota(this->order_.begin(), this->order_.end(), 0);
+	std::stable_sort(this->order_.begin(), this->order_.end(),
+		[this](int a, int b) { return this->task_set_[a] < this->task_set_[b]; });
+	std::vector<basicTask> ordered_set;
+	for (auto i : this->order_) ordered_set.push_back(this->task_set_[i]);
+	this->task_set_.swap(ordered_set);
+}
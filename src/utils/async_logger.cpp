@@ -0,0 +1,161 @@
+#include "utils/async_logger.h"
+#include <sstream>
+#include <chrono>
+#include <cstddef>
+#include <algorithm>
+
+/**
+* @brief The following are functions of the class asyncLogger.
+*
+*/
+
+// The default verbosity (the hot path sites are mostly debug)
+std::atomic<int> asyncLogger::verbosity{LOG_LEVEL_INFO};
+
+/* NOWNS */
+static int64_t nowNs(){
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* INSTANCE */
+asyncLogger& asyncLogger::instance(){
+  static asyncLogger logger;
+  return logger;
+}
+
+/* CONSTRUCTOR */
+asyncLogger::asyncLogger(){
+  // Preallocating the ring and starting the background thread
+  cells = new logCell[AG_LOG_RING_SIZE];
+  for(size_t i = 0; i < AG_LOG_RING_SIZE; i++){
+    cells[i].seq.store(i, std::memory_order_relaxed);
+  }
+  running = true;
+  worker = std::thread(&asyncLogger::workerLoop, this);
+}
+
+/* DESTRUCTOR */
+asyncLogger::~asyncLogger(){
+  running = false;
+  if(worker.joinable()) worker.join();
+  delete[] cells;
+}
+
+/* ALLOW */
+bool asyncLogger::allow(logSite& site){
+  // Only one caller per period wins the site
+  int64_t now = nowNs();
+  int64_t last = site.last_ns.load(std::memory_order_relaxed);
+  if(now - last < site.min_period_ns || !site.last_ns.compare_exchange_strong(last, now, std::memory_order_relaxed)){
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+/* ACQUIRE */
+logRecord* asyncLogger::acquire(logSite& site, const char* text){
+  // Reserving a cell (if the ring is full the record is dropped)
+  size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+  logCell* cell;
+  while(true){
+    cell = &cells[pos % AG_LOG_RING_SIZE];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    intptr_t diff = intptr_t(seq) - intptr_t(pos);
+    if(diff == 0){
+      if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if(diff < 0){
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return NULL;
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Filling the common part
+  logRecord* rec = &cell->rec;
+  rec->site = &site;
+  rec->text = text;
+  rec->stamp_ns = nowNs();
+  rec->suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+  rec->has_value = false;
+  rec->rows = 0;
+  rec->cols = 0;
+  return rec;
+}
+
+/* COMMIT */
+void asyncLogger::commit(logRecord* rec){
+  // The cell is the one containing the record
+  logCell* cell = reinterpret_cast<logCell*>(reinterpret_cast<char*>(rec) - offsetof(logCell, rec));
+  size_t seq = cell->seq.load(std::memory_order_relaxed);
+  cell->seq.store(seq + 1, std::memory_order_release);
+}
+
+/* PUSH (TEXT) */
+void asyncLogger::push(logSite& site, const char* text){
+  logRecord* rec = acquire(site, text);
+  if(rec != NULL) commit(rec);
+}
+
+/* PUSH (VALUE) */
+void asyncLogger::push(logSite& site, const char* text, double value){
+  logRecord* rec = acquire(site, text);
+  if(rec == NULL) return;
+  rec->has_value = true;
+  rec->value = value;
+  commit(rec);
+}
+
+/* SUBSCRIBELEVELTOPIC */
+void asyncLogger::subscribeLevelTopic(ros::NodeHandle& nh, std::string topic_name){
+  level_sub = nh.subscribe(topic_name, 1, &asyncLogger::levelCallback, this);
+}
+
+/* LEVELCALLBACK */
+void asyncLogger::levelCallback(const std_msgs::Int8::ConstPtr& msg){
+  if(msg->data < LOG_LEVEL_DEBUG || msg->data > LOG_LEVEL_OFF){
+    ROS_WARN_STREAM("asyncLogger::levelCallback : Unknown log level " << int(msg->data) << ". Ignoring it.");
+    return;
+  }
+  setVerbosity(logLevel(msg->data));
+  ROS_INFO_STREAM("asyncLogger::levelCallback : Log level set to " << int(msg->data) << ".");
+}
+
+/* WORKERLOOP */
+void asyncLogger::workerLoop(){
+  // Formatting the records in order (polling, this thread is not time critical)
+  while(running.load()){
+    logCell* cell = &cells[dequeue_pos % AG_LOG_RING_SIZE];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    if(intptr_t(seq) - intptr_t(dequeue_pos + 1) < 0){
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+    format(cell->rec);
+    cell->seq.store(dequeue_pos + AG_LOG_RING_SIZE, std::memory_order_release);
+    dequeue_pos++;
+  }
+}
+
+/* FORMAT */
+void asyncLogger::format(const logRecord& rec){
+  // Building the text (with the site, the optional value or matrix and the suppressed count)
+  std::ostringstream out;
+  out << rec.text;
+  if(rec.has_value) out << " " << rec.value;
+  if(rec.rows > 0 && rec.cols > 0){
+    int n = std::min(rec.rows * rec.cols, AG_LOG_MAX_VALUES);
+    Eigen::Map<const Eigen::MatrixXd> mat(rec.data, rec.rows, (n + rec.rows - 1) / rec.rows);
+    out << " (" << rec.rows << "x" << rec.cols << (n < rec.rows * rec.cols ? ", truncated" : "") << "):\n" << mat;
+  }
+  if(rec.suppressed > 0) out << " [" << rec.suppressed << " similar suppressed]";
+  out << " (" << rec.site->file << ":" << rec.site->line << ")";
+
+  switch(rec.site->level){
+    case LOG_LEVEL_ERROR: ROS_ERROR_STREAM(out.str()); break;
+    case LOG_LEVEL_WARN: ROS_WARN_STREAM(out.str()); break;
+    default: ROS_INFO_STREAM(out.str()); break;
+  }
+}
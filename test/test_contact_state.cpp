@@ -45,7 +45,8 @@ int main(int argc, char **argv)
     while(ros::ok()){
       ros::spinOnce();
 
-      // Reading the values of the contact_state_obj
+      // Applying the received touches and reading the values of the contact_state_obj
+      contact_state_obj.processPendingTouches();
       contact_state_obj.readValues(contacts_map_test, joints_map_test);
 
       // Couting the variables
@@ -0,0 +1,136 @@
+/* For testing the factorized solves of reversePriorityManager and stackOfTasksManager against solve_inv_kin */
+
+// Basic Includes
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <ros/ros.h>
+
+
+#include "task_utils/basicTask.h"
+#include "task_utils/reversePriorityManager.h"
+#include "task_utils/stackOfTasksManager.h"
+
+#define DIM_CONFIG      10          // Dimension of the configuration space of the tasks
+#define NUM_SETS        200         // Number of random task sets
+#define NUM_SOLVES      5           // Number of random task velocities solved with each factorization
+#define TOLERANCE       1e-12       // Maximum difference of the solutions
+
+// Builds a random task set (2 to 5 tasks, 1 to 7 rows, shuffled priorities) or, if tied, a larger one (more tasks
+// than a std::sort sorts by insertion) with priorities and secondary priorities drawn from two values each, so that
+// many tasks compare equal
+std::vector<basicTask> randomTaskSet(std::mt19937& gen, bool tied = false){
+    std::uniform_int_distribution<int> num_dist(tied ? 17 : 2, tied ? 24 : 5);
+    std::uniform_int_distribution<int> rows_dist(1, 7);
+    std::uniform_int_distribution<int> coin(0, 1);
+    int num_tasks = num_dist(gen);
+
+    std::vector<int> priorities(num_tasks);
+    for(int i = 0; i < num_tasks; i++) priorities[i] = i + 1;
+    std::shuffle(priorities.begin(), priorities.end(), gen);
+
+    std::vector<basicTask> task_vec;
+    for(int i = 0; i < num_tasks; i++){
+        basicTask tmp_task;
+        int rows = rows_dist(gen);
+        tmp_task.set_task_x_dot(Eigen::VectorXd::Random(rows));
+        tmp_task.set_task_jacobian(Eigen::MatrixXd::Random(rows, DIM_CONFIG));
+        tmp_task.set_task_priority(tied ? 1 + coin(gen) : priorities[i]);
+        tmp_task.set_sec_priority(coin(gen) ? 1 : 2);
+        task_vec.push_back(tmp_task);
+    }
+    return task_vec;
+}
+
+// Sets new random task velocities (returned in insertion order)
+std::vector<Eigen::VectorXd> randomVelocities(std::vector<basicTask>& task_vec){
+    std::vector<Eigen::VectorXd> x_dots;
+    for(auto& task : task_vec){
+        x_dots.push_back(Eigen::VectorXd::Random(task.get_task_jacobian().rows()));
+        task.set_task_x_dot(x_dots.back());
+    }
+    return x_dots;
+}
+
+int main(int argc, char **argv) {
+
+    // Starting the test node
+    std::cout<<std::endl;
+    std::cout<<"|Adaptive Grasping| -> Testing Factorized Inversion!"<<std::endl;
+    std::cout<<std::endl;
+
+    ros::init(argc, argv, "test_factorized_inversion");
+    ros::NodeHandle nh;
+
+    std::mt19937 gen(42);
+    std::srand(42);
+    double rp_max_diff = 0.0;
+    double sot_max_diff = 0.0;
+    int failures = 0;
+
+    for(int s = 0; s < NUM_SETS; s++){
+        // The second half of the sets has tied tasks (the order of equal tasks must be the same in both paths)
+        std::vector<basicTask> task_vec = randomTaskSet(gen, s >= NUM_SETS / 2);
+
+        // Factorizing the set once in both managers
+        reversePriorityManager rp_factorized(DIM_CONFIG, 1000, 0.1);
+        stackOfTasksManager sot_factorized(DIM_CONFIG, 1000, 0.1);
+        rp_factorized.insert_tasks(task_vec);
+        sot_factorized.insert_tasks(task_vec);
+        if(!rp_factorized.prepare_factorization() || !sot_factorized.prepare_factorization()){
+            ROS_ERROR_STREAM("Could not factorize the task set " << s << "!");
+            failures++;
+            continue;
+        }
+
+        // Solving new task velocities with the factorization and from scratch with solve_inv_kin
+        for(int k = 0; k < NUM_SOLVES; k++){
+            std::vector<Eigen::VectorXd> x_dots = randomVelocities(task_vec);
+
+            reversePriorityManager rp_manager(DIM_CONFIG, 1000, 0.1);
+            stackOfTasksManager sot_manager(DIM_CONFIG, 1000, 0.1);
+            rp_manager.insert_tasks(task_vec);
+            sot_manager.insert_tasks(task_vec);
+
+            Eigen::VectorXd rp_ref, rp_fact, sot_ref, sot_fact;
+            bool rp_ok = rp_manager.solve_inv_kin(rp_ref) && rp_factorized.solve_with_factorization(x_dots, rp_fact);
+            sot_manager.solve_inv_kin(sot_ref);
+            bool sot_ok = sot_factorized.solve_with_factorization(x_dots, sot_fact);
+            if(!rp_ok || !sot_ok){
+                ROS_ERROR_STREAM("Could not solve the task set " << s << "!");
+                failures++;
+                continue;
+            }
+
+            double rp_diff = (rp_ref - rp_fact).cwiseAbs().maxCoeff();
+            double sot_diff = (sot_ref - sot_fact).cwiseAbs().maxCoeff();
+            rp_max_diff = std::max(rp_max_diff, rp_diff);
+            sot_max_diff = std::max(sot_max_diff, sot_diff);
+            if(rp_diff > TOLERANCE || sot_diff > TOLERANCE){
+                ROS_ERROR_STREAM("The factorized solution of the task set " << s << " differs: RP " << rp_diff << ", SOT " << sot_diff << ".");
+                failures++;
+            }
+        }
+    }
+
+    // The factorization must not accept velocities of a different task set
+    reversePriorityManager rp_check(DIM_CONFIG, 1000, 0.1);
+    std::vector<basicTask> task_vec = randomTaskSet(gen);
+    rp_check.insert_tasks(task_vec);
+    rp_check.prepare_factorization();
+    std::vector<Eigen::VectorXd> x_dots = randomVelocities(task_vec);
+    x_dots.pop_back();
+    Eigen::VectorXd q_check;
+    if(rp_check.solve_with_factorization(x_dots, q_check)){
+        ROS_ERROR("The factorized solve accepted the velocities of a smaller task set!");
+        failures++;
+    }
+
+    ROS_INFO_STREAM("Maximum differences from solve_inv_kin on " << NUM_SETS << " task sets: RP " << rp_max_diff
+        << ", SOT " << sot_max_diff << ".");
+    if(failures > 0) ROS_ERROR_STREAM("Factorized Inversion Test failed " << failures << " checks!");
+    else ROS_INFO("Factorized Inversion Test passed!");
+
+    ROS_INFO("Exiting Factorized Inversion Test File");
+    return failures > 0 ? 1 : 0;
+}
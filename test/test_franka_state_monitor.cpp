@@ -0,0 +1,186 @@
+/* For testing frankaStateMonitor: its windowedStatistics against the brute force statistics of the same window (small
+ * capacity, wraparound, recompute of the sums and eviction of the peak), the still time and the age */
+
+// Basic Includes
+#include <iostream>
+#include <deque>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <ros/ros.h>
+
+
+#include "frankaStateMonitor.h"
+#include "utils/windowed_statistics.h"
+
+#define WINDOW          0.05        // The window of the statistics [s]
+#define CAPACITY        8           // A small capacity (the buffer wraps and the sums are recomputed every 8 pushes)
+#define NUM_SAMPLES     20000       // Number of random samples
+#define TOLERANCE       1e-12       // Maximum difference from the brute force statistics
+#define STATE_PERIOD    0.001       // The period of the franka states [s]
+#define STILL_THRESHOLD 0.005       // The joint speed below which the arm is still
+#define AGE_WAIT        0.05        // How long the age is checked after the last state [s]
+#define MARGIN          0.02        // Timing tolerance of the age [s]
+
+using namespace adaptive_grasping;
+
+int failures = 0;
+
+void check(bool condition, std::string what){
+    if(!condition){
+        ROS_ERROR_STREAM("Check failed: " << what << "!");
+        failures++;
+    }
+}
+
+// The same window kept in full: the samples within the window (the newest always stays) and at most capacity
+struct bruteWindow {
+    std::deque<std::pair<double, double>> samples;
+    void push(double value, double stamp){
+        while(!samples.empty() && (int(samples.size()) >= CAPACITY || samples.front().second < stamp - WINDOW)) samples.pop_front();
+        samples.push_back(std::make_pair(value, stamp));
+    }
+    double mean() const {
+        double sum = 0.0;
+        for(auto& sample : samples) sum += sample.first;
+        return samples.empty() ? 0.0 : sum / samples.size();
+    }
+    double variance() const {
+        if(samples.size() < 2) return 0.0;
+        double m = mean(), sum = 0.0;
+        for(auto& sample : samples) sum += (sample.first - m) * (sample.first - m);
+        return sum / samples.size();
+    }
+    double peak() const {
+        double max = -std::numeric_limits<double>::infinity();
+        for(auto& sample : samples) max = std::max(max, sample.first);
+        return samples.empty() ? 0.0 : max;
+    }
+    double span() const {
+        return samples.size() > 1 ? samples.back().second - samples.front().second : 0.0;
+    }
+};
+
+// The largest difference of all the statistics from the brute force ones (infinite if the count differs)
+double compare(const windowedStatistics& stats, const bruteWindow& brute){
+    if(stats.count() != int(brute.samples.size())) return std::numeric_limits<double>::infinity();
+    double rate = brute.span() > 0.0 ? (brute.samples.back().first - brute.samples.front().first) / brute.span() : 0.0;
+    double diff = std::abs(stats.mean() - brute.mean());
+    diff = std::max(diff, std::abs(stats.variance() - brute.variance()));
+    diff = std::max(diff, std::abs(stats.peak() - brute.peak()));
+    diff = std::max(diff, std::abs(stats.latest() - brute.samples.back().first));
+    diff = std::max(diff, std::abs(stats.span() - brute.span()));
+    diff = std::max(diff, std::abs(stats.rateOfChange() - rate) * brute.span());
+    return diff;
+}
+
+// Random samples with random stamp steps (some windows are limited by the capacity, some by the time)
+int testStatistics(){
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> value_dist(-1.0, 1.0);
+    std::uniform_real_distribution<double> step_dist(0.0, 2.0 * WINDOW / CAPACITY);
+
+    windowedStatistics stats;
+    stats.configure(WINDOW, CAPACITY);
+    bruteWindow brute;
+    double stamp = 0.0, max_diff = 0.0;
+    int mismatches = 0;
+    for(int n = 0; n < NUM_SAMPLES; n++){
+        // A large jump now and then empties the window down to the new sample
+        stamp += n % 1000 == 999 ? 2.0 * WINDOW : step_dist(gen);
+        double value = value_dist(gen);
+        stats.push(value, stamp);
+        brute.push(value, stamp);
+        double diff = compare(stats, brute);
+        max_diff = std::max(max_diff, diff);
+        if(diff > TOLERANCE) mismatches++;
+    }
+    ROS_INFO_STREAM("Statistics: " << mismatches << " of " << NUM_SAMPLES << " samples differ, maximum difference "
+        << max_diff << ".");
+    check(mismatches == 0, "the windowed statistics differ from the brute force ones");
+
+    // The peak is evicted when it leaves the window (also by time, with smaller samples after it)
+    stats.reset();
+    stats.push(10.0, 0.0);
+    for(int i = 1; i <= 3; i++) stats.push(1.0 * i, 0.01 * i);
+    check(stats.peak() == 10.0, "the peak is lost while in the window");
+    stats.push(0.5, WINDOW + 0.005);
+    check(stats.peak() == 3.0 && stats.count() == 4, "the peak is kept after leaving the window");
+
+    // And when the capacity pushes it out
+    stats.reset();
+    stats.push(10.0, 0.0);
+    for(int i = 1; i < CAPACITY; i++) stats.push(0.0, 0.0);
+    check(stats.peak() == 10.0 && stats.count() == CAPACITY, "the full window lost the peak");
+    stats.push(0.0, 0.0);
+    check(stats.peak() == 0.0 && stats.count() == CAPACITY, "the peak is kept after leaving the capacity");
+
+    return mismatches > 0 ? 1 : 0;
+}
+
+// Feeds franka states moving, still and moving again and checks the still time and the age
+void testMonitor(){
+    frankaStateMonitor monitor;
+    monitor.configure(WINDOW, frankaStateMonitor::JOINT_SPEED, STILL_THRESHOLD);
+    check(!monitor.isValid() && std::isinf(monitor.getAge()), "a monitor without states is valid");
+
+    double t = 0.0;
+    auto feed = [&](double speed, int steps){
+        for(int i = 0; i < steps; i++){
+            franka_msgs::FrankaState::Ptr state(new franka_msgs::FrankaState());
+            state->time = t;
+            state->dq[0] = speed;
+            state->O_T_EE[15] = 1.0;
+            monitor.update(state);
+            t += STATE_PERIOD;
+        }
+    };
+
+    // Moving: never still
+    feed(0.1, 100);
+    check(monitor.getStillTime() == 0.0, "a moving arm is still");
+
+    // Still from the first slow state: the still time is the robot time since it
+    double still_start = t;
+    feed(0.5 * STILL_THRESHOLD, 200);
+    double expected = (t - STATE_PERIOD) - still_start;
+    check(std::abs(monitor.getStillTime() - expected) < 1e-9, "the still time is not the time since the first slow state");
+    check(std::abs(monitor.getStatistics(frankaStateMonitor::JOINT_SPEED).mean() - 0.5 * STILL_THRESHOLD) < 1e-12,
+        "the joint speed statistics do not cover only the still states");
+
+    // A single fast state restarts the stillness
+    feed(0.1, 1);
+    check(monitor.getStillTime() == 0.0, "the stillness is not restarted by a fast state");
+    feed(0.5 * STILL_THRESHOLD, 10);
+    check(std::abs(monitor.getStillTime() - 9 * STATE_PERIOD) < 1e-9, "the stillness does not restart at the next slow state");
+
+    // The age is the time since the last state was received
+    check(monitor.isValid() && monitor.getAge() < MARGIN, "the age of a new state is not small");
+    std::this_thread::sleep_for(std::chrono::duration<double>(AGE_WAIT));
+    double age = monitor.getAge();
+    ROS_INFO_STREAM("Monitor: still time " << monitor.getStillTime() << " s, age " << age << " s after " << AGE_WAIT << " s.");
+    check(age >= AGE_WAIT && age < AGE_WAIT + MARGIN, "the age is not the time since the last state");
+}
+
+int main(int argc, char **argv) {
+
+    // Starting the test node
+    std::cout<<std::endl;
+    std::cout<<"|Adaptive Grasping| -> Testing Franka State Monitor!"<<std::endl;
+    std::cout<<std::endl;
+
+    ros::init(argc, argv, "test_franka_state_monitor");
+    ros::NodeHandle nh;
+
+    testStatistics();
+    testMonitor();
+
+    if(failures > 0) ROS_ERROR_STREAM("Franka State Monitor Test failed " << failures << " checks!");
+    else ROS_INFO("Franka State Monitor Test passed!");
+
+    ROS_INFO("Exiting Franka State Monitor Test File");
+    return failures > 0 ? 1 : 0;
+}
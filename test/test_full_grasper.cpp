@@ -0,0 +1,360 @@
+/* For testing fullGrasper against mock controller managers and franka states (see launch/testFullGrasper.launch):
+ * the controllers are switched once the arm is still, in parallel, and confirmed with list_controllers, a grasp
+ * cycle with an unknown object is aborted before moving, and the adaptive grasp task follows the EE pose, contacts,
+ * grasp signal and synergy events through its phases publishing the references only when changed or at their rate */
+
+// Basic Includes
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <vector>
+#include <ros/ros.h>
+#include <std_srvs/SetBool.h>
+#include <std_msgs/Int8.h>
+#include <std_msgs/Float64MultiArray.h>
+#include <sensor_msgs/JointState.h>
+#include <geometry_msgs/Pose.h>
+#include <franka_msgs/FrankaState.h>
+#include <controller_manager_msgs/SwitchController.h>
+#include <controller_manager_msgs/ListControllers.h>
+#include <controller_manager_msgs/LoadController.h>
+#include <actionlib/client/simple_action_client.h>
+#include <adaptive_grasping/GraspCycleAction.h>
+#include <adaptive_grasping/GraspSignal.h>
+#include <adaptive_grasping/adaptiveGrasp.h>
+
+
+#include "fullGrasper.h"
+#include "utils/parsing_utilities.h"
+
+#define SWITCH_DELAY    0.2         // How long a mock switch takes [s]
+#define CONFIRM_DELAY   0.1         // How long after the switch the controller is reported running [s]
+#define MOTION_TIME     0.3         // For how long the arm moves after the switch is requested [s]
+#define STATE_RATE      1000.0      // The rate of the franka states [Hz]
+#define MARGIN          0.05        // Timing tolerance [s]
+#define PHASE_TIME      0.3         // How long each phase of the grasp sequence is held before its next event [s]
+#define LIFT_DURATION   0.5         // The lift duration of the test (6 s in full_grasp_params.yaml) [s]
+#define FAR_Z           10.0        // The EE height far above (approaching) and below (overshoot) the grasp pose [m]
+
+using namespace adaptive_grasping;
+
+// The mock controller managers: the started controller of each robot, when it runs and when the switch was called
+std::mutex mock_mutex;
+std::map<std::string, std::string> started_controllers;
+std::map<std::string, double> running_since;
+std::map<std::string, double> switch_called;
+std::atomic<int> load_calls{0};
+
+double nowSec(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool mockSwitch(std::string robot, controller_manager_msgs::SwitchController::Request &req,
+    controller_manager_msgs::SwitchController::Response &res){
+    double called = nowSec();
+    std::this_thread::sleep_for(std::chrono::duration<double>(SWITCH_DELAY));
+    std::lock_guard<std::mutex> lock(mock_mutex);
+    switch_called[robot] = called;
+    started_controllers[robot] = req.start_controllers.empty() ? "" : req.start_controllers[0];
+    running_since[robot] = nowSec() + CONFIRM_DELAY;
+    res.ok = true;
+    return true;
+}
+
+bool mockList(std::string robot, controller_manager_msgs::ListControllers::Request &req,
+    controller_manager_msgs::ListControllers::Response &res){
+    std::lock_guard<std::mutex> lock(mock_mutex);
+    if(started_controllers.count(robot) == 0) return true;
+    controller_manager_msgs::ControllerState state;
+    state.name = started_controllers[robot];
+    state.state = nowSec() >= running_since[robot] ? "running" : "initialized";
+    res.controller.push_back(state);
+    return true;
+}
+
+bool mockLoad(controller_manager_msgs::LoadController::Request &req, controller_manager_msgs::LoadController::Response &res){
+    load_calls++;
+    res.ok = true;
+    return true;
+}
+
+bool armSwitch(controller_manager_msgs::SwitchController::Request &req, controller_manager_msgs::SwitchController::Response &res){
+    return mockSwitch("arm", req, res);
+}
+bool handSwitch(controller_manager_msgs::SwitchController::Request &req, controller_manager_msgs::SwitchController::Response &res){
+    return mockSwitch("hand", req, res);
+}
+bool armList(controller_manager_msgs::ListControllers::Request &req, controller_manager_msgs::ListControllers::Response &res){
+    return mockList("arm", req, res);
+}
+bool handList(controller_manager_msgs::ListControllers::Request &req, controller_manager_msgs::ListControllers::Response &res){
+    return mockList("hand", req, res);
+}
+
+// The mock adaptive grasper service (the run requests received) and the x_d references received with their time
+std::mutex ag_mutex;
+std::vector<bool> ag_requests;
+std::mutex ref_mutex;
+std::vector<std::pair<double, std::vector<double>>> x_d_received;
+
+bool mockAdaptiveGrasper(adaptive_grasping::adaptiveGrasp::Request &req, adaptive_grasping::adaptiveGrasp::Response &res){
+    std::lock_guard<std::mutex> lock(ag_mutex);
+    ag_requests.push_back(req.run_adaptive_grasp);
+    res.success = true;
+    return true;
+}
+
+void countReference(const std_msgs::Float64MultiArray::ConstPtr &msg){
+    std::lock_guard<std::mutex> lock(ref_mutex);
+    x_d_received.push_back(std::make_pair(nowSec(), msg->data));
+}
+
+int failures = 0;
+
+void check(bool condition, std::string what){
+    if(!condition){
+        ROS_ERROR_STREAM("Check failed: " << what << "!");
+        failures++;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    // Starting the test node
+    std::cout<<std::endl;
+    std::cout<<"|Adaptive Grasping| -> Testing Full Grasper!"<<std::endl;
+    std::cout<<std::endl;
+
+    ros::init(argc, argv, "test_full_grasper");
+    ros::NodeHandle nh;
+    ros::AsyncSpinner spinner(8);
+    spinner.start();
+
+    // The params of full_grasp_params.yaml used here
+    std::string arm_name = "panda_arm", hand_name = "right_hand";
+    double still_window = 0.1, still_timeout = 2.0;
+    ros::param::get("/full_grasper/arm_name", arm_name);
+    ros::param::get("/full_grasper/hand_name", hand_name);
+    ros::param::get("/full_grasper/still_window", still_window);
+    ros::param::get("/full_grasper/still_timeout", still_timeout);
+    ros::param::set("/full_grasper/still_source", std::string("dq"));
+    ros::param::set("/full_grasper/lift_duration", LIFT_DURATION);
+
+    // The mock controller managers of the arm and of the hand
+    ros::ServiceServer arm_switch_server = nh.advertiseService(arm_name + "/controller_manager/switch_controller", armSwitch);
+    ros::ServiceServer hand_switch_server = nh.advertiseService(hand_name + "/controller_manager/switch_controller", handSwitch);
+    ros::ServiceServer arm_list_server = nh.advertiseService(arm_name + "/controller_manager/list_controllers", armList);
+    ros::ServiceServer hand_list_server = nh.advertiseService(hand_name + "/controller_manager/list_controllers", handList);
+    ros::ServiceServer arm_load_server = nh.advertiseService(arm_name + "/controller_manager/load_controller", mockLoad);
+    ros::ServiceServer hand_load_server = nh.advertiseService(hand_name + "/controller_manager/load_controller", mockLoad);
+
+    // The franka states: the arm moves (dq) until motion_stop, then it is still (no states while publishing is false);
+    // the EE is at ee_z and, once set (not negative), the contacts and the synergy are published at the same rate
+    ros::Publisher pub_franka = nh.advertise<franka_msgs::FrankaState>("/" + arm_name + "/franka_state_controller/franka_states", 1);
+    ros::Publisher pub_contacts = nh.advertise<std_msgs::Int8>("/num_touches_contact_state", 1);
+    ros::Publisher pub_joints = nh.advertise<sensor_msgs::JointState>("/joint_states", 1);
+    std::atomic<bool> publishing{true}, feeding{true};
+    std::atomic<double> motion_stop{nowSec() + 1e9};
+    std::atomic<double> ee_z{0.0}, synergy{-1.0};
+    std::atomic<int> contacts{-1};
+    const double t_zero = nowSec();
+    std::thread feeder([&]{
+        franka_msgs::FrankaState state;
+        state.robot_mode = 2;
+        state.O_T_EE[0] = state.O_T_EE[5] = state.O_T_EE[10] = state.O_T_EE[15] = 1.0;
+        std_msgs::Int8 contacts_msg;
+        sensor_msgs::JointState joints_msg;
+        joints_msg.name.push_back("right_hand_synergy_joint");
+        joints_msg.position.push_back(0.0);
+        while(feeding && ros::ok()){
+            if(publishing){
+                state.time = nowSec() - t_zero;
+                state.dq[0] = nowSec() < motion_stop ? 0.1 : 0.0;
+                state.O_T_EE[14] = ee_z;
+                pub_franka.publish(state);
+            }
+            if(contacts >= 0){
+                contacts_msg.data = contacts;
+                pub_contacts.publish(contacts_msg);
+            }
+            if(synergy >= 0.0){
+                joints_msg.position[0] = synergy;
+                pub_joints.publish(joints_msg);
+            }
+            std::this_thread::sleep_for(std::chrono::duration<double>(1.0 / STATE_RATE));
+        }
+    });
+
+    // The full grasper (in this node, served by the spinner)
+    fullGrasper full_grasper(arm_name, hand_name, {"joint_trajectory_controller", "joint_trajectory_controller"},
+        {"cartesian_velocity_controller", "velocity_controller"});
+    check(ros::service::waitForService("switch_pos2vel_service", ros::Duration(5.0)), "the switch service is not advertised");
+
+    // 1) Switching while the arm moves: the switches wait for the stillness, run in parallel and are confirmed
+    std_srvs::SetBool switch_srv;
+    switch_srv.request.data = true;
+    double t_call = nowSec();
+    motion_stop = t_call + MOTION_TIME;
+    bool ok = ros::service::call("switch_pos2vel_service", switch_srv);
+    double t_done = nowSec();
+    ROS_INFO_STREAM("pos2vel took " << t_done - t_call << " s: " << switch_srv.response.message);
+    check(ok && switch_srv.response.success, "the switch to the velocity controllers failed");
+    {
+        std::lock_guard<std::mutex> lock(mock_mutex);
+        check(switch_called.count("arm") && switch_called.count("hand"), "a controller manager was not called");
+        double settled = motion_stop + still_window - MARGIN;
+        check(switch_called["arm"] >= settled && switch_called["hand"] >= settled, "a switch started while the arm moved");
+        check(std::abs(switch_called["arm"] - switch_called["hand"]) < MARGIN, "the switches did not run in parallel");
+        check(t_done >= running_since["arm"] && t_done >= running_since["hand"], "the call returned before the controllers ran");
+    }
+    check(t_done - t_call < MOTION_TIME + still_window + SWITCH_DELAY + CONFIRM_DELAY + 4.0 * MARGIN,
+        "the switch took longer than settling, one switch and the confirmation");
+
+    // 2) Switching back without franka states: the arm is not known to be still, switching anyway after the timeout
+    publishing = false;
+    std::this_thread::sleep_for(std::chrono::duration<double>(2.0 * still_window));
+    switch_srv.response = std_srvs::SetBool::Response();
+    t_call = nowSec();
+    ok = ros::service::call("switch_vel2pos_service", switch_srv);
+    t_done = nowSec();
+    ROS_INFO_STREAM("vel2pos took " << t_done - t_call << " s: " << switch_srv.response.message);
+    check(ok && switch_srv.response.success, "the switch to the position controllers failed");
+    check(switch_srv.response.message.find("(timeout)") != std::string::npos, "the settle timeout is not reported");
+    check(t_done - t_call >= still_timeout - MARGIN, "the switch did not wait for the settle timeout");
+
+    // 3) A grasp cycle with an unknown object: aborted before any phase (no feedback, no controller calls)
+    typedef actionlib::SimpleActionClient<adaptive_grasping::GraspCycleAction> CycleClient;
+    CycleClient cycle_client("grasp_cycle", true);
+    check(cycle_client.waitForServer(ros::Duration(5.0)), "the grasp cycle server is not available");
+    adaptive_grasping::GraspCycleGoal cycle_goal;
+    XmlRpc::XmlRpcValue poses_map;
+    if(ros::param::get("/full_grasper/poses_map", poses_map) && poses_map.getType() == XmlRpc::XmlRpcValue::TypeStruct
+        && poses_map.size() > 0) cycle_goal.objects.push_back(poses_map.begin()->first);
+    cycle_goal.objects.push_back("not_an_object");
+    std::atomic<int> cycle_feedbacks{0};
+    int loads_before = load_calls;
+    std::map<std::string, double> switches_before;
+    {
+        std::lock_guard<std::mutex> lock(mock_mutex);
+        switches_before = switch_called;
+    }
+    cycle_client.sendGoal(cycle_goal, CycleClient::SimpleDoneCallback(), CycleClient::SimpleActiveCallback(),
+        [&](const adaptive_grasping::GraspCycleFeedbackConstPtr& feedback){ cycle_feedbacks++; });
+    check(cycle_client.waitForResult(ros::Duration(5.0)), "the grasp cycle did not end");
+    ROS_INFO_STREAM("Grasp cycle with an unknown object: " << cycle_client.getState().toString() << " ("
+        << cycle_client.getState().getText() << ")");
+    check(cycle_client.getState() == actionlib::SimpleClientGoalState::ABORTED, "the unknown object was not aborted");
+    check(cycle_feedbacks == 0, "a phase was executed before the abort");
+    check(load_calls == loads_before, "a controller was loaded before the abort");
+    {
+        std::lock_guard<std::mutex> lock(mock_mutex);
+        check(switch_called == switches_before, "a controller was switched before the abort");
+    }
+
+    // 4) The adaptive grasp task driven by its events (franka states, contacts and synergy at STATE_RATE): approach until
+    // the EE is below the grasp pose, pivot with one contact, restrain with two, close at the grasp signal holding the
+    // restrain reference and lift at the synergy; each reference must follow its event at once and be republished
+    // only at reference_rate, not at the rate of the events
+    double reference_rate = 50.0;
+    ros::param::get("/full_grasper/reference_rate", reference_rate);
+    XmlRpc::XmlRpcValue seq_params;
+    std::map<std::string, std::vector<double>> approach_map, adaptive_map, restrain_map, lift_map;
+    ros::param::get("/full_grasper", seq_params);
+    parseParameter(seq_params, approach_map, "approach_ref_map");
+    parseParameter(seq_params, adaptive_map, "adaptive_ref_map");
+    parseParameter(seq_params, restrain_map, "restrain_ref_map");
+    parseParameter(seq_params, lift_map, "lift_ref_map");
+    std::vector<double> null_x_d(7, 0.0);
+    std::vector<double> approach_x_d = approach_map["sigma_d"];
+    approach_x_d.insert(approach_x_d.end(), {0.0, 0.0, approach_map["vel_p_d"].empty() ? 0.0 : approach_map["vel_p_d"][0], 0.0, 0.0, 0.0});
+
+    ros::ServiceServer ag_server = nh.advertiseService("adaptive_grasper_service", mockAdaptiveGrasper);
+    ros::Subscriber x_d_sub = nh.subscribe("/x_d_reference", 100, countReference);
+    ros::Publisher pub_object = nh.advertise<geometry_msgs::Pose>("/object_pose", 1, true);
+    ros::Publisher pub_signal = nh.advertise<adaptive_grasping::GraspSignal>("adaptive_grasping_signal", 1, true);
+    geometry_msgs::Pose object_pose;
+    object_pose.orientation.w = 1.0;
+    pub_object.publish(object_pose);
+    ee_z = FAR_Z;
+    contacts = 1;
+    synergy = 0.0;
+    publishing = true;
+    std::this_thread::sleep_for(std::chrono::duration<double>(2.0 * PHASE_TIME));
+
+    // The events: task call, EE below the grasp pose, second contact, grasp signal, synergy over close_synergy
+    std::vector<double> events;
+    std_srvs::SetBool task_srv;
+    task_srv.request.data = true;
+    std::atomic<bool> task_ok{false};
+    std::atomic<double> task_done{0.0};
+    events.push_back(nowSec());
+    std::thread task([&]{
+        task_ok = ros::service::call("adaptive_task_service", task_srv);
+        task_done = nowSec();
+    });
+    std::this_thread::sleep_for(std::chrono::duration<double>(PHASE_TIME));
+    events.push_back(nowSec());
+    ee_z = -FAR_Z;
+    std::this_thread::sleep_for(std::chrono::duration<double>(PHASE_TIME));
+    events.push_back(nowSec());
+    contacts = 2;
+    std::this_thread::sleep_for(std::chrono::duration<double>(PHASE_TIME));
+    events.push_back(nowSec());
+    adaptive_grasping::GraspSignal signal_msg;
+    signal_msg.reason = adaptive_grasping::GraspSignal::HAND_CLOSED;
+    pub_signal.publish(signal_msg);
+    std::this_thread::sleep_for(std::chrono::duration<double>(PHASE_TIME));
+    events.push_back(nowSec());
+    synergy = 1.0;
+    task.join();
+    contacts = -1;
+    synergy = -1.0;
+    check(task_ok && task_srv.response.success, "the adaptive grasp task failed");
+    check(std::abs(task_done - (events[4] + LIFT_DURATION)) < MARGIN, "the task did not end after the lift duration");
+    {
+        std::lock_guard<std::mutex> lock(ag_mutex);
+        check(ag_requests == std::vector<bool>({true, false}), "the adaptive grasper was not started and stopped once");
+    }
+
+    // The references in runs of equal x_d: approach, null, pivot, restrain (held while closing), lift and null
+    struct referenceRun { std::vector<double> x_d; double start, end; int count; };
+    std::vector<referenceRun> runs;
+    int total = 0;
+    {
+        std::lock_guard<std::mutex> lock(ref_mutex);
+        total = x_d_received.size();
+        for(auto& received : x_d_received){
+            if(runs.empty() || runs.back().x_d != received.second) runs.push_back({received.second, received.first, received.first, 0});
+            runs.back().end = received.first;
+            runs.back().count++;
+        }
+    }
+    ROS_INFO_STREAM("Grasp sequence: " << total << " x_d references in " << task_done - events[0] << " s ("
+        << runs.size() << " runs) with events at " << STATE_RATE << " Hz.");
+    std::vector<std::vector<double>> expected_x_d = {approach_x_d, null_x_d, adaptive_map["x_d"], restrain_map["x_d"],
+        lift_map["x_d"], null_x_d};
+    std::vector<double> expected_start = {events[0], events[1], events[1], events[2], events[4], events[4] + LIFT_DURATION};
+    std::vector<double> held = {PHASE_TIME, 0.0, PHASE_TIME, 2.0 * PHASE_TIME, LIFT_DURATION, 0.0};
+    check(runs.size() == expected_x_d.size(), "the references did not follow the phases");
+    for(int i = 0; i < int(std::min(runs.size(), expected_x_d.size())); i++){
+        check(runs[i].x_d == expected_x_d[i], "the reference of run " + std::to_string(i) + " is not the one of its phase");
+        check(runs[i].start >= expected_start[i] - MARGIN && runs[i].start < expected_start[i] + MARGIN,
+            "the reference of run " + std::to_string(i) + " did not follow its event");
+        check(runs[i].count <= held[i] * reference_rate + 2 && runs[i].count >= 0.5 * held[i] * reference_rate,
+            "the reference of run " + std::to_string(i) + " was not republished at the reference rate");
+    }
+
+    feeding = false;
+    feeder.join();
+
+    if(failures > 0) ROS_ERROR_STREAM("Full Grasper Test failed " << failures << " checks!");
+    else ROS_INFO("Full Grasper Test passed!");
+
+    ROS_INFO("Exiting Full Grasper Test File");
+    spinner.stop();
+    return failures > 0 ? 1 : 0;
+}
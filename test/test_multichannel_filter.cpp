@@ -0,0 +1,118 @@
+/* For testing multiChannelFilter against a filters::FilterChain<double> per channel (loaded with filter_chain.yaml,
+ * see launch/testMultiChannelFilter.launch) */
+
+// Basic Includes
+#include <iostream>
+#include <random>
+#include <cmath>
+#include <memory>
+#include <ros/ros.h>
+#include <filters/filter_chain.h>
+
+
+#include "utils/multichannel_filter.h"
+
+#define CHANNELS        7           // As the references of robotCommander
+#define NUM_SAMPLES     20000       // Number of random samples filtered
+
+// A biquad stage in the filters package format (one coefficient list, or one list per channel if per_channel)
+XmlRpc::XmlRpcValue biquadStage(std::string name, int first_channel, int channels, bool per_channel){
+    XmlRpc::XmlRpcValue stage;
+    stage["name"] = name;
+    stage["type"] = "filters/TransferFunctionFilterDouble";
+    XmlRpc::XmlRpcValue& a = stage["params"]["a"];
+    XmlRpc::XmlRpcValue& b = stage["params"]["b"];
+    for(int c = 0; c < channels; c++){
+        // A stable low pass biquad (poles at radius r, a0 not normalized) different for every channel
+        int k = first_channel + c;
+        double r = 0.5 + 0.02 * k, w = 0.1 * (k + 1), a0 = 1.0 + 0.1 * (k % CHANNELS);
+        XmlRpc::XmlRpcValue a_row, b_row;
+        a_row[0] = a0; a_row[1] = -2.0 * r * std::cos(w) * a0; a_row[2] = r * r * a0;
+        b_row[0] = 0.2; b_row[1] = 0.4; b_row[2] = 0.2;
+        if(per_channel){
+            a[c] = a_row;
+            b[c] = b_row;
+        } else {
+            a = a_row;
+            b = b_row;
+        }
+    }
+    return stage;
+}
+
+// Sets the per channel biquad chain: one chain per channel for the FilterChains and one for multiChannelFilter
+void setBiquadChains(ros::NodeHandle& nh){
+    XmlRpc::XmlRpcValue multi_chain;
+    multi_chain[0] = biquadStage("first_biquad", 0, CHANNELS, true);
+    multi_chain[1] = biquadStage("second_biquad", CHANNELS, CHANNELS, true);
+    nh.setParam("test_biquad_filter", multi_chain);
+    for(int c = 0; c < CHANNELS; c++){
+        XmlRpc::XmlRpcValue chain;
+        chain[0] = biquadStage("first_biquad", c, 1, false);
+        chain[1] = biquadStage("second_biquad", CHANNELS + c, 1, false);
+        nh.setParam("test_biquad_filter_" + std::to_string(c), chain);
+    }
+}
+
+// Filters random samples with both and counts the samples which are not bitwise identical
+int compareChains(ros::NodeHandle& nh, std::string multi_param, std::vector<std::string> chain_params){
+    std::vector<std::shared_ptr<filters::FilterChain<double>>> chains;
+    for(int c = 0; c < CHANNELS; c++){
+        chains.push_back(std::make_shared<filters::FilterChain<double>>("double"));
+        if(!chains.back()->configure(chain_params[c], nh)){
+            ROS_ERROR_STREAM("Could not configure the FilterChain " << chain_params[c] << "!");
+            return 1;
+        }
+    }
+    multiChannelFilter multi_filter;
+    if(!multi_filter.configure(CHANNELS, multi_param, nh)){
+        ROS_ERROR_STREAM("Could not configure the multiChannelFilter " << multi_param << "!");
+        return 1;
+    }
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    Eigen::VectorXd in(CHANNELS), out(CHANNELS), expected(CHANNELS);
+    int mismatches = 0;
+    double max_diff = 0.0;
+    for(int n = 0; n < NUM_SAMPLES; n++){
+        // Random samples with some steps (held inputs) as the references
+        if(n % 100 < 50) for(int c = 0; c < CHANNELS; c++) in(c) = dist(gen);
+        for(int c = 0; c < CHANNELS; c++) chains[c]->update(in(c), expected(c));
+        multi_filter.update(in, out);
+        if((out.array() != expected.array()).any()) mismatches++;
+        max_diff = std::max(max_diff, (out - expected).cwiseAbs().maxCoeff());
+    }
+
+    ROS_INFO_STREAM(multi_param << " (" << multi_filter.getStages() << " stages): " << mismatches << " of " << NUM_SAMPLES
+        << " samples differ, maximum difference " << max_diff << ".");
+    return mismatches > 0 ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+
+    // Starting the test node
+    std::cout<<std::endl;
+    std::cout<<"|Adaptive Grasping| -> Testing Multi Channel Filter!"<<std::endl;
+    std::cout<<std::endl;
+
+    ros::init(argc, argv, "test_multichannel_filter");
+    ros::NodeHandle nh;
+
+    int failures = 0;
+
+    // The low_pass_filter chain of filter_chain.yaml, shared by all the channels (as in robotCommander)
+    failures += compareChains(nh, "low_pass_filter", std::vector<std::string>(CHANNELS, "low_pass_filter"));
+
+    // Two cascaded biquads with different (not normalized) coefficients for every channel
+    setBiquadChains(nh);
+    std::vector<std::string> biquad_params;
+    for(int c = 0; c < CHANNELS; c++) biquad_params.push_back("test_biquad_filter_" + std::to_string(c));
+    failures += compareChains(nh, "test_biquad_filter", biquad_params);
+
+    if(failures > 0) ROS_ERROR_STREAM("Multi Channel Filter Test failed " << failures << " checks!");
+    else ROS_INFO("Multi Channel Filter Test passed!");
+
+    ROS_INFO("Exiting Multi Channel Filter Test File");
+    return failures > 0 ? 1 : 0;
+}
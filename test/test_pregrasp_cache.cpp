@@ -0,0 +1,162 @@
+/* For testing preGraspCache: hits, misses, rejected entries, eviction, reload from the file, malformed files and the
+ * directory of a relative file */
+
+// Basic Includes
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+#include <ros/ros.h>
+
+
+#include "preGraspCache.h"
+
+#define POSITION_QUANTUM    0.005       // The cache params of full_grasp_params.yaml
+#define ANGLE_QUANTUM       0.05
+#define START_TOLERANCE     0.01
+#define MAX_ENTRIES         3
+
+using namespace adaptive_grasping;
+
+int failures = 0;
+
+void check(bool condition, std::string what){
+    if(!condition){
+        ROS_ERROR_STREAM("Check failed: " << what << "!");
+        failures++;
+    }
+}
+
+Eigen::Affine3d makePose(double x, double y, double z, double yaw){
+    Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+    pose.translation() << x, y, z;
+    pose.linear() = Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+    return pose;
+}
+
+int main(int argc, char **argv) {
+
+    // Starting the test node
+    std::cout<<std::endl;
+    std::cout<<"|Adaptive Grasping| -> Testing Pre-Grasp Cache!"<<std::endl;
+    std::cout<<std::endl;
+
+    ros::init(argc, argv, "test_pregrasp_cache");
+    ros::NodeHandle nh;
+
+    std::string file = "/tmp/adaptive_grasping_test_pregrasp_cache_" + std::to_string(getpid()) + ".txt";
+    std::remove(file.c_str());
+
+    // The object, its pre-grasp pose (10 cm above it) and the joints
+    Eigen::Affine3d object_pose = makePose(0.5, 0.1, 0.02, 0.3);
+    Eigen::Affine3d target = object_pose * makePose(0.0, 0.0, 0.1, 0.0);
+    std::vector<double> start_joints = {0.0, -0.785, 0.0, -2.356, 0.0, 1.571, 0.785};
+    std::vector<double> pregrasp_joints = {0.1, -0.5, 0.05, -2.0, 0.02, 1.6, 0.9};
+    std::vector<double> joints;
+
+    {
+        preGraspCache cache;
+        cache.configure(POSITION_QUANTUM, ANGLE_QUANTUM, START_TOLERANCE, MAX_ENTRIES, file);
+        check(!cache.load(), "a missing file is loaded");
+
+        // The first call plans (miss), the second one for the same object and pose uses the stored joints (hit)
+        std::string key = cache.makeKey("mug", object_pose);
+        check(!cache.lookup(key, start_joints, target, joints), "an empty cache hits");
+        cache.store(key, start_joints, target, pregrasp_joints);
+        check(cache.lookup(cache.makeKey("mug", object_pose), start_joints, target, joints), "the same object and pose miss");
+        check(joints == pregrasp_joints, "the hit returns other joints");
+
+        // A small start difference still hits, a different start state is rejected
+        std::vector<double> near_start = start_joints;
+        near_start[3] += 0.5 * START_TOLERANCE;
+        check(cache.lookup(key, near_start, target, joints), "a start within the tolerance misses");
+        std::vector<double> other_start = start_joints;
+        other_start[3] += 0.2;
+        check(!cache.lookup(key, other_start, target, joints), "a different start state hits");
+        check(cache.getRejects() == 1, "the different start state is not counted as rejected");
+
+        // The object moved by 2 cm or rotated by 0.2 rad: another key (miss)
+        Eigen::Affine3d moved_pose = makePose(0.52, 0.1, 0.02, 0.3);
+        Eigen::Affine3d rotated_pose = makePose(0.5, 0.1, 0.02, 0.5);
+        check(cache.makeKey("mug", moved_pose) != key, "a 2 cm move has the same key");
+        check(!cache.lookup(cache.makeKey("mug", moved_pose), start_joints, moved_pose * makePose(0.0, 0.0, 0.1, 0.0), joints),
+            "a 2 cm move hits");
+        check(cache.makeKey("mug", rotated_pose) != key, "a 0.2 rad rotation has the same key");
+
+        // Another object in the same pose is another entry
+        check(cache.makeKey("bottle", object_pose) != key, "another object has the same key");
+
+        // The same key with a target out of the quanta (e.g. another pre-grasp offset) is rejected
+        check(!cache.lookup(key, start_joints, object_pose * makePose(0.0, 0.0, 0.15, 0.0), joints),
+            "another target hits");
+
+        // The least recently used entries are evicted above the maximum
+        for(int i = 0; i < MAX_ENTRIES; i++){
+            Eigen::Affine3d pose = makePose(0.3, -0.1 * i, 0.02, 0.0);
+            cache.store(cache.makeKey("box_" + std::to_string(i), pose), start_joints, pose, pregrasp_joints);
+        }
+        check(cache.getSize() == MAX_ENTRIES, "the cache grows over the maximum");
+        check(!cache.lookup(key, start_joints, target, joints), "the least recently used entry is not evicted");
+
+        ROS_INFO_STREAM("First instance: " << cache.getReport() << ".");
+    }
+
+    // A new instance reloads the entries from the file
+    {
+        preGraspCache cache;
+        cache.configure(POSITION_QUANTUM, ANGLE_QUANTUM, START_TOLERANCE, MAX_ENTRIES, file);
+        check(cache.load(), "the file is not loaded");
+        check(cache.getSize() == MAX_ENTRIES, "the entries are not reloaded");
+        Eigen::Affine3d pose = makePose(0.3, -0.1 * (MAX_ENTRIES - 1), 0.02, 0.0);
+        check(cache.lookup(cache.makeKey("box_" + std::to_string(MAX_ENTRIES - 1), pose), start_joints, pose, joints),
+            "a reloaded entry misses");
+        check(joints == pregrasp_joints, "a reloaded entry returns other joints");
+
+        // An invalidated entry (e.g. the joint goal failed) is removed from the file too
+        cache.invalidate(cache.makeKey("box_" + std::to_string(MAX_ENTRIES - 1), pose));
+        preGraspCache reloaded;
+        reloaded.configure(POSITION_QUANTUM, ANGLE_QUANTUM, START_TOLERANCE, MAX_ENTRIES, file);
+        reloaded.load();
+        check(reloaded.getSize() == MAX_ENTRIES - 1, "the invalidated entry is still in the file");
+
+        ROS_INFO_STREAM("Reloaded instance: " << cache.getReport() << ".");
+    }
+
+    // A corrupt or edited file: the lines with a wrong number of joints (or a size which would not fit in memory) are
+    // skipped without allocating, the valid one is loaded
+    {
+        std::ofstream out(file);
+        out << "# key n start_joints[n] x y z qx qy qz qw m joints[m] last_use" << std::endl;
+        out << "huge 100000000000000 0.0 0.0" << std::endl;
+        out << "negative -1 0.0" << std::endl;
+        out << "eight 8 0 0 0 0 0 0 0 0 0.3 0.0 0.1 0 0 0 1 8 0 0 0 0 0 0 0 0 1" << std::endl;
+        out << "big_joints 7 0 0 0 0 0 0 0 0.3 0.0 0.1 0 0 0 1 100000000000000 0 2" << std::endl;
+        out << "valid 7 0 0 0 0 0 0 0 0.3 0.0 0.1 0 0 0 1 7 0 0 0 0 0 0 0 3" << std::endl;
+    }
+    {
+        preGraspCache cache;
+        cache.configure(POSITION_QUANTUM, ANGLE_QUANTUM, START_TOLERANCE, MAX_ENTRIES, file);
+        check(cache.load(), "the malformed file is not loaded");
+        check(cache.getSize() == 1, "a malformed line is loaded");
+    }
+    std::remove(file.c_str());
+
+    // A relative file is taken in $ROS_HOME (not in the working directory of the node)
+    {
+        std::string name = "adaptive_grasping_test_pregrasp_cache_relative_" + std::to_string(getpid()) + ".txt";
+        setenv("ROS_HOME", "/tmp", 1);
+        preGraspCache cache;
+        cache.configure(POSITION_QUANTUM, ANGLE_QUANTUM, START_TOLERANCE, MAX_ENTRIES, name);
+        cache.store(cache.makeKey("mug", object_pose), start_joints, target, pregrasp_joints);
+        check(std::ifstream("/tmp/" + name).is_open(), "the relative file is not written in $ROS_HOME");
+        std::remove(("/tmp/" + name).c_str());
+        std::remove(name.c_str());
+    }
+
+    if(failures > 0) ROS_ERROR_STREAM("Pre-Grasp Cache Test failed " << failures << " checks!");
+    else ROS_INFO("Pre-Grasp Cache Test passed!");
+
+    ROS_INFO("Exiting Pre-Grasp Cache Test File");
+    return failures > 0 ? 1 : 0;
+}
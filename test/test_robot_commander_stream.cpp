@@ -0,0 +1,271 @@
+/* For testing the streaming mode of robotCommander: the newest reference of all the sources, the watchdog and the
+ * interpolation of the preview */
+
+// Basic Includes
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#include <ros/ros.h>
+#include <geometry_msgs/Twist.h>
+
+
+#include "robotCommander.h"
+
+#define STREAM_RATE     1000.0      // The rate of the output thread [Hz]
+#define POST_RATE       100.0       // The rate of the posted references [Hz]
+#define POST_TIME       0.2         // For how long the references are posted [s]
+#define STALE_TIMEOUT   0.05        // The watchdog params [s]
+#define HOLD_TIME       0.2
+#define DECAY_TIME      0.05
+#define VALUE           0.1         // The posted twist component
+#define MARGIN          0.005       // The samples closer than this to a transition are not checked [s]
+#define TOLERANCE       0.01        // Maximum difference from the expected output
+#define RAMP_SLOPE      0.5         // The slope of the previewed ramp [1/s]
+#define RAMP_TOLERANCE  0.002       // Maximum difference from the previewed ramp
+
+using namespace adaptive_grasping;
+
+// The received twists (linear x) with their arrival time
+std::mutex samples_mutex;
+std::vector<std::pair<double, double>> samples;
+
+double nowSec(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void twistCallback(const geometry_msgs::Twist::ConstPtr& msg){
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    samples.push_back(std::make_pair(nowSec(), msg->linear.x));
+}
+
+void clearSamples(){
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    samples.clear();
+}
+
+double lastSample(){
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    return samples.empty() ? NAN : samples.back().second;
+}
+
+void sleepFor(double seconds){
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+// Sets the streaming params of the commander (read by its constructor)
+void setStreamParams(ros::NodeHandle& nh, std::string mode, std::string interpolation = "linear"){
+    nh.setParam("robot_commander/streaming", true);
+    nh.setParam("robot_commander/enable_filter", false);
+    nh.setParam("robot_commander/vel_limit", 1.0);
+    nh.setParam("robot_commander/stream_rate", STREAM_RATE);
+    nh.setParam("robot_commander/stale_timeout", STALE_TIMEOUT);
+    nh.setParam("robot_commander/hold_time", HOLD_TIME);
+    nh.setParam("robot_commander/decay_time", DECAY_TIME);
+    nh.setParam("robot_commander/watchdog_mode", mode);
+    nh.setParam("robot_commander/interpolation", interpolation);
+    nh.setParam("robot_commander/diagnostics_rate", 0.0);
+}
+
+// Waits for the commander to be connected to the subscriber
+bool waitForConnection(ros::Subscriber& sub){
+    for(int i = 0; i < 200 && sub.getNumPublishers() == 0; i++) sleepFor(0.01);
+    return sub.getNumPublishers() > 0;
+}
+
+// The expected output of the watchdog after the reference became stale (stale_for > 0)
+double expectedStale(std::string mode, double stale_for){
+    if(mode == "hold") return stale_for > HOLD_TIME ? 0.0 : VALUE;
+    if(mode == "decay") return VALUE * std::exp(-stale_for / DECAY_TIME);
+    return 0.0;
+}
+
+// Posts references at POST_RATE, stops and checks the watchdog output against the expected one
+int testWatchdog(ros::NodeHandle& nh, std::string mode){
+    setStreamParams(nh, mode);
+    ros::Subscriber sub = nh.subscribe("stream_test/arm_" + mode, 1000, twistCallback);
+    robotCommander commander("stream_test/hand_" + mode, "stream_test/arm_" + mode, true);
+    if(!waitForConnection(sub)){
+        ROS_ERROR_STREAM("The commander in " << mode << " mode did not connect!");
+        return 1;
+    }
+
+    Eigen::Matrix<double, 7, 1> x_ref = Eigen::Matrix<double, 7, 1>::Zero();
+    x_ref(1) = VALUE;
+    double last_post = 0.0;
+    for(int i = 0; i < int(POST_TIME * POST_RATE); i++){
+        commander.post(x_ref);
+        last_post = nowSec();
+        sleepFor(1.0 / POST_RATE);
+    }
+    sleepFor(STALE_TIMEOUT + HOLD_TIME + 0.1);
+
+    // Checking the samples after the last post (away from the transitions)
+    int failures = 0, checked = 0;
+    double max_error = 0.0;
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    for(auto& sample : samples){
+        double stale_for = sample.first - last_post - STALE_TIMEOUT;
+        if(sample.first < last_post || std::abs(stale_for) < MARGIN) continue;
+        if(mode == "hold" && std::abs(stale_for - HOLD_TIME) < MARGIN) continue;
+        double expected = stale_for < 0.0 ? VALUE : expectedStale(mode, stale_for);
+        double error = std::abs(sample.second - expected);
+        max_error = std::max(max_error, error);
+        checked++;
+        if(error > TOLERANCE) failures++;
+    }
+    samples.clear();
+
+    ROS_INFO_STREAM("Watchdog " << mode << ": " << checked << " samples checked, maximum error " << max_error << ".");
+    if(checked == 0 || failures > 0){
+        ROS_ERROR_STREAM("The watchdog in " << mode << " mode failed on " << failures << " samples!");
+        return 1;
+    }
+    return 0;
+}
+
+// Posts from several sources and checks that the newest one (by arrival time) is followed
+int testSources(ros::NodeHandle& nh){
+    setStreamParams(nh, "hold");
+    ros::Subscriber sub = nh.subscribe("stream_test/arm_sources", 1000, twistCallback);
+    robotCommander commander("stream_test/hand_sources", "stream_test/arm_sources", true);
+    if(!waitForConnection(sub)){
+        ROS_ERROR("The commander for the sources test did not connect!");
+        return 1;
+    }
+
+    int failures = 0;
+    Eigen::Matrix<double, 7, 1> x_ref = Eigen::Matrix<double, 7, 1>::Zero();
+
+    // An older reference (shifted back by its latency) of another source does not replace the newest one
+    x_ref(1) = 0.01;
+    commander.queueReference(robotCommander::SOURCE_COMMAND_TOPIC, x_ref);
+    x_ref(1) = 0.02;
+    commander.queueReference(robotCommander::SOURCE_SERVICE, x_ref, nullptr, nullptr, 0, 0.02);
+    sleepFor(0.02);
+    if(lastSample() != 0.01){
+        ROS_ERROR_STREAM("An older reference of another source replaced the newest one (sent " << lastSample() << ")!");
+        failures++;
+    }
+
+    // A newer reference of any source is followed
+    x_ref(1) = 0.03;
+    commander.queueReference(robotCommander::SOURCE_PREVIEW_TOPIC, x_ref);
+    sleepFor(0.02);
+    if(lastSample() != 0.03){
+        ROS_ERROR_STREAM("The newest reference was not followed (sent " << lastSample() << ")!");
+        failures++;
+    }
+
+    // Bursts of a source overwrite each other: only the last one is sent
+    for(int i = 1; i <= 100; i++){
+        x_ref(1) = 0.001 * i;
+        commander.queueReference(robotCommander::SOURCE_IN_PROCESS, x_ref);
+    }
+    sleepFor(0.02);
+    if(lastSample() != 0.001 * 100){
+        ROS_ERROR_STREAM("The last reference of a burst was not followed (sent " << lastSample() << ")!");
+        failures++;
+    }
+    clearSamples();
+
+    if(failures == 0) ROS_INFO("Sources: the newest reference is always followed.");
+    return failures;
+}
+
+// Posts a ramp at POST_RATE as adaptiveGrasper previews it (the previous reference followed by the new one one post
+// period later), then holds it: the output must follow the delayed ramp and never overshoot when it stops
+int testPreview(ros::NodeHandle& nh, std::string interpolation){
+    setStreamParams(nh, "hold", interpolation);
+    ros::Subscriber sub = nh.subscribe("stream_test/arm_preview_" + interpolation, 1000, twistCallback);
+    robotCommander commander("stream_test/hand_preview_" + interpolation, "stream_test/arm_preview_" + interpolation, true);
+    if(!waitForConnection(sub)){
+        ROS_ERROR_STREAM("The commander for the " << interpolation << " preview did not connect!");
+        return 1;
+    }
+
+    const double period = 1.0 / POST_RATE;
+    const int ramp_posts = int(POST_TIME * POST_RATE);
+    Eigen::Matrix<double, 7, 1> x_ref = Eigen::Matrix<double, 7, 1>::Zero();
+    double preview[7] = {0.0};
+    double preview_time = period;
+    std::vector<double> post_times, post_values;
+    double previous = 0.0;
+    for(int i = 1; i <= 2 * ramp_posts; i++){
+        double value = RAMP_SLOPE * period * std::min(i, ramp_posts);
+        x_ref(1) = previous;
+        preview[1] = value;
+        post_times.push_back(nowSec());
+        post_values.push_back(value);
+        commander.postPreview(x_ref, preview, &preview_time, 1);
+        previous = value;
+        sleepFor(period);
+    }
+
+    // Checking the samples against the ramp from the previous reference to the new one (skipping the first post)
+    int failures = 0, checked = 0;
+    double max_error = 0.0, max_output = 0.0;
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    for(auto& sample : samples){
+        max_output = std::max(max_output, sample.second);
+        int k = int(std::upper_bound(post_times.begin(), post_times.end(), sample.first) - post_times.begin()) - 1;
+        if(k < 1 || sample.first - post_times[k] < MARGIN / 5.0) continue;
+        double s = std::min((sample.first - post_times[k]) / period, 1.0);
+        double expected = post_values[k - 1] + s * (post_values[k] - post_values[k - 1]);
+        if(interpolation == "none"){
+            // Each knot is held until the next one (the new reference is reached one post period later)
+            if(std::abs(sample.first - post_times[k] - period) < MARGIN / 5.0) continue;
+            expected = s < 1.0 ? post_values[k - 1] : post_values[k];
+        }
+        double error = std::abs(sample.second - expected);
+        max_error = std::max(max_error, error);
+        checked++;
+        if(error > RAMP_TOLERANCE) failures++;
+    }
+    samples.clear();
+
+    double final_value = post_values.back();
+    ROS_INFO_STREAM("Preview " << interpolation << ": " << checked << " samples checked, maximum error " << max_error
+        << ", maximum output " << max_output << " (final reference " << final_value << ").");
+    if(max_output > final_value + 1e-12){
+        ROS_ERROR_STREAM("The " << interpolation << " preview overshoots the final reference!");
+        failures++;
+    }
+    if(checked == 0 || failures > 0){
+        ROS_ERROR_STREAM("The " << interpolation << " preview failed on " << failures << " samples!");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+
+    // Starting the test node
+    std::cout<<std::endl;
+    std::cout<<"|Adaptive Grasping| -> Testing Robot Commander Streaming!"<<std::endl;
+    std::cout<<std::endl;
+
+    ros::init(argc, argv, "test_robot_commander_stream");
+    ros::NodeHandle nh;
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+
+    int failures = 0;
+    failures += testSources(nh);
+    failures += testWatchdog(nh, "hold");
+    failures += testWatchdog(nh, "decay");
+    failures += testWatchdog(nh, "zero");
+    failures += testPreview(nh, "none");
+    failures += testPreview(nh, "linear");
+    failures += testPreview(nh, "cubic");
+
+    if(failures > 0) ROS_ERROR_STREAM("Robot Commander Streaming Test failed " << failures << " checks!");
+    else ROS_INFO("Robot Commander Streaming Test passed!");
+
+    ROS_INFO("Exiting Robot Commander Streaming Test File");
+    spinner.stop();
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+/* For testing the time budget of contactPreserver: the previous solution fallback holds one scaled copy of the last
+ * full solution (it is not scaled again on every fallback tick) and, as adaptiveGrasper stores it in its solution
+ * cache, a tick over the budget is not replayed by the skip unchanged path */
+
+// Basic Includes
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <ros/ros.h>
+
+
+#include "contactPreserver.h"
+#include "utils/solution_cache.h"
+
+#define FALLBACK_SCALE      0.9         // As budget_fallback_scale of adaptive_params.yaml
+#define FALLBACK_TICKS      5           // Number of consecutive ticks over the budget
+#define TOLERANCE           1e-12       // Maximum difference of the solutions
+#define NUM_GENERATIONS     6           // As the inputs of adaptiveGrasper
+#define INPUT_GEN_CHANGED   4           // The input which changes (x_d)
+
+using namespace adaptive_grasping;
+
+int failures = 0;
+
+void check(bool condition, std::string what){
+    if(!condition){
+        ROS_ERROR_STREAM("Check failed: " << what << "!");
+        failures++;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    // Starting the test node
+    std::cout<<std::endl;
+    std::cout<<"|Adaptive Grasping| -> Testing Solver Budget!"<<std::endl;
+    std::cout<<std::endl;
+
+    ros::init(argc, argv, "test_solver_budget");
+    ros::NodeHandle nh;
+
+    // A hand with 4 joints and 1 synergy grasping with one soft finger contact (x_d has the synergy and the palm twist)
+    std::srand(42);
+    Eigen::MatrixXd S = Eigen::MatrixXd::Random(4, 1);
+    Eigen::MatrixXd J = Eigen::MatrixXd::Random(6, 4);
+    Eigen::MatrixXd G = Eigen::MatrixXd::Random(6, 6);
+    Eigen::MatrixXd T = Eigen::MatrixXd::Random(6, 6);
+    Eigen::MatrixXd H = Eigen::MatrixXd::Identity(6, 6);
+    Eigen::MatrixXd Kc = Eigen::MatrixXd::Identity(6, 6);
+    Eigen::VectorXd x_d = Eigen::VectorXd::Random(7);
+    Eigen::VectorXd f_d_d = Eigen::VectorXd::Zero(6);
+    std::map<int, std::tuple<std::string, Eigen::Affine3d, Eigen::Affine3d>> contacts_map;
+    contacts_map[1] = std::make_tuple("right_hand_thumb_distal_link", Eigen::Affine3d::Identity(), Eigen::Affine3d::Identity());
+
+    // The reference motion first, then the contact
+    contactPreserver preserver(S, 1, {7, 6}, {1, 2}, 0.001, 0.001);
+    preserver.setGraspState(J, G, T, H, Kc);
+    preserver.setMinimizationParams(x_d, f_d_d);
+    preserver.setPermutationParams(Eigen::MatrixXd::Identity(6, 6), 1);
+    preserver.set_contacts_and_selection(contacts_map, H);
+
+    // 1) Without a budget the full inversion is used
+    Eigen::VectorXd x_full;
+    preserver.setTimeBudget(0.0, FALLBACK_SCALE);
+    check(preserver.performKinInversion(x_full), "the full inversion failed");
+    check(preserver.getBudgetStats().last_fallback == FALLBACK_NONE, "a fallback was used without a budget");
+
+    // 2) A budget which no solve fits in: every tick sends the last full solution scaled once
+    preserver.setTimeBudget(1e-12, FALLBACK_SCALE);
+    double max_diff = 0.0;
+    for(int i = 0; i < FALLBACK_TICKS; i++){
+        Eigen::VectorXd x_fallback;
+        preserver.performKinInversion(x_fallback);
+        check(preserver.getBudgetStats().last_fallback == FALLBACK_PREVIOUS, "the previous solution was not reused");
+        max_diff = std::max(max_diff, (x_fallback - FALLBACK_SCALE * x_full).cwiseAbs().maxCoeff());
+    }
+    ROS_INFO_STREAM(FALLBACK_TICKS << " fallback ticks: maximum difference from the scaled full solution " << max_diff << ".");
+    check(max_diff < TOLERANCE, "the fallback is scaled again on every tick");
+    check(preserver.getBudgetStats().previous_fallbacks == FALLBACK_TICKS, "the fallbacks are not counted");
+
+    // 3) Once the budget allows it again the full inversion gives the same solution
+    Eigen::VectorXd x_again;
+    preserver.setTimeBudget(0.0, FALLBACK_SCALE);
+    preserver.performKinInversion(x_again);
+    check(preserver.getBudgetStats().last_fallback == FALLBACK_NONE, "the full inversion is not used again");
+    check((x_again - x_full).cwiseAbs().maxCoeff() < TOLERANCE, "the full inversion changed after the fallbacks");
+
+    // 4) The skip unchanged path of adaptiveGrasper (a tick stores its solution as exact only without a fallback):
+    // a tick over the budget is sent but recomputed on the next tick with the same inputs, a full one is replayed
+    solutionCache<NUM_GENERATIONS> cache;
+    unsigned long input_gen[NUM_GENERATIONS] = {1, 2, 3, 4, 5, 6};
+    Eigen::VectorXd x_tick;
+    preserver.setTimeBudget(1e-12, FALLBACK_SCALE);
+    bool no_relaxation = preserver.performKinInversion(x_tick);
+    cache.store(x_tick, input_gen, no_relaxation && preserver.getBudgetStats().last_fallback == FALLBACK_NONE);
+    check(cache.hasSolution() && cache.getSolution() == x_tick, "the reference of the tick over the budget is not sent");
+    check(!cache.canReplay(input_gen), "the tick over the budget is replayed while the inputs do not change");
+
+    preserver.setTimeBudget(0.0, FALLBACK_SCALE);
+    no_relaxation = preserver.performKinInversion(x_tick);
+    cache.store(x_tick, input_gen, no_relaxation && preserver.getBudgetStats().last_fallback == FALLBACK_NONE);
+    check(cache.canReplay(input_gen), "the full solution is not replayed while the inputs do not change");
+    input_gen[INPUT_GEN_CHANGED]++;
+    check(!cache.canReplay(input_gen), "the full solution is replayed after an input changed");
+    cache.reset();
+    input_gen[INPUT_GEN_CHANGED]--;
+    check(!cache.hasSolution() && !cache.canReplay(input_gen), "the solution is kept after a reset");
+
+    if(failures > 0) ROS_ERROR_STREAM("Solver Budget Test failed " << failures << " checks!");
+    else ROS_INFO("Solver Budget Test passed!");
+
+    ROS_INFO("Exiting Solver Budget Test File");
+    return failures > 0 ? 1 : 0;
+}
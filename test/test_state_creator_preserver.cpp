@@ -11,8 +11,11 @@
 #include "contactState.h"
 #include "matricesCreator.h"
 #include "contactPreserver.h"
+#include "jointStateHub.h"
 #include <utils/pseudo_inversion.h>
 #include <ros/subscribe_options.h>
+#include <tf/transform_listener.h>
+#include <tf_conversions/tf_eigen.h>
 
 // For RViz Visualization
 #include <visualization_msgs/Marker.h>
@@ -31,6 +34,8 @@ using namespace adaptive_grasping;
 
 // GLOBAL VARIABLES
 sensor_msgs::JointState::ConstPtr full_joint_state;	  // a msg where the subscriber will save the joint states
+jointStateHub js_hub;                               // indexed access to the needed joints of full_joint_state
+int hand_block;                                     // handle of the 33 hand joints in js_hub
 KDL::Tree robot_kin_tree;
 KDL::Chain robot_kin_chain;
 
@@ -41,30 +46,16 @@ Eigen::VectorXd jointsExtract(){
   // Creating the vector to be returned
   Eigen::VectorXd vector_js(8);
 
-  // Finding the states of arm and hand and pushing back
-  int index = find (full_joint_state->name.begin(),full_joint_state->name.end(), "right_arm_a1_joint") - full_joint_state->name.begin();
-	vector_js(0) = full_joint_state->position[index];
-
-  index = find (full_joint_state->name.begin(),full_joint_state->name.end(), "right_arm_a2_joint") - full_joint_state->name.begin();
-	vector_js(1) = full_joint_state->position[index];
-
-  index = find (full_joint_state->name.begin(),full_joint_state->name.end(), "right_arm_e1_joint") - full_joint_state->name.begin();
-	vector_js(2) = full_joint_state->position[index];
-
-  index = find (full_joint_state->name.begin(),full_joint_state->name.end(), "right_arm_a3_joint") - full_joint_state->name.begin();
-	vector_js(3) = full_joint_state->position[index];
-
-  index = find (full_joint_state->name.begin(),full_joint_state->name.end(), "right_arm_a4_joint") - full_joint_state->name.begin();
-	vector_js(4) = full_joint_state->position[index];
-
-  index = find (full_joint_state->name.begin(),full_joint_state->name.end(), "right_arm_a5_joint") - full_joint_state->name.begin();
-	vector_js(5) = full_joint_state->position[index];
-
-  index = find (full_joint_state->name.begin(),full_joint_state->name.end(), "right_arm_a6_joint") - full_joint_state->name.begin();
-	vector_js(6) = full_joint_state->position[index];
-
-  index = find (full_joint_state->name.begin(),full_joint_state->name.end(), "right_hand_synergy_joint") - full_joint_state->name.begin();
-	vector_js(7) = full_joint_state->position[index];
+  // Finding the states of arm and hand through the hub and pushing back
+  Eigen::VectorXd arm_js;
+  double synergy = 0.0;
+  js_hub.update(full_joint_state);
+  if(!js_hub.getArmJoints(arm_js) || !js_hub.getSynergy(synergy)){
+    ROS_ERROR("The arm or synergy joints are not in the joint states!");
+    vector_js.setZero();
+    return vector_js;
+  }
+  vector_js << arm_js, synergy;
 
   return vector_js;
 }
@@ -86,14 +77,14 @@ Eigen::MatrixXd computeSynergyMatrix(){
 	// Using the full joint state to compute the ratios
   Eigen::MatrixXd Syn(33, 1);
 
-  // Copying the values of the joints
-  int index = find (full_joint_state->name.begin(),full_joint_state->name.end(), "right_hand_thumb_abd_joint") - full_joint_state->name.begin();
-	for(int j = 0; j < 33; j++){
-    Syn(j) = full_joint_state->position[index + j];
+  // Copying the values of the joints and dividing by synergy value to find the Matrix
+  double synergy = 1.0;
+  if(!js_hub.update(full_joint_state) || !js_hub.getSynergy(synergy)){
+    ROS_ERROR("The hand joints are not in the joint states!");
+    Syn.setZero();
+    return Syn;
   }
-
-  // Dividing by synergy value to find the Matrix
-  Syn = Syn / full_joint_state->position[index - 1];
+  Syn = js_hub.getBlock(hand_block) / synergy;
 
   return Syn;
 }
@@ -130,6 +121,12 @@ int main(int argc, char **argv){
   ros::init(argc, argv, "test_state_creator_preserver");
   ros::NodeHandle nh;
 
+  // Registering the needed joints in the hub
+  js_hub.setArmJoints({"right_arm_a1_joint", "right_arm_a2_joint", "right_arm_e1_joint", "right_arm_a3_joint",
+    "right_arm_a4_joint", "right_arm_a5_joint", "right_arm_a6_joint"});
+  js_hub.setSynergyJoint("right_hand_synergy_joint");
+  hand_block = js_hub.addBlock("right_hand_thumb_abd_joint", 33);
+
   /*
       FOR CONTACT_STATE
   */
@@ -429,7 +426,8 @@ int main(int argc, char **argv){
     // Getting initial time
     initial_time = ros::Time::now();
 
-    // Reading the values of the contact_state_obj
+    // Applying the received touches and reading the values of the contact_state_obj
+    contact_state_obj.processPendingTouches();
     contact_state_obj.readValues(contacts_map_test, joints_map_test);
 
     // Setting the contacts_map and joints_map in creator and computing matrices